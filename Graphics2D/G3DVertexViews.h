@@ -0,0 +1,58 @@
+//
+//  G3DVertexViews.h
+//  Graphics3D
+//
+//  Copyright (c) 2014 Jeffrey Kesselman. All rights reserved.
+//
+
+#ifndef __G3DVertexViews_h
+#define __G3DVertexViews_h
+
+#include "Graphics3D.h"
+#include <cml/cml.h>
+
+namespace Graphics3D {
+
+    /**
+     * A cml vector aliasing one vertex's position or normal in place
+     */
+    typedef cml::vector<float, cml::external<3> > G3DVertexView;
+
+    /**
+     * A cml matrix aliasing a whole G3DVertexRange, one vertex per row
+     *
+     * With the row basis a deformer can transform every vertex at once, e.g.
+     * block = block * rotation, where rotation is a row_basis 3x3 matrix.
+     */
+    typedef cml::matrix<float, cml::external<>, cml::row_basis, cml::row_major> G3DVertexBlockView;
+
+    /**
+     * Returns a view of the position of the index'th vertex of a range
+     */
+    inline G3DVertexView PositionView(const G3DVertexRange& range, const unsigned int index){
+        return G3DVertexView(range.GetPositions()+index*3);
+    }
+
+    /**
+     * Returns a view of the normal of the index'th vertex of a range
+     */
+    inline G3DVertexView NormalView(const G3DVertexRange& range, const unsigned int index){
+        return G3DVertexView(range.GetNormals()+index*3);
+    }
+
+    /**
+     * Returns a count x 3 matrix view of the positions in a range
+     */
+    inline G3DVertexBlockView PositionBlock(const G3DVertexRange& range){
+        return G3DVertexBlockView(range.GetPositions(), range.GetCount(), 3);
+    }
+
+    /**
+     * Returns a count x 3 matrix view of the normals in a range
+     */
+    inline G3DVertexBlockView NormalBlock(const G3DVertexRange& range){
+        return G3DVertexBlockView(range.GetNormals(), range.GetCount(), 3);
+    }
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include "Graphics2DPriv.h"
 
 #include <string>
+#include <cmath>
 
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
@@ -104,7 +105,7 @@ namespace Graphics2D{
      * @param vec the Translation to apply represented as a Vector3
      */
 
-    void Transform2D::Translate(const Vector2 vec){
+    void Transform2D::Translate(const Vector2& vec){
         cml::matrix33f xlateMatrix;
         cml::matrix_translation_2D(xlateMatrix, vec._pimpl->vec);
        
@@ -131,7 +132,7 @@ namespace Graphics2D{
      * This transforms the passed in vec according to the current setting of the Transform3D
      * It doesnt modify its operands, but instead returns the result as a new Vector3.
      */
-    Vector2 Transform2D::TransformVec(const Vector2 sourceVec)const{
+    Vector2 Transform2D::TransformVec(const Vector2& sourceVec)const{
         cml::vector2f result =cml::transform_point_2D(_pimpl->matrix, sourceVec._pimpl->vec);
        return Vector2(result.data()[0],result.data()[1]);
    }
@@ -186,12 +187,25 @@ namespace Graphics2D{
      * matrix, returning the result as a new Transform3D.  It does not
      * modify either operand themselves.
      */
-    Transform2D Transform2D::operator*(const Transform2D other)const{
+    Transform2D Transform2D::operator*(const Transform2D& other)const{
         Transform2D result;
         result._pimpl->matrix=_pimpl->matrix*other._pimpl->matrix;
         return result;
     }
 
+    /**
+     * This decomposes the Transform2D about the passed handle.
+     *
+     * The rotation is the angle of the transformed x axis, and the translation
+     * is where the transform puts the handle.
+     */
+    void Transform2D::Decompose(const Vector2& handle, float& radians, Vector2& translation)const{
+        const cml::matrix33f& m = _pimpl->matrix;
+        radians = std::atan2(m.basis_element(0,1), m.basis_element(0,0));
+        cml::vector2f result = cml::transform_point_2D(m, handle._pimpl->vec);
+        translation = Vector2(result.data()[0],result.data()[1]);
+    }
+
     /*** GraphicsProvider2DPriv Impementation  ***/
     /**
      * This callback is registered with GLFW to handle key events in
@@ -210,7 +224,7 @@ namespace Graphics2D{
      * @param width the width of the window in screen pixels
      * @param the height of the window in screen pixels.
      */
-    GraphicsProvider2D* GraphicsProvider2D::MakeNewProvider(const std::string windowName,const int width, const int height){
+    GraphicsProvider2D* GraphicsProvider2D::MakeNewProvider(const std::string& windowName,const int width, const int height){
         return (GraphicsProvider2D* )new GraphicsProvider2DPriv(windowName,width,height);
     }
     
@@ -219,7 +233,7 @@ namespace Graphics2D{
      * This is the private constructor that is used by the factory method to actually create the
      * window
      */
-    GraphicsProvider2DPriv::GraphicsProvider2DPriv(const std::string title, const int windowWidth,const int windowHeight){
+    GraphicsProvider2DPriv::GraphicsProvider2DPriv(const std::string& title, const int windowWidth,const int windowHeight){
         
         
         /* Initialize the library */
@@ -251,7 +265,7 @@ namespace Graphics2D{
      * This method loads an image bitmap at the passed relative or absolute path and returns 
      * a pointer to a G2DImage object that represents it.
      */
-    G2DImage* GraphicsProvider2DPriv::LoadImage(const std::string path)const{
+    G2DImage* GraphicsProvider2DPriv::LoadImage(const std::string& path)const{
         /* load an image file directly as a new OpenGL texture */
         GLuint texName = SOIL_load_OGL_texture(path.c_str(),SOIL_LOAD_AUTO,SOIL_CREATE_NEW_ID,
          SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
@@ -300,7 +314,7 @@ namespace Graphics2D{
      * @param transform the Transform3D to apply to its vertices
      */
 
-    void GraphicsProvider2DPriv::DrawImage(const G2DImage *image, const Rectangle source, const Transform2D transform)const{
+    void GraphicsProvider2DPriv::DrawImage(const G2DImage *image, const Rectangle& source, const Transform2D& transform)const{
         G2DImagePriv* img = (G2DImagePriv *)image;
         
         // figure dest coords
@@ -170,7 +170,7 @@ namespace Graphics2D {
          * @param vec  a 2D vector containing the X and Y offsets
          *
          */
-        void Translate(const Vector2 vec);
+        void Translate(const Vector2& vec);
         
         /**
          * Rotates the transform about the Z axis
@@ -193,7 +193,7 @@ namespace Graphics2D {
          * @param sourceVec  the vector containing the x and y coords to transform
          * @returns a vector cntaing the newly transfromed x and y coords.
          */
-        Vector2 TransformVec(const Vector2 sourceVec)const;
+        Vector2 TransformVec(const Vector2& sourceVec)const;
         
         /**
          *Calculates the result of applying this transform to a set of coords
@@ -245,7 +245,20 @@ namespace Graphics2D {
          * @param other The transform to append to append its rotations and translations to this one
          * @param returns The result of appending the second parameter of a * expression to the first
          */
-        Transform2D operator*(const Transform2D other)const;
+        Transform2D operator*(const Transform2D& other)const;
+        
+        /**
+         * Splits this transform into a rotation and translation about a handle
+         *
+         * Given the handle, this finds the rotation and translation that rebuild this
+         * transform when applied as Translate(handle*-1), Rotate(radians), Translate(translation).
+         * Any scale in the transform is discarded.
+         *
+         * @param handle the handle the transform is rotated about
+         * @param radians receives the rotation about the Z axis in radians
+         * @param translation receives the translation
+         */
+        void Decompose(const Vector2& handle, float& radians, Vector2& translation)const;
         
     };
 
@@ -316,7 +329,7 @@ namespace Graphics2D {
              * @param height the height of the drawing space (window) in pixels
              * @return An instance of a sub class of GraphicsProvider2D
              */
-            static GraphicsProvider2D* MakeNewProvider(const std::string windowName,const int width, const int height);
+            static GraphicsProvider2D* MakeNewProvider(const std::string& windowName,const int width, const int height);
         
             /**
              * This method load a 2D image froma file path and creates a G2DImage object that encapsulates it
@@ -327,7 +340,7 @@ namespace Graphics2D {
              *
              * @param path The relative path from the CWD or an absolute path where the image file is kept.
              */
-            virtual G2DImage* LoadImage(const std::string path)const=0;
+            virtual G2DImage* LoadImage(const std::string& path)const=0;
              /**
               * This method must be called to start drawing a new video frame
              */
@@ -344,7 +357,7 @@ namespace Graphics2D {
              * and height <= image->GetHeight
              * @param transform  a tranformation matrix to apply to the image in order to position and rotate it.
              */
-            virtual void DrawImage(const G2DImage* image,const Rectangle source, const Transform2D transform)const=0;
+            virtual void DrawImage(const G2DImage* image,const Rectangle& source, const Transform2D& transform)const=0;
             /**
              * This method must be called after all images for a frame have been drawn in order to complete the 
              * frame and swap it to the screen.
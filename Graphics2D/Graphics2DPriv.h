@@ -30,10 +30,10 @@ namespace Graphics2D{
         public:
             void* user_data_ptr;
             
-        GraphicsProvider2DPriv(const std::string title, const int windowWidth,const int windowHeight);
-        G2DImage* LoadImage(const std::string path)const;
+        GraphicsProvider2DPriv(const std::string& title, const int windowWidth,const int windowHeight);
+        G2DImage* LoadImage(const std::string& path)const;
         void BeginFrame()const;
-        void DrawImage(const G2DImage* sprite,const Rectangle source, const Transform2D transform)const;
+        void DrawImage(const G2DImage* sprite,const Rectangle& source, const Transform2D& transform)const;
         void EndFrame()const;
         ~GraphicsProvider2DPriv();
         void SetKeyCallback(const KeyCallback keyCallback){
@@ -52,7 +52,7 @@ namespace Graphics2D{
             GLuint _texname;
             int _width,_height;
         
-            G2DImagePriv(const std::string path,const GLuint texname){
+            G2DImagePriv(const std::string& path,const GLuint texname){
                 _path=path;
                 _texname=texname;
                 glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &_width);
@@ -12,6 +12,15 @@
 #include "Graphics3DPriv.h"
 
 #include <string>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
@@ -20,55 +29,73 @@
 #include "SOIL.h"
 #include <cml/cml.h>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 
 
 namespace Graphics3D {
     /*** Vector3 Implementation ***/
     /**
-     * This struct is the internal Implementation of the Vector3 data
-     * It is defined as a struct in the CPP file rather then in the
-     * header file in order to isolate clients from the immplementation
+     * Vector3 keeps its values inline so that it can be passed, copied and
+     * returned without any heap traffic.  Check that it stays that way.
      */
-    struct Vector3::Implementation {
-        cml::vector3f vec = cml::vector3f(0,0,0);
-    };
+    static_assert(std::is_trivially_copyable<Vector3>::value,
+                  "Vector3 must be trivially copyable");
+    static_assert(sizeof(Vector3) == 3*sizeof(float),
+                  "Vector3 must be the size of three floats");
+    static_assert(std::is_standard_layout<Vector3>::value,
+                  "An array of Vector3 must be readable as packed x,y,z floats");
+
+    /**
+     * This is a cml vector that uses a Vector3's own value block as its
+     * storage.  It lets the implementation apply cml operations to a
+     * Vector3 without copying its values into a temporary.
+     */
+    typedef cml::vector<float, cml::external<3> > vector3f_view;
 
     /**
-     * This is the default constructor for Vector 3 which creates am
-     * Instance of Implementation and sets a shared pr to reference it
+     * This is the default constructor for Vector 3 which creates
+     * the vector (0,0,0)
      */
     Vector3::Vector3(){
-        _pimpl.reset(new Implementation);
+        _vec[0] = 0;
+        _vec[1] = 0;
+        _vec[2] = 0;
     }
 
     /**
-     * This is the value constructor which creates an instance of Implementation
-     * and sets its internal cml::vector3f to the passed x, y and z values
+     * This is the value constructor which sets the
+     * vector's values to the passed x, y and z values
      */
     Vector3::Vector3(const float x, const float y, const float z){
-        _pimpl.reset(new Implementation);
-        _pimpl->vec = cml::vector3f(x,y,z);
+        _vec[0] = x;
+        _vec[1] = y;
+        _vec[2] = z;
     }
 
     /**
      * This returns the X value from the internal representation
      */
     float Vector3::GetX()const{
-        return _pimpl->vec.data()[0];
+        return _vec[0];
     }
 
     /**
      * This returns the Y value from the internal representation
      */
     float Vector3::GetY()const{
-        return _pimpl->vec.data()[1];
+        return _vec[1];
     }
     
     /**
      * This returns the Z value from the internal representation
      */
     float Vector3::GetZ()const{
-        return _pimpl->vec.data()[2];
+        return _vec[2];
     }
 
     /**
@@ -77,7 +104,7 @@ namespace Graphics3D {
      * the operands.
      */
     Vector3 Vector3::operator*(const float f)const{
-        return Vector3(_pimpl->vec.data()[0]*f,_pimpl->vec.data()[1]*f,_pimpl->vec.data()[2]);
+        return Vector3(_vec[0]*f,_vec[1]*f,_vec[2]*f);
     }
 
     /**
@@ -86,71 +113,256 @@ namespace Graphics3D {
      * the operands.
      */
     Vector3 Vector3::operator/(const float f)const{
-        return Vector3(_pimpl->vec.data()[0]/f,_pimpl->vec.data()[1]/f,_pimpl->vec.data()[2]);
+        return Vector3(_vec[0]/f,_vec[1]/f,_vec[2]/f);
+    }
+
+
+
+    /*** Quaternion Implementation ***/
+    static_assert(std::is_trivially_copyable<Quaternion>::value,
+                  "Quaternion must be trivially copyable");
+
+    /**
+     * This is a cml quaternion that uses a Quaternion's own value block
+     * as its storage.
+     */
+    typedef cml::quaternion<float, cml::external<>, cml::vector_first, cml::positive_cross> quaternionf_view;
+
+    /**
+     * This is the default constructor for Quaternion which creates
+     * the identity rotation
+     */
+    Quaternion::Quaternion(){
+        _quat[0] = 0;
+        _quat[1] = 0;
+        _quat[2] = 0;
+        _quat[3] = 1;
+    }
+
+    /**
+     * This is the value constructor which sets the
+     * quaternion's values to the passed x, y, z and w values
+     */
+    Quaternion::Quaternion(const float x, const float y, const float z, const float w){
+        _quat[0] = x;
+        _quat[1] = y;
+        _quat[2] = z;
+        _quat[3] = w;
+    }
+
+    /**
+     * This builds a Quaternion from euler angles applied in the order x,y,z
+     */
+    Quaternion Quaternion::FromEulerAngles(const Vector3& eulerAngles){
+        Quaternion result;
+        quaternionf_view quat(result._quat);
+        cml::quaternion_rotation_euler(quat, eulerAngles.GetX(), eulerAngles.GetY(), eulerAngles.GetZ(),
+                                       cml::euler_order_xyz);
+        return result;
+    }
+
+    /**
+     * This returns a set of euler angles, applied in the order x,y,z,
+     * that describe the same rotation as the Quaternion
+     */
+    Vector3 Quaternion::ToEulerAngles()const{
+        quaternionf_view quat(const_cast<float*>(_quat));
+        float x, y, z;
+        cml::quaternion_to_euler(quat, x, y, z, cml::euler_order_xyz);
+        return Vector3(x,y,z);
+    }
+
+    /**
+     * This returns the X value from the internal representation
+     */
+    float Quaternion::GetX()const{
+        return _quat[0];
+    }
+
+    /**
+     * This returns the Y value from the internal representation
+     */
+    float Quaternion::GetY()const{
+        return _quat[1];
+    }
+
+    /**
+     * This returns the Z value from the internal representation
+     */
+    float Quaternion::GetZ()const{
+        return _quat[2];
+    }
+
+    /**
+     * This returns the W value from the internal representation
+     */
+    float Quaternion::GetW()const{
+        return _quat[3];
     }
 
 
 
     /*** Transform implementaton ***/
     
+    static_assert(sizeof(Transform3D) <= 17*sizeof(float),
+                  "Transform3D must be a 4x4 float matrix plus its kind");
+
     /**
-     * This struct is the internal Implementation of the Transform3D data
-     * It is defined as a struct in the CPP file rather then in the
-     * header file in order to isolate clients from the immplementation
+     * This is a cml matrix that uses a Transform3D's own value block as
+     * its storage.  It has the same basis and layout as a cml::matrix44f_c
+     * so that cml operations can be applied to a Transform3D in place.
      */
-    struct Transform3D::Implementation {
-        cml::matrix44f_c matrix;
-    };
+    typedef cml::matrix<float, cml::external<4,4>, cml::col_basis, cml::col_major> matrix44f_view;
+
+    /**
+     * This returns the index into a column major 4x4 value block of the
+     * element at the given row and column
+     */
+    static inline int Elem(const int row, const int col){
+        return col*4+row;
+    }
     
     /**
-     * This is the default constructor for Transform3D which creates am
-     * Instance of Implementation and sets a shared pr to reference it
+     * This is the default constructor for Transform3D
      *
      * A Transform3D starts out as the Identity transform
      */
 
     Transform3D::Transform3D(){
-        _pimpl.reset(new Implementation);
-        _pimpl->matrix = cml::identity(_pimpl->matrix);
+        matrix44f_view matrix(_matrix);
+        cml::identity_transform(matrix);
+        _kind = RIGID;
     }
 
 
+    /**
+     * This is the constructor that builds a handle, rotation, translation transform
+     *
+     * The result is T(translation)*R(rotation)*T(-handle).  Its upper 3x3 is the
+     * rotation matrix and its last column is translation-R*handle, so it is written
+     * out directly rather than built up from three separate matrix operations.
+     */
+    Transform3D::Transform3D(const Vector3& handle, const Quaternion& rotation, const Vector3& translation){
+        cml::matrix33f_c rotMatrix;
+        quaternionf_view quat(const_cast<float*>(rotation._quat));
+        cml::matrix_rotation_quaternion(rotMatrix, quat);
+        const float* r = rotMatrix.data();
+        const float hx = handle._vec[0];
+        const float hy = handle._vec[1];
+        const float hz = handle._vec[2];
+        for(int col=0;col<3;col++){
+            _matrix[Elem(0,col)] = r[col*3];
+            _matrix[Elem(1,col)] = r[col*3+1];
+            _matrix[Elem(2,col)] = r[col*3+2];
+            _matrix[Elem(3,col)] = 0;
+        }
+        _matrix[Elem(0,3)] = translation._vec[0] - (r[0]*hx + r[3]*hy + r[6]*hz);
+        _matrix[Elem(1,3)] = translation._vec[1] - (r[1]*hx + r[4]*hy + r[7]*hz);
+        _matrix[Elem(2,3)] = translation._vec[2] - (r[2]*hx + r[5]*hy + r[8]*hz);
+        _matrix[Elem(3,3)] = 1;
+        _kind = RIGID;
+    }
+
+    /**
+     * This returns true if the upper 3x3 of a column major 4x4 value block
+     * is a rotation, that is if its columns are orthonormal and it does not
+     * mirror.
+     */
+    static bool IsRotation(const float* m){
+        const float epsilon = 1e-5f;
+        for(int a=0;a<3;a++){
+            for(int b=a;b<3;b++){
+                const float dot = m[Elem(0,a)]*m[Elem(0,b)] + m[Elem(1,a)]*m[Elem(1,b)] + m[Elem(2,a)]*m[Elem(2,b)];
+                if (std::fabs(dot - (a==b ? 1.0f : 0.0f)) > epsilon){
+                    return false;
+                }
+            }
+        }
+        const float det = m[Elem(0,0)]*(m[Elem(1,1)]*m[Elem(2,2)] - m[Elem(2,1)]*m[Elem(1,2)])
+                        - m[Elem(0,1)]*(m[Elem(1,0)]*m[Elem(2,2)] - m[Elem(2,0)]*m[Elem(1,2)])
+                        + m[Elem(0,2)]*(m[Elem(1,0)]*m[Elem(2,1)] - m[Elem(2,0)]*m[Elem(1,1)]);
+        return det > 0;
+    }
+
+    /**
+     * This is the constructor that copies a raw column major matrix
+     *
+     * The matrix is inspected to find its kind, so that one that is only a
+     * rotation and translation still gets the RIGID fast paths.
+     */
+    Transform3D::Transform3D(const float oglData[16]){
+        std::copy(oglData, oglData+16, _matrix);
+        if (_matrix[Elem(3,0)]!=0 || _matrix[Elem(3,1)]!=0 ||
+            _matrix[Elem(3,2)]!=0 || _matrix[Elem(3,3)]!=1){
+            _kind = GENERAL;
+        } else if (IsRotation(_matrix)){
+            _kind = RIGID;
+        } else {
+            _kind = AFFINE;
+        }
+    }
+
     /**
      * This modifies the Transform3D, translating it with the 
      * passed in Vector3
      *
+     * Pre-multiplying by a translation only adds a multiple of the bottom
+     * row to each of the top three rows, so this is done directly on the
+     * value block rather than by building and multiplying a translation matrix.
+     * When the bottom row is known to be (0,0,0,1) that is just an add to the
+     * last column.
+     *
      * @param vec the Translation to apply represented as a Vector3
      */
-    void Transform3D::Translate(const Vector3 vec){
-        cml::matrix44f_c xlateMatrix;
-        cml::matrix_translation(xlateMatrix, vec._pimpl->vec);
-        
-        xlateMatrix = xlateMatrix*_pimpl->matrix;
-        _pimpl.reset(new Implementation);
-        _pimpl->matrix = xlateMatrix;
+    void Transform3D::Translate(const Vector3& vec){
+        if (_kind!=GENERAL){
+            _matrix[Elem(0,3)] += vec._vec[0];
+            _matrix[Elem(1,3)] += vec._vec[1];
+            _matrix[Elem(2,3)] += vec._vec[2];
+            return;
+        }
+        for(int col=0;col<4;col++){
+            const float w = _matrix[Elem(3,col)];
+            _matrix[Elem(0,col)] += vec._vec[0]*w;
+            _matrix[Elem(1,col)] += vec._vec[1]*w;
+            _matrix[Elem(2,col)] += vec._vec[2]*w;
+        }
     }
 
     /**
      * This modifies the Transform3D, rotating it with the
      * passed in Vector3.  Angles are applied in the order x,y,z
      *
+     * A rotation only mixes the top three rows of the matrix, so this
+     * builds a 3x3 rotation and pre-multiplies it onto those rows in place
+     * rather than doing a full 4x4 multiply.
+     *
      * @param vec the Rotation to apply represented as a Vector3 of euler angles
      */
-    void Transform3D::Rotate(const Vector3 eulerAngles){
-        cml::matrix44f_c rotMatrix;
-        cml::matrix_rotation_euler(rotMatrix, eulerAngles.GetX(), eulerAngles.GetY(), eulerAngles.GetZ(), cml::euler_order_xyz);
-        rotMatrix = rotMatrix*_pimpl->matrix;
-        _pimpl.reset(new Implementation);
-        _pimpl->matrix = rotMatrix;
+    void Transform3D::Rotate(const Vector3& eulerAngles){
+        cml::matrix33f_c rotMatrix;
+        cml::matrix_rotation_euler(rotMatrix, eulerAngles._vec[0], eulerAngles._vec[1], eulerAngles._vec[2], cml::euler_order_xyz);
+        const float* r = rotMatrix.data();
+        for(int col=0;col<4;col++){
+            float* m = &_matrix[Elem(0,col)];
+            const float x = m[0];
+            const float y = m[1];
+            const float z = m[2];
+            m[0] = r[0]*x + r[3]*y + r[6]*z;
+            m[1] = r[1]*x + r[4]*y + r[7]*z;
+            m[2] = r[2]*x + r[5]*y + r[8]*z;
+        }
     }
 
     /**
      * This transforms the passed in vec according to the current setting of the Transform3D
      * It doesnt modify its operands, but instead returns the result as a new Vector3.
      */
-    Vector3 Transform3D::TransformVec(const Vector3 sourceVec)const{
-        cml::vector3f result =cml::transform_point(_pimpl->matrix, sourceVec._pimpl->vec);
-        return Vector3(result.data()[0],result.data()[1],result.data()[3]);
+    Vector3 Transform3D::TransformVec(const Vector3& sourceVec)const{
+        matrix44f_view matrix(const_cast<float*>(_matrix));
+        vector3f_view source(const_cast<float*>(sourceVec._vec));
+        cml::vector3f result =cml::transform_point(matrix, source);
+        return Vector3(result.data()[0],result.data()[1],result.data()[2]);
     }
 
     /*
@@ -161,6 +373,15 @@ namespace Graphics3D {
         sourceVec = TransformVec(sourceVec);
     }
 
+    /**
+     * Rejects a negative start or length before it reaches the size_t batch calls
+     */
+    static void CheckVecRange(const int start, const int len){
+        if (start<0 || len<0){
+            throw std::runtime_error("Transform3D::TransformVecs: negative start or length");
+        }
+    }
+
     /**
      * This transforms an array of Vector3 according to the current Transform3D state
      * It returns the result as a new array of vector3 of length len
@@ -174,10 +395,9 @@ namespace Graphics3D {
      * @return A new array of Vector3
      */
     Vector3* Transform3D::TransformVecs(const Vector3 sourceVec[],const int start, const int len)const{
+        CheckVecRange(start, len);
         Vector3* newVecs = new Vector3[len];
-        for(int i=0;i<len;i++){
-            newVecs[i] = TransformVec(sourceVec[start+i]);
-        }
+        TransformPoints(sourceVec[start]._vec, newVecs[0]._vec, static_cast<size_t>(len));
         return newVecs;
     }
 
@@ -191,8 +411,127 @@ namespace Graphics3D {
      * @param len the number of Vector3 to transform
      */
     void  Transform3D::TransformVecsInPlace(Vector3 sourceVec[],const int start, const int len)const{
-        for(int i=0;i<len;i++){
-            sourceVec[start+i] = TransformVec(sourceVec[start+i]);
+        CheckVecRange(start, len);
+        TransformPoints(sourceVec[start]._vec, sourceVec[start]._vec, static_cast<size_t>(len));
+    }
+
+    /**
+     * This transforms count points held as separate x, y and z arrays.
+     *
+     * The matrix is affine so each output coordinate is a dot product of a
+     * matrix row with (x,y,z,1).  The rows are broadcast once and then applied
+     * to 8 (AVX) or 4 (SSE) points per step, with a scalar loop for the remainder.
+     * Each lane only reads its own point before writing it, so the output arrays
+     * may alias the input arrays.
+     */
+    void Transform3D::TransformPoints(const float* xs, const float* ys, const float* zs,
+                                      float* outXs, float* outYs, float* outZs, const size_t count)const{
+        const float* m = _matrix;
+        size_t i=0;
+#if defined(__AVX__)
+        const __m256 m0 = _mm256_set1_ps(m[0]), m4 = _mm256_set1_ps(m[4]),
+                     m8 = _mm256_set1_ps(m[8]), m12 = _mm256_set1_ps(m[12]);
+        const __m256 m1 = _mm256_set1_ps(m[1]), m5 = _mm256_set1_ps(m[5]),
+                     m9 = _mm256_set1_ps(m[9]), m13 = _mm256_set1_ps(m[13]);
+        const __m256 m2 = _mm256_set1_ps(m[2]), m6 = _mm256_set1_ps(m[6]),
+                     m10 = _mm256_set1_ps(m[10]), m14 = _mm256_set1_ps(m[14]);
+        for(;i+8<=count;i+=8){
+            const __m256 x = _mm256_loadu_ps(xs+i);
+            const __m256 y = _mm256_loadu_ps(ys+i);
+            const __m256 z = _mm256_loadu_ps(zs+i);
+            const __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0,x),_mm256_mul_ps(m4,y)),
+                                            _mm256_add_ps(_mm256_mul_ps(m8,z),m12));
+            const __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1,x),_mm256_mul_ps(m5,y)),
+                                            _mm256_add_ps(_mm256_mul_ps(m9,z),m13));
+            const __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2,x),_mm256_mul_ps(m6,y)),
+                                            _mm256_add_ps(_mm256_mul_ps(m10,z),m14));
+            _mm256_storeu_ps(outXs+i, rx);
+            _mm256_storeu_ps(outYs+i, ry);
+            _mm256_storeu_ps(outZs+i, rz);
+        }
+#elif defined(__SSE__)
+        const __m128 m0 = _mm_set1_ps(m[0]), m4 = _mm_set1_ps(m[4]),
+                     m8 = _mm_set1_ps(m[8]), m12 = _mm_set1_ps(m[12]);
+        const __m128 m1 = _mm_set1_ps(m[1]), m5 = _mm_set1_ps(m[5]),
+                     m9 = _mm_set1_ps(m[9]), m13 = _mm_set1_ps(m[13]);
+        const __m128 m2 = _mm_set1_ps(m[2]), m6 = _mm_set1_ps(m[6]),
+                     m10 = _mm_set1_ps(m[10]), m14 = _mm_set1_ps(m[14]);
+        for(;i+4<=count;i+=4){
+            const __m128 x = _mm_loadu_ps(xs+i);
+            const __m128 y = _mm_loadu_ps(ys+i);
+            const __m128 z = _mm_loadu_ps(zs+i);
+            const __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0,x),_mm_mul_ps(m4,y)),
+                                         _mm_add_ps(_mm_mul_ps(m8,z),m12));
+            const __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1,x),_mm_mul_ps(m5,y)),
+                                         _mm_add_ps(_mm_mul_ps(m9,z),m13));
+            const __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2,x),_mm_mul_ps(m6,y)),
+                                         _mm_add_ps(_mm_mul_ps(m10,z),m14));
+            _mm_storeu_ps(outXs+i, rx);
+            _mm_storeu_ps(outYs+i, ry);
+            _mm_storeu_ps(outZs+i, rz);
+        }
+#endif
+        for(;i<count;i++){
+            const float x = xs[i];
+            const float y = ys[i];
+            const float z = zs[i];
+            outXs[i] = m[0]*x + m[4]*y + m[8]*z + m[12];
+            outYs[i] = m[1]*x + m[5]*y + m[9]*z + m[13];
+            outZs[i] = m[2]*x + m[6]*y + m[10]*z + m[14];
+        }
+    }
+
+    /**
+     * This transforms count points held as interleaved x,y,z triples.
+     *
+     * With SSE, four points (three registers) are loaded at a time and shuffled
+     * into x, y and z registers, transformed as in the structure-of-arrays case,
+     * and shuffled back before being stored.  A whole block is read before any
+     * of it is written, so the output may alias the input.
+     */
+    void Transform3D::TransformPoints(const float* xyz, float* outXyz, const size_t count)const{
+        const float* m = _matrix;
+        size_t i=0;
+#if defined(__SSE__)
+        const __m128 m0 = _mm_set1_ps(m[0]), m4 = _mm_set1_ps(m[4]),
+                     m8 = _mm_set1_ps(m[8]), m12 = _mm_set1_ps(m[12]);
+        const __m128 m1 = _mm_set1_ps(m[1]), m5 = _mm_set1_ps(m[5]),
+                     m9 = _mm_set1_ps(m[9]), m13 = _mm_set1_ps(m[13]);
+        const __m128 m2 = _mm_set1_ps(m[2]), m6 = _mm_set1_ps(m[6]),
+                     m10 = _mm_set1_ps(m[10]), m14 = _mm_set1_ps(m[14]);
+        for(;i+4<=count;i+=4){
+            // a0 = x0 y0 z0 x1, a1 = y1 z1 x2 y2, a2 = z2 x3 y3 z3
+            const __m128 a0 = _mm_loadu_ps(xyz+i*3);
+            const __m128 a1 = _mm_loadu_ps(xyz+i*3+4);
+            const __m128 a2 = _mm_loadu_ps(xyz+i*3+8);
+            const __m128 x = _mm_shuffle_ps(a0, _mm_shuffle_ps(a1,a2,_MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+            const __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a0,a1,_MM_SHUFFLE(0,0,1,1)),
+                                            _mm_shuffle_ps(a1,a2,_MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+            const __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a0,a1,_MM_SHUFFLE(1,1,2,2)), a2, _MM_SHUFFLE(3,0,2,0));
+            const __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0,x),_mm_mul_ps(m4,y)),
+                                         _mm_add_ps(_mm_mul_ps(m8,z),m12));
+            const __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1,x),_mm_mul_ps(m5,y)),
+                                         _mm_add_ps(_mm_mul_ps(m9,z),m13));
+            const __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2,x),_mm_mul_ps(m6,y)),
+                                         _mm_add_ps(_mm_mul_ps(m10,z),m14));
+            const __m128 b0 = _mm_shuffle_ps(_mm_shuffle_ps(rx,ry,_MM_SHUFFLE(0,0,0,0)),
+                                             _mm_shuffle_ps(rz,rx,_MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0));
+            const __m128 b1 = _mm_shuffle_ps(_mm_shuffle_ps(ry,rz,_MM_SHUFFLE(1,1,1,1)),
+                                             _mm_shuffle_ps(rx,ry,_MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0));
+            const __m128 b2 = _mm_shuffle_ps(_mm_shuffle_ps(rz,rx,_MM_SHUFFLE(3,3,2,2)),
+                                             _mm_shuffle_ps(ry,rz,_MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+            _mm_storeu_ps(outXyz+i*3, b0);
+            _mm_storeu_ps(outXyz+i*3+4, b1);
+            _mm_storeu_ps(outXyz+i*3+8, b2);
+        }
+#endif
+        for(;i<count;i++){
+            const float x = xyz[i*3];
+            const float y = xyz[i*3+1];
+            const float z = xyz[i*3+2];
+            outXyz[i*3]   = m[0]*x + m[4]*y + m[8]*z + m[12];
+            outXyz[i*3+1] = m[1]*x + m[5]*y + m[9]*z + m[13];
+            outXyz[i*3+2] = m[2]*x + m[6]*y + m[10]*z + m[14];
         }
     }
 
@@ -200,19 +539,499 @@ namespace Graphics3D {
      * This function post-multiplies the Transform3D's matrix with another Transform3D's
      * matrix, returning the result as a new Transform3D.  It does not
      * modify either operand themselves.
+     *
+     * When neither operand is GENERAL both bottom rows are (0,0,0,1), so only the
+     * top 3x4 of the product is computed, which takes 36 multiply-adds rather than 64.
+     * The product is written straight into the result's value block.
      */
-    Transform3D Transform3D::operator*(const Transform3D other)const{
+    Transform3D Transform3D::operator*(const Transform3D& other)const{
         Transform3D result;
-        result._pimpl->matrix=_pimpl->matrix*other._pimpl->matrix;
+        result._kind = _kind>other._kind ? _kind : other._kind;
+        if (result._kind!=GENERAL){
+            const float* a = _matrix;
+            const float* b = other._matrix;
+            float* c = result._matrix;
+            for(int col=0;col<4;col++){
+                const float b0 = b[Elem(0,col)];
+                const float b1 = b[Elem(1,col)];
+                const float b2 = b[Elem(2,col)];
+                for(int row=0;row<3;row++){
+                    c[Elem(row,col)] = a[Elem(row,0)]*b0 + a[Elem(row,1)]*b1 + a[Elem(row,2)]*b2;
+                }
+            }
+            c[Elem(0,3)] += a[Elem(0,3)];
+            c[Elem(1,3)] += a[Elem(1,3)];
+            c[Elem(2,3)] += a[Elem(2,3)];
+            return result;
+        }
+        matrix44f_view lhs(const_cast<float*>(_matrix));
+        matrix44f_view rhs(const_cast<float*>(other._matrix));
+        matrix44f_view product(result._matrix);
+        product = lhs*rhs;
         return result;
     }
+
+    /**
+     * This computes the inverse of the Transform3D's matrix into inverse.
+     *
+     * A RIGID transform's rotation is orthonormal, so its inverse is its
+     * transpose and the translation is the negated translation rotated by that
+     * transpose.  An AFFINE transform inverts just its 3x3 part.  Only a
+     * GENERAL transform goes through cml's full 4x4 inverse.
+     */
+    void Transform3D::InverseData(float inverse[16])const{
+        const float* m = _matrix;
+        float* r = inverse;
+        if (_kind==GENERAL){
+            matrix44f_view source(const_cast<float*>(_matrix));
+            matrix44f_view result(inverse);
+            result = cml::inverse(source);
+            return;
+        }
+        if (_kind==RIGID){
+            for(int row=0;row<3;row++){
+                for(int col=0;col<3;col++){
+                    r[Elem(row,col)] = m[Elem(col,row)];
+                }
+            }
+        } else {
+            cml::matrix33f_c linear;
+            for(int row=0;row<3;row++){
+                for(int col=0;col<3;col++){
+                    linear(row,col) = m[Elem(row,col)];
+                }
+            }
+            cml::matrix33f_c inverse = cml::inverse(linear);
+            for(int row=0;row<3;row++){
+                for(int col=0;col<3;col++){
+                    r[Elem(row,col)] = inverse(row,col);
+                }
+            }
+        }
+        const float tx = m[Elem(0,3)];
+        const float ty = m[Elem(1,3)];
+        const float tz = m[Elem(2,3)];
+        for(int row=0;row<3;row++){
+            r[Elem(row,3)] = -(r[Elem(row,0)]*tx + r[Elem(row,1)]*ty + r[Elem(row,2)]*tz);
+            r[Elem(3,row)] = 0;
+        }
+        r[Elem(3,3)] = 1;
+    }
+
+    /**
+     * This returns the inverse of the Transform3D as a new Transform3D.
+     *
+     * The inverse is written straight into the result's value block and
+     * has the same kind as this Transform3D.
+     */
+    Transform3D Transform3D::Inverse()const{
+        Transform3D result;
+        InverseData(result._matrix);
+        result._kind = _kind;
+        return result;
+    }
+
+    /**
+     * This returns the inverse transpose of the Transform3D's upper 3x3 in
+     * column major order.
+     *
+     * For a RIGID transform that is the rotation itself, so the inverse is
+     * not needed.  Otherwise it is the transpose of the inverse's upper 3x3.
+     */
+    void Transform3D::InverseTranspose3x3(float normalMatrix[9])const{
+        if (_kind==RIGID){
+            for(int col=0;col<3;col++){
+                for(int row=0;row<3;row++){
+                    normalMatrix[col*3+row] = _matrix[Elem(row,col)];
+                }
+            }
+            return;
+        }
+        float inverse[16];
+        InverseData(inverse);
+        for(int col=0;col<3;col++){
+            for(int row=0;row<3;row++){
+                normalMatrix[col*3+row] = inverse[Elem(col,row)];
+            }
+        }
+    }
+
+    /**
+     * This transforms the passed in normal by the inverse transpose of the
+     * Transform3D's upper 3x3, returning the result as a new Vector3.
+     */
+    Vector3 Transform3D::TransformNormal(const Vector3& normal)const{
+        float n[9];
+        InverseTranspose3x3(n);
+        const float x = normal._vec[0];
+        const float y = normal._vec[1];
+        const float z = normal._vec[2];
+        return Vector3(n[0]*x + n[3]*y + n[6]*z,
+                       n[1]*x + n[4]*y + n[7]*z,
+                       n[2]*x + n[5]*y + n[8]*z);
+    }
     
+    /**
+     * This decomposes a single column major matrix about a handle.
+     *
+     * The columns of the upper 3x3 are normalized to remove any scale.  The
+     * quaternion is then found with the standard matrix to quaternion conversion:
+     * the magnitude of each component follows from the diagonal, and the largest
+     * of them is used to divide out the other three from the off diagonal terms,
+     * which keeps the result accurate whatever the rotation.  The translation is
+     * where the matrix puts the handle.
+     */
+    static void DecomposeMatrix(const float* m, const float* handle, float* quat, float* translation){
+        float r[9];
+        for(int col=0;col<3;col++){
+            const float x = m[Elem(0,col)];
+            const float y = m[Elem(1,col)];
+            const float z = m[Elem(2,col)];
+            const float len = std::sqrt(x*x + y*y + z*z);
+            const float scale = len > 0 ? 1/len : 0;
+            r[col*3]   = x*scale;
+            r[col*3+1] = y*scale;
+            r[col*3+2] = z*scale;
+        }
+        // r is column major so r(row,col) is r[col*3+row]
+        const float r00 = r[0], r11 = r[4], r22 = r[8];
+        const float x = 0.5f*std::sqrt(std::max(0.0f, 1 + r00 - r11 - r22));
+        const float y = 0.5f*std::sqrt(std::max(0.0f, 1 - r00 + r11 - r22));
+        const float z = 0.5f*std::sqrt(std::max(0.0f, 1 - r00 - r11 + r22));
+        const float w = 0.5f*std::sqrt(std::max(0.0f, 1 + r00 + r11 + r22));
+        if (w>=x && w>=y && w>=z){
+            const float f = 0.25f/w;
+            quat[0] = (r[5] - r[7])*f;
+            quat[1] = (r[6] - r[2])*f;
+            quat[2] = (r[1] - r[3])*f;
+            quat[3] = w;
+        } else if (x>=y && x>=z){
+            const float f = 0.25f/x;
+            quat[0] = x;
+            quat[1] = (r[3] + r[1])*f;
+            quat[2] = (r[6] + r[2])*f;
+            quat[3] = (r[5] - r[7])*f;
+        } else if (y>=z){
+            const float f = 0.25f/y;
+            quat[0] = (r[3] + r[1])*f;
+            quat[1] = y;
+            quat[2] = (r[7] + r[5])*f;
+            quat[3] = (r[6] - r[2])*f;
+        } else {
+            const float f = 0.25f/z;
+            quat[0] = (r[6] + r[2])*f;
+            quat[1] = (r[7] + r[5])*f;
+            quat[2] = z;
+            quat[3] = (r[1] - r[3])*f;
+        }
+        for(int row=0;row<3;row++){
+            translation[row] = m[Elem(row,0)]*handle[0] + m[Elem(row,1)]*handle[1] +
+                               m[Elem(row,2)]*handle[2] + m[Elem(row,3)];
+        }
+    }
+
+#if defined(__SSE__)
+    /**
+     * This returns, lane by lane, a where mask is set and b where it is not
+     */
+    static inline __m128 Select(const __m128 mask, const __m128 a, const __m128 b){
+        return _mm_or_ps(_mm_and_ps(mask,a), _mm_andnot_ps(mask,b));
+    }
+#endif
+
+    /**
+     * This decomposes the Transform3D about the passed handle.
+     */
+    void Transform3D::Decompose(const Vector3& handle, Quaternion& rotation, Vector3& translation)const{
+        DecomposeMatrix(_matrix, handle._vec, rotation._quat, translation._vec);
+    }
+
+    /**
+     * This decomposes count raw matrices about their handles.
+     *
+     * With SSE, four matrices are handled per step.  Each column of the four
+     * matrices is loaded and transposed so that every register holds one matrix
+     * element for all four matrices, then the same math as DecomposeMatrix runs
+     * four wide.  Any remainder goes through DecomposeMatrix.
+     */
+    void Transform3D::Decompose(const float matrices[][16], const Vector3 handles[],
+                                Quaternion rotations[], Vector3 translations[], const size_t count){
+        size_t i=0;
+#if defined(__SSE__)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for(;i+4<=count;i+=4){
+            // e[col][row] holds element (row,col) of all four matrices
+            __m128 e[4][4];
+            for(int col=0;col<4;col++){
+                e[col][0] = _mm_loadu_ps(&matrices[i][col*4]);
+                e[col][1] = _mm_loadu_ps(&matrices[i+1][col*4]);
+                e[col][2] = _mm_loadu_ps(&matrices[i+2][col*4]);
+                e[col][3] = _mm_loadu_ps(&matrices[i+3][col*4]);
+                _MM_TRANSPOSE4_PS(e[col][0], e[col][1], e[col][2], e[col][3]);
+            }
+            const __m128 hx = _mm_set_ps(handles[i+3]._vec[0], handles[i+2]._vec[0], handles[i+1]._vec[0], handles[i]._vec[0]);
+            const __m128 hy = _mm_set_ps(handles[i+3]._vec[1], handles[i+2]._vec[1], handles[i+1]._vec[1], handles[i]._vec[1]);
+            const __m128 hz = _mm_set_ps(handles[i+3]._vec[2], handles[i+2]._vec[2], handles[i+1]._vec[2], handles[i]._vec[2]);
+            __m128 t[3];
+            for(int row=0;row<3;row++){
+                t[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0][row],hx), _mm_mul_ps(e[1][row],hy)),
+                                    _mm_add_ps(_mm_mul_ps(e[2][row],hz), e[3][row]));
+            }
+            __m128 r[3][3];
+            for(int col=0;col<3;col++){
+                const __m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[col][0],e[col][0]),
+                                                           _mm_mul_ps(e[col][1],e[col][1])),
+                                                _mm_mul_ps(e[col][2],e[col][2]));
+                const __m128 len = _mm_sqrt_ps(lenSq);
+                const __m128 scale = _mm_and_ps(_mm_cmpgt_ps(len,zero), _mm_div_ps(one,len));
+                r[col][0] = _mm_mul_ps(e[col][0],scale);
+                r[col][1] = _mm_mul_ps(e[col][1],scale);
+                r[col][2] = _mm_mul_ps(e[col][2],scale);
+            }
+            const __m128 r00 = r[0][0], r11 = r[1][1], r22 = r[2][2];
+            const __m128 qx = _mm_mul_ps(half, _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(_mm_sub_ps(_mm_add_ps(one,r00),r11),r22))));
+            const __m128 qy = _mm_mul_ps(half, _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(one,r00),r11),r22))));
+            const __m128 qz = _mm_mul_ps(half, _mm_sqrt_ps(_mm_max_ps(zero, _mm_add_ps(_mm_sub_ps(_mm_sub_ps(one,r00),r11),r22))));
+            const __m128 qw = _mm_mul_ps(half, _mm_sqrt_ps(_mm_max_ps(zero, _mm_add_ps(_mm_add_ps(_mm_add_ps(one,r00),r11),r22))));
+            // the off diagonal sums and differences each case divides by its largest component
+            const __m128 d0 = _mm_sub_ps(r[1][2], r[2][1]);
+            const __m128 d1 = _mm_sub_ps(r[2][0], r[0][2]);
+            const __m128 d2 = _mm_sub_ps(r[0][1], r[1][0]);
+            const __m128 s01 = _mm_add_ps(r[1][0], r[0][1]);
+            const __m128 s02 = _mm_add_ps(r[2][0], r[0][2]);
+            const __m128 s12 = _mm_add_ps(r[2][1], r[1][2]);
+            // pick, lane by lane, the same case the scalar code would branch to
+            const __m128 useW = _mm_and_ps(_mm_cmpge_ps(qw,qx), _mm_and_ps(_mm_cmpge_ps(qw,qy), _mm_cmpge_ps(qw,qz)));
+            const __m128 useX = _mm_andnot_ps(useW, _mm_and_ps(_mm_cmpge_ps(qx,qy), _mm_cmpge_ps(qx,qz)));
+            const __m128 useY = _mm_andnot_ps(_mm_or_ps(useW,useX), _mm_cmpge_ps(qy,qz));
+            const __m128 largest = Select(useW, qw, Select(useX, qx, Select(useY, qy, qz)));
+            const __m128 f = _mm_div_ps(quarter, largest);
+            __m128 x = Select(useW, _mm_mul_ps(d0,f), Select(useX, qx, Select(useY, _mm_mul_ps(s01,f), _mm_mul_ps(s02,f))));
+            __m128 y = Select(useW, _mm_mul_ps(d1,f), Select(useX, _mm_mul_ps(s01,f), Select(useY, qy, _mm_mul_ps(s12,f))));
+            __m128 z = Select(useW, _mm_mul_ps(d2,f), Select(useX, _mm_mul_ps(s02,f), Select(useY, _mm_mul_ps(s12,f), qz)));
+            __m128 w = Select(useW, qw, Select(useX, _mm_mul_ps(d0,f), Select(useY, _mm_mul_ps(d1,f), _mm_mul_ps(d2,f))));
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            _mm_storeu_ps(rotations[i]._quat, x);
+            _mm_storeu_ps(rotations[i+1]._quat, y);
+            _mm_storeu_ps(rotations[i+2]._quat, z);
+            _mm_storeu_ps(rotations[i+3]._quat, w);
+            float tx[4], ty[4], tz[4];
+            _mm_storeu_ps(tx, t[0]);
+            _mm_storeu_ps(ty, t[1]);
+            _mm_storeu_ps(tz, t[2]);
+            for(int k=0;k<4;k++){
+                translations[i+k] = Vector3(tx[k], ty[k], tz[k]);
+            }
+        }
+#endif
+        for(;i<count;i++){
+            DecomposeMatrix(matrices[i], handles[i]._vec, rotations[i]._quat, translations[i]._vec);
+        }
+    }
+
+    /**
+     * A pool of threads, one per core less the caller, that the batch calls
+     * split their work across.  It is started by the first batch large enough
+     * to need it and kept for the rest of the program, so a batch only wakes
+     * the threads rather than creating them.  Between batches the threads
+     * sleep on a condition variable.
+     *
+     * A batch is handed out in chunks that the caller and the threads claim
+     * in turn until none are left.  Only one batch runs at a time; a second
+     * caller waits for the first to finish.
+     */
+    class BatchWorkers {
+    public:
+        typedef void (*ChunkFn)(const void* work, size_t first, size_t count);
+        
+        explicit BatchWorkers(const unsigned int count){
+            for(unsigned int i=1;i<count;i++){
+                threads.emplace_back(&BatchWorkers::ThreadMain, this);
+            }
+        }
+        
+        ~BatchWorkers(){
+            {
+                std::lock_guard<std::mutex> guard(batchLock);
+                stopping = true;
+            }
+            batchStart.notify_all();
+            for(auto& i : threads){
+                i.join();
+            }
+        }
+        
+        /**
+         * The pool shared by all batch calls, started on first use
+         */
+        static BatchWorkers& Shared(){
+            static BatchWorkers shared(std::thread::hardware_concurrency());
+            return shared;
+        }
+        
+        unsigned int GetCount()const{
+            return (unsigned int)threads.size()+1;
+        }
+        
+        /**
+         * Runs fn(work, first, n) over [0,count) in chunks of chunk, and
+         * returns once every chunk is done
+         */
+        void Run(ChunkFn fn, const void* work, const size_t count, const size_t chunk){
+            std::lock_guard<std::mutex> running(runLock);
+            {
+                std::lock_guard<std::mutex> guard(batchLock);
+                chunkFn = fn;
+                chunkWork = work;
+                batchCount = count;
+                batchChunk = chunk;
+                next.store(0, std::memory_order_relaxed);
+                busy = (unsigned int)threads.size();
+                batch++;
+            }
+            batchStart.notify_all();
+            Work();
+            std::unique_lock<std::mutex> guard(batchLock);
+            batchEnd.wait(guard, [this]{ return busy==0; });
+        }
+        
+    private:
+        std::vector<std::thread> threads;
+        std::mutex runLock;
+        std::mutex batchLock;
+        std::condition_variable batchStart;
+        std::condition_variable batchEnd;
+        unsigned int batch=0;
+        unsigned int busy=0;
+        bool stopping=false;
+        
+        // the batch being run, set under batchLock
+        ChunkFn chunkFn=nullptr;
+        const void* chunkWork=nullptr;
+        size_t batchCount=0;
+        size_t batchChunk=0;
+        // the start of the next chunk to claim
+        std::atomic<size_t> next{0};
+        
+        void ThreadMain(){
+            unsigned int seen = 0;
+            for(;;){
+                {
+                    std::unique_lock<std::mutex> guard(batchLock);
+                    batchStart.wait(guard, [&]{ return stopping || batch!=seen; });
+                    if (stopping){
+                        return;
+                    }
+                    seen = batch;
+                }
+                Work();
+                {
+                    std::lock_guard<std::mutex> guard(batchLock);
+                    if (--busy==0){
+                        batchEnd.notify_one();
+                    }
+                }
+            }
+        }
+        
+        void Work(){
+            for(;;){
+                const size_t first = next.fetch_add(batchChunk, std::memory_order_relaxed);
+                if (first>=batchCount){
+                    return;
+                }
+                chunkFn(chunkWork, first, std::min(batchChunk, batchCount-first));
+            }
+        }
+        
+        BatchWorkers(const BatchWorkers&)=delete;
+        BatchWorkers& operator=(const BatchWorkers&)=delete;
+    };
+    
+    /**
+     * This calls a batch call's work function for one chunk
+     */
+    template<typename WorkT>
+    static void RunChunk(const void* work, size_t first, size_t count){
+        (*static_cast<const WorkT*>(work))(first, count);
+    }
+
+    /**
+     * This runs work(first, count) over [0,count).  Batches of ParallelBatchSize or
+     * more are split into one contiguous chunk per core and run on the shared
+     * BatchWorkers.  Chunks are multiples of eight so that every thread works on
+     * whole SIMD groups.
+     */
+    template<typename WorkT>
+    static void RunBatch(const size_t count, const WorkT& work){
+        if (count<Transform3D::ParallelBatchSize || std::thread::hardware_concurrency()<2){
+            work(0, count);
+            return;
+        }
+        BatchWorkers& workers = BatchWorkers::Shared();
+        const size_t threads = workers.GetCount();
+        const size_t chunk = ((count+threads-1)/threads + 7) & ~size_t(7);
+        workers.Run(&RunChunk<WorkT>, &work, count, chunk);
+    }
+    
+    /**
+     * Each raw matrix is laid out like a matrix44f_c, so arrays of them can be
+     * handed to cml's batched inverse functions directly.
+     */
+    static_assert(sizeof(cml::matrix44f_c) == 16*sizeof(float),
+                  "A cml::matrix44f_c must be 16 packed floats");
+    
+    static const cml::matrix44f_c* AsMatrices(const float matrices[][16]){
+        return reinterpret_cast<const cml::matrix44f_c*>(matrices);
+    }
+    
+    static cml::matrix44f_c* AsMatrices(float matrices[][16]){
+        return reinterpret_cast<cml::matrix44f_c*>(matrices);
+    }
+    
+    /**
+     * This inverts count raw matrices with cml::inverse_batch, splitting large
+     * batches across threads.
+     */
+    void Transform3D::Invert(const float matrices[][16], float inverses[][16], const size_t count,
+                             float determinants[]){
+        RunBatch(count, [=](size_t first, size_t n){
+            cml::inverse_batch(AsMatrices(matrices+first), AsMatrices(inverses+first), n,
+                               determinants ? determinants+first : nullptr);
+        });
+    }
+    
+    /**
+     * This inverts count raw affine matrices with cml::inverse_affine_batch,
+     * splitting large batches across threads.
+     */
+    void Transform3D::InvertAffine(const float matrices[][16], float inverses[][16], const size_t count,
+                                   float determinants[]){
+        RunBatch(count, [=](size_t first, size_t n){
+            cml::inverse_affine_batch(AsMatrices(matrices+first), AsMatrices(inverses+first), n,
+                                      determinants ? determinants+first : nullptr);
+        });
+    }
+    
+    /**
+     * This finds the determinants of count raw matrices with cml::determinant_batch,
+     * splitting large batches across threads.
+     */
+    void Transform3D::Determinants(const float matrices[][16], float determinants[], const size_t count){
+        RunBatch(count, [=](size_t first, size_t n){
+            cml::determinant_batch(AsMatrices(matrices+first), determinants+first, n);
+        });
+    }
+
     /**
      * This is a utility function used to fetch the matrix data ina form appropriate to
      * give to an openGL matrix call.
      */
-    float* Transform3D::GetOGLData()const{
-        return _pimpl->matrix.data();
+    const float* Transform3D::GetOGLData()const{
+        return _matrix;
     }
 
     /*** GraphicsProvider3DPriv Impementation  ***/
@@ -234,7 +1053,7 @@ namespace Graphics3D {
      * @param width the width of the window in screen pixels
      * @param the height of the window in screen pixels.
      */
-    GraphicsProvider3D* GraphicsProvider3D::MakeNewProvider(const std::string windowName,const int width, const int height){
+    GraphicsProvider3D* GraphicsProvider3D::MakeNewProvider(const std::string& windowName,const int width, const int height){
         return (GraphicsProvider3D* )new GraphicsProvider3DPriv(windowName,width,height);
     }
    
@@ -242,7 +1061,7 @@ namespace Graphics3D {
      * This is the private constructor that is used by the factory method to actually create the 
      * window
      */
-    GraphicsProvider3DPriv::GraphicsProvider3DPriv(const std::string title, const int windowWidth,const int windowHeight){
+    GraphicsProvider3DPriv::GraphicsProvider3DPriv(const std::string& title, const int windowWidth,const int windowHeight){
         
         
         /* Initialize the library */
@@ -271,10 +1090,6 @@ namespace Graphics3D {
      * It does all the set up of the frame to ready it for drawing.
      */
     void GraphicsProvider3DPriv::BeginFrame()const{
-        int win_width;
-        int win_height;// framework of choice here
-        glfwGetWindowSize(window, &win_width, &win_height); // retrieve window
-        float const win_aspect = (float)win_width / (float)win_height;
         // set lighting
         glEnable(GL_LIGHTING);
         glEnable(GL_LIGHT0);
@@ -288,22 +1103,146 @@ namespace Graphics3D {
         glClearColor(0.f, 0.f, 0.f, 1.f);
         glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_STENCIL_BUFFER_BIT|GL_ACCUM_BUFFER_BIT);
         glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        
-        gluPerspective(45, win_aspect, 1, 10);
+        float projection[16];
+        MakeProjection(projection);
+        glLoadMatrixf(projection);
         
         glMatrixMode(GL_MODELVIEW);
         
     }
     
     
+    /**
+     * The number of UpdateBounds calls so far.  Models may be updated on any
+     * thread.
+     */
+    static std::atomic<unsigned int> boundsUpdateCount(0);
+    
+    /**
+     * Hands out model ids.  Models may be made on any thread.
+     */
+    G3DModel::G3DModel(){
+        static std::atomic<unsigned int> nextId(1);
+        _id = nextId++;
+    }
+    
+    /**
+     * Finds the box around the vertices, then the furthest vertex from its center
+     */
+    void G3DModel::UpdateBounds(){
+        _boundsVersion = ++boundsUpdateCount;
+        const unsigned int count = GetVertexCount();
+        const float* positions = GetPositions();
+        if (count==0){
+            _bounds = G3DBounds();
+            return;
+        }
+        float lo[3] = {positions[0], positions[1], positions[2]};
+        float hi[3] = {positions[0], positions[1], positions[2]};
+        for (unsigned int i=1;i<count;i++){
+            for (int axis=0;axis<3;axis++){
+                lo[axis] = std::min(lo[axis], positions[i*3+axis]);
+                hi[axis] = std::max(hi[axis], positions[i*3+axis]);
+            }
+        }
+        const float center[3] = {(lo[0]+hi[0])*0.5f, (lo[1]+hi[1])*0.5f, (lo[2]+hi[2])*0.5f};
+        float radiusSq = 0;
+        for (unsigned int i=0;i<count;i++){
+            const float dx = positions[i*3]-center[0];
+            const float dy = positions[i*3+1]-center[1];
+            const float dz = positions[i*3+2]-center[2];
+            radiusSq = std::max(radiusSq, dx*dx+dy*dy+dz*dz);
+        }
+        _bounds.boxMin = Vector3(lo[0], lo[1], lo[2]);
+        _bounds.boxMax = Vector3(hi[0], hi[1], hi[2]);
+        _bounds.center = Vector3(center[0], center[1], center[2]);
+        _bounds.radius = std::sqrt(radiusSq);
+    }
+    
+    unsigned int G3DModel::GetBoundsUpdateCount(){
+        return boundsUpdateCount.load();
+    }
+    
+    /**
+     * Releases the model's vertex buffer, if it was ever drawn
+     */
+    G3DModelPriv::~G3DModelPriv(){
+        if (vertexBuffer!=0){
+            glDeleteBuffers(1, &vertexBuffer);
+        }
+    }
+    
+    /**
+     * Returns a writable range over the model's vertices and marks it dirty
+     */
+    G3DVertexRange G3DModelPriv::EditVertices(const unsigned int first, const unsigned int count){
+        if (first>GetVertexCount() || count>GetVertexCount()-first){
+            throw std::runtime_error("G3DModel::EditVertices: vertex range out of bounds");
+        }
+        MarkVerticesDirty(first, count);
+        return G3DVertexRange(vertices.data()+first*3, normals.data()+first*3, first, count);
+    }
+    
+    /**
+     * Adds a span to the dirty list, merging it with any spans it overlaps or touches
+     */
+    void G3DModelPriv::MarkVerticesDirty(const unsigned int first, const unsigned int count){
+        unsigned int end = std::min(first+count, GetVertexCount());
+        if (first>=end){
+            return;
+        }
+        VertexSpan span = {first, end};
+        std::vector<VertexSpan>::iterator lo = std::lower_bound(dirtySpans.begin(), dirtySpans.end(), span,
+            [](const VertexSpan& a, const VertexSpan& b){ return a.end<b.first; });
+        std::vector<VertexSpan>::iterator hi = lo;
+        while (hi!=dirtySpans.end() && hi->first<=span.end){
+            span.first = std::min(span.first, hi->first);
+            span.end = std::max(span.end, hi->end);
+            ++hi;
+        }
+        lo = dirtySpans.erase(lo, hi);
+        dirtySpans.insert(lo, span);
+        if (dirtySpans.size()>MaxDirtySpans){
+            VertexSpan all = {dirtySpans.front().first, dirtySpans.back().end};
+            dirtySpans.assign(1, all);
+        }
+    }
+    
+    /**
+     * Creates the vertex buffer on first use, and otherwise uploads only the spans
+     * of positions and normals that changed since the last draw
+     */
+    void G3DModelPriv::UploadVertices(){
+        const GLsizeiptr vertexBytes = vertices.size()*sizeof(GLfloat);
+        const GLsizeiptr normalBytes = normals.size()*sizeof(GLfloat);
+        const GLsizeiptr texcoordBytes = texcoords.size()*sizeof(GLfloat);
+        if (vertexBuffer==0){
+            glGenBuffers(1, &vertexBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes+normalBytes+texcoordBytes, nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, vertices.data());
+            glBufferSubData(GL_ARRAY_BUFFER, vertexBytes, normalBytes, normals.data());
+            glBufferSubData(GL_ARRAY_BUFFER, vertexBytes+normalBytes, texcoordBytes, texcoords.data());
+            dirtySpans.clear();
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        for (const VertexSpan& span : dirtySpans){
+            const GLintptr offset = span.first*3*sizeof(GLfloat);
+            const GLsizeiptr bytes = (span.end-span.first)*3*sizeof(GLfloat);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, &vertices[span.first*3]);
+            glBufferSubData(GL_ARRAY_BUFFER, vertexBytes+offset, bytes, &normals[span.first*3]);
+        }
+        dirtySpans.clear();
+    }
+    
     /**
      * This method draws the passed model to the output window, transforming all
      * vertices with the passed in Transform3D.
      * @param model a pointer to a G3DModel to draw
      * @param transform the Transform3D to apply to its vertices
      */
-    void GraphicsProvider3DPriv::DrawModel(const G3DModel* model, const Transform3D transform)const{
+    void GraphicsProvider3DPriv::DrawModel(const G3DModel* model, const Transform3D& transform)const{
         G3DModelPriv* privModel = (G3DModelPriv *)model;
         glPushMatrix();
         glLoadMatrixf(transform.GetOGLData());
@@ -312,9 +1251,14 @@ namespace Graphics3D {
         glEnableClientState(GL_NORMAL_ARRAY);
         glEnableClientState(GL_TEXTURE_COORD_ARRAY);
         
-        glVertexPointer(3, GL_FLOAT, 0, &privModel->vertices[0]);
-        glNormalPointer(GL_FLOAT, 0, &privModel->normals[0]);
-        glTexCoordPointer(2, GL_FLOAT, 0, &privModel->texcoords[0]);
+        privModel->UploadVertices();
+        const GLubyte* offset = nullptr;
+        glVertexPointer(3, GL_FLOAT, 0, offset);
+        offset += privModel->vertices.size()*sizeof(GLfloat);
+        glNormalPointer(GL_FLOAT, 0, offset);
+        offset += privModel->normals.size()*sizeof(GLfloat);
+        glTexCoordPointer(2, GL_FLOAT, 0, offset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
         
         glEnable(GL_TEXTURE_2D);
         //glFrontFace(GL_CCW);
@@ -328,6 +1272,85 @@ namespace Graphics3D {
        
     }
     
+    constexpr float GraphicsProvider3DPriv::FieldOfView;
+    constexpr float GraphicsProvider3DPriv::NearClip;
+    constexpr float GraphicsProvider3DPriv::FarClip;
+    
+    /**
+     * Builds the same projection gluPerspective would, for the window's aspect ratio
+     */
+    void GraphicsProvider3DPriv::MakeProjection(float projection[16])const{
+        int win_width;
+        int win_height;
+        glfwGetWindowSize(window, &win_width, &win_height);
+        float const win_aspect = (float)win_width / (float)win_height;
+        matrix44f_view matrix(projection);
+        cml::matrix_perspective_yfov_RH(matrix, cml::rad(FieldOfView), win_aspect, NearClip, FarClip,
+                                        cml::z_clip_neg_one);
+    }
+    
+    /**
+     * Extracts the frustum planes from the projection.  The modelview is the
+     * identity, so they come out in eye coordinates.
+     */
+    void GraphicsProvider3DPriv::GetFrustumPlanes(float planes[6][4])const{
+        float projection[16];
+        MakeProjection(projection);
+        cml::extract_frustum_planes(matrix44f_view(projection), planes, cml::z_clip_neg_one);
+    }
+    
+    /**
+     * This method draws a batch of models.  The GL state DrawModel sets up for
+     * each model is set up once, and a model's vertex arrays and texture are only
+     * bound when they differ from the previous draw's.
+     * @param models the models to draw
+     * @param matrices the column major matrix to draw each model with
+     * @param count the number of models
+     * @param stats has the draws and binds added to it
+     */
+    void GraphicsProvider3DPriv::DrawModels(const G3DModel* const models[], const float* const matrices[],
+                                            const size_t count, G3DDrawStats& stats)const{
+        if (count==0){
+            return;
+        }
+        glPushMatrix();
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnable(GL_TEXTURE_2D);
+        glEnable(GL_CULL_FACE);
+        glActiveTexture(GL_TEXTURE0);
+        
+        G3DModelPriv* boundModel = nullptr;
+        GLuint boundTexture = 0;
+        for (size_t i=0;i<count;i++){
+            G3DModelPriv* privModel = (G3DModelPriv *)models[i];
+            if (privModel!=boundModel){
+                privModel->UploadVertices();
+                const GLubyte* offset = nullptr;
+                glVertexPointer(3, GL_FLOAT, 0, offset);
+                offset += privModel->vertices.size()*sizeof(GLfloat);
+                glNormalPointer(GL_FLOAT, 0, offset);
+                offset += privModel->normals.size()*sizeof(GLfloat);
+                glTexCoordPointer(2, GL_FLOAT, 0, offset);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                stats.vertexArrayBinds++;
+                // the texture binding is unknown until the first model binds one
+                if (boundModel==nullptr || privModel->texname!=boundTexture){
+                    glBindTexture(GL_TEXTURE_2D, privModel->texname);
+                    boundTexture = privModel->texname;
+                    stats.textureBinds++;
+                }
+                boundModel = privModel;
+            }
+            glLoadMatrixf(matrices[i]);
+            glDrawElements(GL_QUADS, privModel->indices.size(), GL_UNSIGNED_SHORT, &privModel->indices[0]);
+            stats.draws++;
+        }
+        glPopMatrix();
+        glDisable(GL_TEXTURE_2D);
+    }
+    
     /**
      * THis method must be called at the end of a frame, after all models are drawn.
      * It finalizes the frame and puts it to the screen.
@@ -341,12 +1364,15 @@ namespace Graphics3D {
         
         /* Poll for and process events */
         glfwPollEvents();
+        
+        /* Release this frame's scratch vectors and matrices */
+        cml::frame_arena().reset();
     }
     
     /**
      * This is an internal utiltiy used to load model textures
      */
-    static GLuint LoadImage(const std::string path){
+    static GLuint LoadImage(const std::string& path){
         
         /*load an image file directly as a new OpenGL texture */
         GLuint texName = SOIL_load_OGL_texture(path.c_str(),SOIL_LOAD_AUTO,SOIL_CREATE_NEW_ID,
@@ -376,7 +1402,7 @@ namespace Graphics3D {
      */
     G3DModel* GraphicsProvider3DPriv::MakeTexturedSphere(const float radius, const unsigned int rings,
                                                      const unsigned int sectors,
-                                                     const std::string path)const{
+                                                     const std::string& path)const{
         
         std::vector<GLfloat> vertices;
         std::vector<GLfloat> normals;
@@ -385,18 +1411,29 @@ namespace Graphics3D {
         
         float const R = 1./(float)(rings-1);
         float const S = 1./(float)(sectors-1);
-        int r, s;
+        unsigned int r, s;
         
         vertices.resize(rings * sectors * 3);
         normals.resize(rings * sectors * 3);
         texcoords.resize(rings * sectors * 2);
+        
+        // Each ring and each sector has one angle, so take their sines and
+        // cosines once up front, in place over the angles, rather than for
+        // every vertex
+        std::vector<GLfloat> ringSin(rings), ringCos(rings);
+        std::vector<GLfloat> sectorSin(sectors), sectorCos(sectors);
+        for(r = 0; r < rings; r++) ringSin[r] = M_PI * r * R;
+        for(s = 0; s < sectors; s++) sectorSin[s] = 2*M_PI * s * S;
+        cml::sincos_batch(&ringSin[0], &ringSin[0], &ringCos[0], rings);
+        cml::sincos_batch(&sectorSin[0], &sectorSin[0], &sectorCos[0], sectors);
+        
         std::vector<GLfloat>::iterator v = vertices.begin();
         std::vector<GLfloat>::iterator n = normals.begin();
         std::vector<GLfloat>::iterator t = texcoords.begin();
         for(r = 0; r < rings; r++) for(s = 0; s < sectors; s++) {
-            float const y = sin( -M_PI_2 + M_PI * r * R );
-            float const x = cos(2*M_PI * s * S) * sin( M_PI * r * R );
-            float const z = sin(2*M_PI * s * S) * sin( M_PI * r * R );
+            float const y = -ringCos[r];
+            float const x = sectorCos[s] * ringSin[r];
+            float const z = sectorSin[s] * ringSin[r];
             
             *t++ = s*S;
             *t++ = r*R;
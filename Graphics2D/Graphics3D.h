@@ -10,6 +10,7 @@
 #define __Graphics3D_h
 #include <string>
 #include <memory>
+#include <cstddef>
 
 #pragma GCC visibility push(default)
 namespace Graphics3D {
@@ -19,9 +20,11 @@ namespace Graphics3D {
      * This class defines a Vector3 type which is three
      * floating point values, x, y and z.
      *
-     * It makes use of the PIMPL idiom to hide private data
-     * Assignment of one vector to another makes a shallow copy
-     * as this class is an Immutable.
+     * The three values are stored inline in the object so a Vector3
+     * is the size of three floats and is trivially copyable.  Creating,
+     * copying or returning one never touches the heap.
+     * This class is an Immutable so assigning one vector to another
+     * simply copies its three values.
      *
      * This class may be used as an automatic (value type)
      */
@@ -31,20 +34,12 @@ namespace Graphics3D {
         friend class Transform3D;
         
     private:
-        /***
-         * This is a foward declaration of the privately defined
-         * structure that holds its actual values
-         */
-        struct Implementation;
         /**
-         * This is a pointer to the value block for the Vector3
-         * its is rference counted so that it is automatically cleaned up
-         * when its last referer is destroyed.
-         * Note: Assigning one vector to another is a shallow copy, creating
-         * another owner of the shared pointer.
+         * This is the value block for the Vector3, in x, y, z order.
+         * It is laid out the same as a cml::vector3f so the implementation
+         * can hand it to cml without copying.
          */
-        
-        std::shared_ptr<Implementation> _pimpl;
+        float _vec[3];
         
     public:
         /**
@@ -109,41 +104,165 @@ namespace Graphics3D {
         
     };
     
+    /**
+     * This class defines a Quaternion type which represents a rotation
+     * as four floating point values, x, y, z and w.
+     *
+     * Like Vector3 its values are stored inline so it is trivially
+     * copyable and never touches the heap.  This class is an Immutable.
+     *
+     * This class may be used as an automatic (value type)
+     */
+    class Quaternion {
+        // Transforms need to have access to its values
+        // in order to do their work
+        friend class Transform3D;
+        
+    private:
+        /**
+         * This is the value block for the Quaternion, in x, y, z, w order.
+         * It is laid out the same as a cml::quaternionf_p so the implementation
+         * can hand it to cml without copying.
+         */
+        float _quat[4];
+        
+    public:
+        /**
+         *  This is the empty constructor.
+         *  It creates the identity rotation (0,0,0,1)
+         */
+        Quaternion();
+        
+        /**
+         * This is a contructor that takes explicit values for
+         * (x,y,z,w)
+         *
+         * @param x The X value of the vector part
+         * @param y The Y value of the vector part
+         * @param z The Z value of the vector part
+         * @param w The scalar part
+         */
+        Quaternion(float x, float y, float z, float w);
+        
+        /**
+         * Creates the rotation described by a set of euler angles
+         *
+         * The angles are applied in the order x,y,z, the same as
+         * Transform3D::Rotate applies them.
+         *
+         * @param eulerAngles the x, y and z rotations in radians
+         * @returns a new Quaternion describing the same rotation
+         */
+        static Quaternion FromEulerAngles(const Vector3& eulerAngles);
+        
+        /**
+         * Calculates a set of euler angles that describe this rotation
+         *
+         * Many sets of angles describe the same rotation, so this is not
+         * guaranteed to return the angles passed to FromEulerAngles, only
+         * angles that produce the same rotation.
+         *
+         * @returns the x, y and z rotations in radians, applied in the order x,y,z
+         */
+        Vector3 ToEulerAngles()const;
+        
+        /**
+         *  This returns the X value of the Quaternion
+         *
+         * @returns The X value
+         */
+        float GetX()const;
+        /**
+         *  This returns the Y value of the Quaternion
+         *
+         * @returns The Y value
+         */
+        float GetY()const;
+        /**
+         *  This returns the Z value of the Quaternion
+         *
+         * @returns The Z value
+         */
+        float GetZ()const;
+        /**
+         *  This returns the W (scalar) value of the Quaternion
+         *
+         * @returns The W value
+         */
+        float GetW()const;
+    };
+    
     /**
      * This class defines a 3D Transform type which can be translated
      * and rotated.
      *
-     * It makes use of the PIMPL idiom to hide private data.
-     * Assignment of one Tramsfr, to another makes a shallow copy.
-     * When this Transform is traslated or rotated however its shared_ptr
-     * is reset to a new implemntation of the PIMPL data thereby
-     * insulating it and making any instance appear to be individually mutable.
+     * The 4x4 matrix is stored inline in the object, in the column major
+     * order OpenGL expects.  Assignment of one Transform to another copies
+     * the matrix, and translating or rotating a Transform modifies it
+     * in place, so no operation on a Transform3D allocates heap memory.
      *
      * This class may be used as an automatic (value type)
      */
     class Transform3D {
     private:
         
-        /***
-         * This is a foward declaration of the privately defined
-         * structure that holds its actual values
+        /**
+         * This is the value block for the Transform3D.  It holds a 4x4
+         * column basis matrix in column major order, laid out the same as
+         * a cml::matrix44f_c, so the implementation can hand it to cml
+         * without copying.
          */
-        struct Implementation;
+        float _matrix[16];
+        
         /**
-         * This is a pointer to the value block for the Vector3
-         * its is rference counted so that it is automatically cleaned up
-         * when its last referer is destroyed.
-         * Note: Assigning one vector to another is a shallow copy, creating
-         * another owner of the shared pointer.
+         * This records what kind of matrix the value block holds.  Transforms
+         * built only from translations and rotations are rigid, and their bottom
+         * row is always (0,0,0,1).  Knowing this lets concatenation and inversion
+         * work on the top 3x4 of the matrix and skip the general 4x4 math.
+         * The kinds are ordered so that the kind of a product is the larger
+         * of the kinds of its operands.
          */
+        enum MatrixKind {
+            RIGID,      // rotation and translation only
+            AFFINE,     // any 3x3 linear part plus translation
+            GENERAL     // anything, including projections
+        };
+        MatrixKind _kind;
         
-        std::shared_ptr<Implementation> _pimpl;
+        /**
+         * used internally to compute the inverse of the value block into
+         * a caller supplied array, in the same layout
+         */
+        void InverseData(float inverse[16])const;
         
     public:
         /**
          * Default constructor that creates an Identity transform.
          */
         Transform3D();
+        
+        /**
+         * Constructor that creates the transform for a handle, rotation and translation
+         *
+         * This creates the same transform as starting from the identity and calling
+         * Translate(handle*-1), rotating by rotation and then calling Translate(translation),
+         * but builds the matrix directly in a single pass.
+         *
+         * @param handle the point that is rotated about and placed at translation
+         * @param rotation the rotation to apply about the handle
+         * @param translation the position to move the handle to
+         */
+        Transform3D(const Vector3& handle, const Quaternion& rotation, const Vector3& translation);
+        
+        /**
+         * Constructor that creates a transform from a raw 4x4 matrix
+         *
+         * The matrix is in the same column major order that GetOGLData returns.
+         *
+         * @param oglData the 16 values of the matrix
+         */
+        explicit Transform3D(const float oglData[16]);
+        
         /**
          * Adds an x and y translation to the Transform
          *
@@ -152,7 +271,7 @@ namespace Graphics3D {
          * @param vec  a 2D vector containing the X and Y offsets
          *
          */
-        void Translate(const Vector3 vec);
+        void Translate(const Vector3& vec);
         
         /**
          * Rotates the transform about the Z axis
@@ -163,7 +282,7 @@ namespace Graphics3D {
          *
          * @param radians  the amount to rotate in radians
          */
-        void Rotate(const Vector3 eulerAngles);
+        void Rotate(const Vector3& eulerAngles);
         
         /**
          * Calculates the result of applying this transform to a set of coords
@@ -175,7 +294,7 @@ namespace Graphics3D {
          * @param sourceVec  the vector containing the x, y and z coords to transform
          * @returns a vector containing the newly transformed x,y and z coords.
          */
-        Vector3 TransformVec(const Vector3 sourceVec)const;
+        Vector3 TransformVec(const Vector3& sourceVec)const;
         
         /**
          *Calculates the result of applying this transform to a set of coords
@@ -202,6 +321,7 @@ namespace Graphics3D {
          *  @param start the index of the first entry to transform
          *  @param len the number of squential entries, starting at start, to transform
          *  @returns a new array of size len containing the transformed values.
+         *  @throws std::runtime_error if start or len is negative
          */
         Vector3* TransformVecs(const Vector3 sourceVec[],const int start, const int len)const;
         
@@ -215,9 +335,44 @@ namespace Graphics3D {
          *  @param sourceVec  an array of Vector3 objects to transform, and to return the results in
          *  @param start the index of the first entry to transform
          *  @param len the number of squential entries, starting at start, to transform
+         *  @throws std::runtime_error if start or len is negative
          */
         void  TransformVecsInPlace(Vector3 sourceVec[],const int start, const int len)const;
         
+        /**
+         * Transforms a batch of points stored as separate x, y and z arrays
+         *
+         *  This applies the transform to count points held in structure-of-arrays form
+         *  and writes the results to the out arrays.  It uses SSE or AVX where the
+         *  target supports them and a scalar loop otherwise.  The out arrays may be the
+         *  same arrays as the source arrays to transform the points in place.
+         *  It allocates no heap storage.
+         *
+         *  @param xs the x coordinates of the points to transform
+         *  @param ys the y coordinates of the points to transform
+         *  @param zs the z coordinates of the points to transform
+         *  @param outXs receives the transformed x coordinates
+         *  @param outYs receives the transformed y coordinates
+         *  @param outZs receives the transformed z coordinates
+         *  @param count the number of points to transform
+         */
+        void TransformPoints(const float* xs, const float* ys, const float* zs,
+                             float* outXs, float* outYs, float* outZs, const size_t count)const;
+        
+        /**
+         * Transforms a batch of points stored as interleaved x, y, z triples
+         *
+         *  This call is just like the previous call except that the points are packed
+         *  as x0,y0,z0,x1,y1,z1... which is also the layout of an array of Vector3.
+         *  The out array may be the same as the source array to transform the points
+         *  in place.
+         *
+         *  @param xyz the 3*count coordinates of the points to transform
+         *  @param outXyz receives the 3*count transformed coordinates
+         *  @param count the number of points to transform
+         */
+        void TransformPoints(const float* xyz, float* outXyz, const size_t count)const;
+        
         /**
          * Perform a matrix multiply with another Transform
          *
@@ -227,19 +382,326 @@ namespace Graphics3D {
          * @param other The transform to append to append its rotations and translations to this one
          * @param returns The result of appending the second parameter of a * expression to the first
          */
-        Transform3D operator*(const Transform3D other)const;
+        Transform3D operator*(const Transform3D& other)const;
+        
+        /**
+         * Calculates the inverse of this transform
+         *
+         * The inverse undoes this transform, mapping points from the transformed space
+         * back to the space they came from.  For the rigid transforms built by
+         * Translate and Rotate this is a transpose of the rotation and a rotated,
+         * negated translation rather than a general matrix inversion.
+         *
+         * The inverse is computed on every call and not stored on the transform, so
+         * a Transform3D stays the size of its matrix and may be read from several
+         * threads at once.
+         *
+         * @returns a new Transform3D that is the inverse of this one
+         */
+        Transform3D Inverse()const;
+        
+        /**
+         * Splits this transform into a rotation and translation about a handle
+         *
+         * This is the reverse of the handle, rotation, translation constructor.  Given
+         * the handle, it finds the rotation and translation that, with that handle,
+         * rebuild this transform.  Any scale in the transform is discarded since it
+         * cannot be expressed by a rotation.
+         *
+         * @param handle the handle the transform is rotated about
+         * @param rotation receives the rotation
+         * @param translation receives the translation
+         */
+        void Decompose(const Vector3& handle, Quaternion& rotation, Vector3& translation)const;
         
-        float* GetOGLData()const;
+        /**
+         * Splits an array of raw matrices into rotations and translations about handles
+         *
+         *  This call is just like the previous call but works on count matrices at once,
+         *  using SSE to decompose four matrices per step where the target supports it.
+         *  It allocates no heap storage.
+         *
+         *  @param matrices count column major 4x4 matrices, as GetOGLData returns
+         *  @param handles the handle to decompose each matrix about
+         *  @param rotations receives the rotation of each matrix
+         *  @param translations receives the translation of each matrix
+         *  @param count the number of matrices to decompose
+         */
+        static void Decompose(const float matrices[][16], const Vector3 handles[],
+                              Quaternion rotations[], Vector3 translations[], const size_t count);
+        
+        /**
+         * Inverts an array of raw matrices
+         *
+         *  The matrices are inverted in closed form, eight at a time with AVX or four at a
+         *  time with SSE where the target supports it.  Batches of ParallelBatchSize
+         *  matrices or more are split across a pool of threads, one per core, that is
+         *  started by the first such batch and reused by later ones.  It allocates no
+         *  heap storage other than for that pool.
+         *
+         *  A singular matrix gets a determinant of 0 and an inverse of infinities or NaNs.
+         *
+         *  @param matrices count column major 4x4 matrices, as GetOGLData returns
+         *  @param inverses receives the inverse of each matrix, and may be matrices
+         *  @param count the number of matrices to invert
+         *  @param determinants if not null, receives the determinant of each matrix
+         */
+        static void Invert(const float matrices[][16], float inverses[][16], const size_t count,
+                           float determinants[]=nullptr);
+        
+        /**
+         * Inverts an array of raw affine matrices
+         *
+         *  This call is just like Invert but only for matrices whose bottom row is
+         *  (0,0,0,1), such as those built by Translate, Rotate and Scale.  It inverts just
+         *  the upper 3x3 and so is cheaper.  The bottom row of each matrix is not read.
+         *
+         *  @param matrices count column major 4x4 affine matrices, as GetOGLData returns
+         *  @param inverses receives the inverse of each matrix, and may be matrices
+         *  @param count the number of matrices to invert
+         *  @param determinants if not null, receives the determinant of each matrix
+         */
+        static void InvertAffine(const float matrices[][16], float inverses[][16], const size_t count,
+                                 float determinants[]=nullptr);
+        
+        /**
+         * Calculates the determinants of an array of raw matrices
+         *
+         *  @param matrices count column major 4x4 matrices, as GetOGLData returns
+         *  @param determinants receives the determinant of each matrix
+         *  @param count the number of matrices
+         */
+        static void Determinants(const float matrices[][16], float determinants[], const size_t count);
+        
+        /**
+         * The batch size at which Invert, InvertAffine and Determinants start using
+         * more than one thread
+         */
+        static const size_t ParallelBatchSize = 64*1024;
+        
+        /**
+         * Calculates the matrix used to transform surface normals
+         *
+         * This is the inverse transpose of the upper 3x3 of the transform, which keeps
+         * normals perpendicular to their surfaces under non-uniform scales.  For rigid
+         * transforms it is simply the rotation.  It is returned in column major order
+         * as OpenGL expects for a mat3 uniform.
+         *
+         * @param normalMatrix an array of 9 floats to receive the matrix
+         */
+        void InverseTranspose3x3(float normalMatrix[9])const;
+        
+        /**
+         * Calculates the result of applying this transform to a surface normal
+         *
+         * The normal is transformed by the inverse transpose of the upper 3x3 of the
+         * transform and is not translated.  The result is not re-normalized.
+         *
+         * @param normal the normal to transform
+         * @returns a vector containing the newly transformed normal
+         */
+        Vector3 TransformNormal(const Vector3& normal)const;
+        
+        const float* GetOGLData()const;
         
     };
     
 
+    /**
+     * This class is a writable window onto a run of a G3DModel's vertices.
+     *
+     * It is returned by G3DModel::EditVertices and points straight into the model's
+     * vertex storage, so nothing is copied.  Positions and normals are each stored as
+     * 3 floats per vertex (x, y, z), with GetPositions()[0] belonging to vertex GetFirst().
+     * G3DVertexViews.h wraps these pointers in cml::external vectors and matrices.
+     *
+     * The pointers stay valid for as long as the model exists.
+     */
+    class G3DVertexRange {
+    private:
+        float* _positions;
+        float* _normals;
+        unsigned int _first;
+        unsigned int _count;
+        
+    public:
+        /**
+         * Creates a range over count vertices starting at vertex first
+         *
+         * @param positions the position of vertex first
+         * @param normals the normal of vertex first
+         */
+        G3DVertexRange(float* positions, float* normals, unsigned int first, unsigned int count):
+            _positions(positions),_normals(normals),_first(first),_count(count){}
+        
+        /** The positions, 3 floats per vertex */
+        float* GetPositions()const{ return _positions; }
+        
+        /** The normals, 3 floats per vertex */
+        float* GetNormals()const{ return _normals; }
+        
+        /** The index in the model of the first vertex in the range */
+        unsigned int GetFirst()const{ return _first; }
+        
+        /** The number of vertices in the range */
+        unsigned int GetCount()const{ return _count; }
+    };
+    
+    /**
+     * The bounds of a G3DModel's vertices, in the model's own coordinates
+     */
+    struct G3DBounds {
+        /** The lowest x, y and z of any vertex */
+        Vector3 boxMin;
+        /** The highest x, y and z of any vertex */
+        Vector3 boxMax;
+        /** The center of the box, which is also the center of the bounding sphere */
+        Vector3 center;
+        /** The distance from center to the furthest vertex */
+        float radius=0;
+    };
+    
+    /**
+     * This class defines a drawable 3D model, as created by the factory methods on
+     * GraphicsProvider3D.
+     *
+     * A model's vertices can be deformed on the CPU in place.  EditVertices returns a
+     * G3DVertexRange pointing into the model's own storage and marks that span dirty.
+     * The next DrawModel call re-uploads only the dirty spans, then clears them.
+     */
     class G3DModel{
+        private:
+        /**
+         * A number unique to this model, handed out by the constructor
+         */
+        unsigned int _id;
+        
+        /**
+         * The bounds of the vertices as of the last UpdateBounds call
+         */
+        G3DBounds _bounds;
+        
+        /**
+         * The value of the UpdateBounds call count when this model's bounds
+         * were last computed, or 0 if they never were
+         */
+        unsigned int _boundsVersion=0;
+        
+        protected:
+        /**
+         * Gives the model the next unused id
+         */
+        G3DModel();
+        
         public:
-      
+        /**
+         * Returns a number that no other model shares
+         *
+         * Render lists sort by it to keep draws of the same model together.
+         */
+        unsigned int GetId()const{ return _id; }
+        
+        /**
+         * Returns the name of the OpenGL texture the model is drawn with, or 0
+         * if it has none
+         */
+        virtual unsigned int GetTextureName()const=0;
+        
+        /**
+         * Returns the model's bounding box and sphere
+         *
+         * These are computed when the model is made.  After editing vertices, call
+         * UpdateBounds if they may have moved outside them.
+         */
+        const G3DBounds& GetBounds()const{ return _bounds; }
+        
+        /**
+         * Recomputes the bounding box and sphere from the current vertex positions
+         *
+         * A Scenegraph notices the change at its next RenderFrame, and refreshes
+         * the bounds of every node drawing this model.
+         */
+        void UpdateBounds();
+        
+        /**
+         * Returns a number that changes each time UpdateBounds is called
+         *
+         * No two calls, on this model or any other, give the same number.
+         */
+        unsigned int GetBoundsVersion()const{ return _boundsVersion; }
+        
+        /**
+         * Returns the number of UpdateBounds calls so far, on any model
+         *
+         * A scenegraph compares it from frame to frame to find out whether any
+         * model's bounds may have changed.
+         */
+        static unsigned int GetBoundsUpdateCount();
+        
+        /**
+         * Returns the number of vertices in the model
+         */
+        virtual unsigned int GetVertexCount()const=0;
+        
+        /**
+         * Returns the model's vertex positions for reading, 3 floats per vertex
+         */
+        virtual const float* GetPositions()const=0;
+        
+        /**
+         * Returns the model's vertex normals for reading, 3 floats per vertex
+         */
+        virtual const float* GetNormals()const=0;
+        
+        /**
+         * Gives write access to a span of vertices and marks it dirty
+         *
+         * Write to the returned range before the next DrawModel call of this model;
+         * later writes need another EditVertices or MarkVerticesDirty call.
+         *
+         * @param first the index of the first vertex to edit
+         * @param count the number of vertices to edit
+         * @returns a range over the model's own vertex storage
+         * @throws std::runtime_error if the span runs past the last vertex
+         */
+        virtual G3DVertexRange EditVertices(const unsigned int first, const unsigned int count)=0;
+        
+        /**
+         * Marks a span of vertices as changed so it is re-uploaded at the next draw
+         *
+         * @param first the index of the first changed vertex
+         * @param count the number of changed vertices
+         */
+        virtual void MarkVerticesDirty(const unsigned int first, const unsigned int count)=0;
+        
+        /**
+         * Returns the number of separate dirty spans waiting to be uploaded
+         */
+        virtual unsigned int GetDirtySpanCount()const=0;
+        
+        /**
+         * This is a virtual destructor so the private implementation can release
+         * its buffers
+         */
+        virtual ~G3DModel(){}
     };
     
 
+    /**
+     * Counts of the work done by a GraphicsProvider3D::DrawModels call
+     *
+     * DrawModel binds a model's vertex arrays and texture on every call, so
+     * draws minus binds is the number of state changes a batch saved.
+     */
+    struct G3DDrawStats {
+        /** The number of models drawn */
+        size_t draws=0;
+        /** The number of times a model's vertex arrays were bound */
+        size_t vertexArrayBinds=0;
+        /** The number of times a texture was bound */
+        size_t textureBinds=0;
+    };
+    
     //foward decalre the GraphicsProvider3D class
     class GraphicsProvider3D;
     
@@ -283,7 +745,7 @@ namespace Graphics3D {
          * @param height the height of the drawing space (window) in pixels
          * @return An instance of a sub class of GraphicsProvider3D
          */
-        static GraphicsProvider3D* MakeNewProvider(const std::string windowName,const int width, const int height);
+        static GraphicsProvider3D* MakeNewProvider(const std::string& windowName,const int width, const int height);
         
                 /**
          * This method must be called to start drawing a new video frame
@@ -301,11 +763,40 @@ namespace Graphics3D {
          * and height <= image->GetHeight
          * @param transform  a tranformation matrix to apply to the image in order to position and rotate it.
          */
-        virtual void DrawModel(const G3DModel* model, const Transform3D transform)const=0;
+        virtual void DrawModel(const G3DModel* model, const Transform3D& transform)const=0;
+        /**
+         * Draws a batch of models
+         *
+         * This draws the same thing as calling DrawModel for each model in turn, but
+         * sets up the GL state once and only binds a model's vertex arrays or a texture
+         * when it differs from the previous draw's.  Order the batch so that draws of
+         * the same texture and model are together to get the most out of this.
+         *
+         * @param models the models to draw
+         * @param matrices for each model, the column major matrix to draw it with, as
+         * Transform3D::GetOGLData returns
+         * @param count the number of models to draw
+         * @param stats has the draws and binds of this batch added to it
+         */
+        virtual void DrawModels(const G3DModel* const models[], const float* const matrices[],
+                                const size_t count, G3DDrawStats& stats)const=0;
+        /**
+         * Returns the planes of the view frustum in eye coordinates
+         *
+         * These are the planes of the projection BeginFrame sets up, as found by
+         * cml::extract_frustum_planes.  Each is (a,b,c,d) with a unit normal, and
+         * a point (x,y,z) is on the inside of the plane when ax+by+cz+d >= 0.
+         * They are in the order left, right, bottom, top, near, far.
+         *
+         * @param planes receives the six planes
+         */
+        virtual void GetFrustumPlanes(float planes[6][4])const=0;
         /**
          * This method must be called after all images for a frame have been drawn in order to complete the
          * frame and swap it to the screen.
-         *
+         * It also resets the render thread's cml::frame_arena(), so arena-backed vectors and
+         * matrices (cml::vectorf_arena, cml::matrixf_arena) must not be kept past this call.
+         * Install a hook with cml::frame_arena().set_stats_hook() to see each frame's peak usage.
          */
         virtual void EndFrame()const=0;
         
@@ -336,7 +827,7 @@ namespace Graphics3D {
         virtual void DoKey(const int key)const=0;
         
         virtual G3DModel* MakeTexturedSphere(const float radius, const unsigned int rings,
-                                             const unsigned int sectors,const std::string texturePath)const=0;
+                                             const unsigned int sectors,const std::string& texturePath)const=0;
 
         
     };
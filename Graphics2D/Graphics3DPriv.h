@@ -40,6 +40,34 @@ namespace Graphics3D{
         GLuint texname;
         bool _textured=false;
         
+        /**
+         * A run of vertices that changed since the last upload
+         */
+        struct VertexSpan{
+            unsigned int first;
+            unsigned int end;
+        };
+        
+        /**
+         * The spans to re-upload at the next draw, sorted and non-overlapping.
+         * Past MaxDirtySpans they are merged into one covering span, which costs
+         * less than many small uploads.
+         */
+        std::vector<VertexSpan> dirtySpans;
+        static const size_t MaxDirtySpans = 16;
+        
+        /**
+         * The GL buffer holding positions, then normals, then texture coordinates.
+         * It is created by the first draw.
+         */
+        GLuint vertexBuffer=0;
+        
+        /**
+         * Creates the vertex buffer if needed, and uploads the dirty spans to it.
+         * Leaves the buffer bound to GL_ARRAY_BUFFER.
+         */
+        void UploadVertices();
+        
     public:
         /**
          * This constructor is used by factory methods on GrpahicsProvider3DPriv to
@@ -54,8 +82,37 @@ namespace Graphics3D{
             this->texcoords = texcoords;
             this->indices=indices;
             this->texname = texname;
+            UpdateBounds();
+        }
+        
+        /**
+         * Releases the vertex buffer
+         */
+        ~G3DModelPriv();
+        
+        unsigned int GetVertexCount()const{
+            return (unsigned int)(vertices.size()/3);
         }
         
+        const float* GetPositions()const{
+            return vertices.data();
+        }
+        
+        const float* GetNormals()const{
+            return normals.data();
+        }
+        
+        G3DVertexRange EditVertices(const unsigned int first, const unsigned int count);
+        
+        void MarkVerticesDirty(const unsigned int first, const unsigned int count);
+        
+        unsigned int GetDirtySpanCount()const{
+            return (unsigned int)dirtySpans.size();
+        }
+        
+        unsigned int GetTextureName()const{
+            return texname;
+        }
         
     };
 
@@ -76,6 +133,20 @@ namespace Graphics3D{
          */
         KeyCallback keyCB=nullptr;
         
+        /**
+         * The perspective projection set up by BeginFrame
+         */
+        static constexpr float FieldOfView = 45.0f; // vertical, in degrees
+        static constexpr float NearClip = 1.0f;
+        static constexpr float FarClip = 10.0f;
+        
+        /**
+         * Builds the projection matrix for the window's current aspect ratio
+         *
+         * @param projection receives the column major matrix
+         */
+        void MakeProjection(float projection[16])const;
+        
         
     public:
       
@@ -83,7 +154,7 @@ namespace Graphics3D{
          * This is the private constructor that is used by the factory method to actually create the
          * window.  It is used by the public factory method GraphicsProvider3D:MakeGraphicsProvider(...)
          */
-        GraphicsProvider3DPriv(const std::string title, const int windowWidth,const int windowHeight);
+        GraphicsProvider3DPriv(const std::string& title, const int windowWidth,const int windowHeight);
        
         /**
          * THis method must be called at the start of a frame, before any models are drawn.
@@ -97,7 +168,24 @@ namespace Graphics3D{
          * @param model a pointer to a G3DModel to draw
          * @param transform the Transform3D to apply to its vertices
          */
-        void DrawModel(const G3DModel* model, const Transform3D transform)const;
+        void DrawModel(const G3DModel* model, const Transform3D& transform)const;
+        
+        /**
+         * This method draws a batch of models, binding each model's vertex arrays
+         * and texture only when they change from the previous draw.
+         * @param models the models to draw
+         * @param matrices the column major matrix to draw each model with
+         * @param count the number of models
+         * @param stats has the draws and binds added to it
+         */
+        void DrawModels(const G3DModel* const models[], const float* const matrices[],
+                        const size_t count, G3DDrawStats& stats)const;
+        
+        /**
+         * Returns the planes of the frustum of the projection BeginFrame sets up
+         * @param planes receives the left, right, bottom, top, near and far planes
+         */
+        void GetFrustumPlanes(float planes[6][4])const;
         
         /**
          * THis method must be called at the end of a frame, after all models are drawn.
@@ -139,7 +227,7 @@ namespace Graphics3D{
          */
 
         G3DModel* MakeTexturedSphere(const float radius, const unsigned int rings, const unsigned int sectors,
-                                     const std::string path)const;
+                                     const std::string& path)const;
         
         /**
          *Destructor to allow for cleanup
@@ -0,0 +1,297 @@
+//
+//  interpolation_bench.cpp
+//  Graphics3D Bench
+//
+//  Checks cml::nlerp_batch, slerp_batch and squad_batch against the scalar
+//  interpolations and times them.  nlerp_batch and slerp_batch are compared
+//  with nlerp() and slerp(); the scalar squad() is compiled out, so
+//  squad_batch is compared with its formula evaluated in double precision.
+//  The pairs are random, plus parallel, antiparallel and nearly parallel
+//  ones, which take the normalized lerp fallback.  It exits with a non-zero
+//  status if an error bound is exceeded, if the AoS and SoA forms differ, or
+//  if an empty batch touches its arrays.
+//
+
+#include <cml/cml.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+typedef cml::quaternionf_p Quat;
+
+static const size_t PairCount = 200003;
+static const int Passes = 50;
+/**
+ * The largest differences allowed from nlerp() and slerp(), a few float ulps
+ */
+static const double ScalarBound = 1e-6;
+/**
+ * The largest difference allowed from the double precision squad, scaled
+ * by the sine of the angle of its inner or outer slerp.  Those do not take
+ * the shortest arc, so where their ends are nearly opposite the result moves
+ * by 1/sin(omega) times any rounding in the ends.
+ */
+static const double SquadBound = 1e-5;
+
+static double seconds(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * The inputs, in both AoS and SoA form
+ */
+struct Inputs {
+    std::vector<Quat> q[4];
+    std::vector<float> elements[4][4];
+    std::vector<float> t;
+    
+    const float* soa[4][4];
+};
+
+static Quat randomQuat(std::mt19937& random){
+    std::uniform_real_distribution<float> element(-1, 1);
+    Quat q(element(random), element(random), element(random), element(random));
+    return q.normalize();
+}
+
+/**
+ * Fills q[0..3] with random unit quaternions.  One pair in eight is made
+ * parallel, antiparallel or nearly parallel.
+ */
+static void makeInputs(Inputs& in){
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0, 1);
+    for(size_t i=0;i<PairCount;i++){
+        for(int k=0;k<4;k++){
+            in.q[k].push_back(randomQuat(random));
+        }
+        switch(i%8){
+            case 0: in.q[3][i] = in.q[0][i]; break;
+            case 1: in.q[3][i] = -in.q[0][i]; break;
+            case 2: {
+                Quat near = in.q[0][i];
+                near[0] += 1e-4f;
+                in.q[3][i] = near.normalize();
+                break;
+            }
+            default: break;
+        }
+        in.t.push_back(unit(random));
+    }
+    for(int k=0;k<4;k++){
+        for(int e=0;e<4;e++){
+            for(size_t i=0;i<PairCount;i++){
+                in.elements[k][e].push_back(in.q[k][i][e]);
+            }
+            in.soa[k][e] = in.elements[k][e].data();
+        }
+    }
+}
+
+/**
+ * slerp in double precision, taking the shortest arc only if asked to, as
+ * squad_batch does
+ */
+static void slerpDouble(const double a[4], const double b[4], const double t, const bool shortest,
+                        double out[4]){
+    double c = a[0]*b[0]+a[1]*b[1]+a[2]*b[2]+a[3]*b[3];
+    double sign = 1;
+    if (shortest && c<0){
+        sign = -1;
+        c = -c;
+    }
+    const double omega = std::acos(std::min(1.0, std::max(-1.0, c)));
+    const double s = std::sin(omega);
+    if (s<cml::epsilon<float>::placeholder()){
+        double length = 0;
+        for(int k=0;k<4;k++){
+            out[k] = (1-t)*a[k]+t*sign*b[k];
+            length += out[k]*out[k];
+        }
+        for(int k=0;k<4;k++){
+            out[k] /= std::sqrt(length);
+        }
+        return;
+    }
+    for(int k=0;k<4;k++){
+        out[k] = (std::sin((1-t)*omega)*a[k]+std::sin(t*omega)*sign*b[k])/s;
+    }
+}
+
+static double difference(const Quat& a, const Quat& b){
+    double worst = 0;
+    for(int k=0;k<4;k++){
+        worst = std::max(worst, double(std::fabs(a[k]-b[k])));
+    }
+    return worst;
+}
+
+/**
+ * Returns true if out is element for element the same as the SoA results
+ */
+static bool sameAsSoA(const std::vector<Quat>& out, float* const soa[4]){
+    for(size_t i=0;i<out.size();i++){
+        for(int e=0;e<4;e++){
+            if (std::memcmp(&out[i][e], &soa[e][i], sizeof(float))!=0){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool report(const char* name, const double worst, const double bound, const bool same){
+    const bool ok = worst<=bound && same;
+    printf("%-6s max error %.3g (bound %.3g), AoS %s SoA  %s\n", name, worst, bound,
+           same ? "==" : "!=", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static bool checkAccuracy(const Inputs& in){
+    std::vector<Quat> out(PairCount);
+    std::vector<float> outElements[4];
+    float* soa[4];
+    for(int e=0;e<4;e++){
+        outElements[e].resize(PairCount);
+        soa[e] = outElements[e].data();
+    }
+    bool ok = true;
+    
+    double worst = 0;
+    cml::nlerp_batch(in.q[0].data(), in.q[3].data(), in.t.data(), out.data(), PairCount);
+    cml::nlerp_batch(in.soa[0], in.soa[3], in.t.data(), soa, PairCount);
+    for(size_t i=0;i<PairCount;i++){
+        worst = std::max(worst, difference(out[i], cml::nlerp(in.q[0][i], in.q[3][i], in.t[i])));
+    }
+    ok &= report("nlerp", worst, ScalarBound, sameAsSoA(out, soa));
+    
+    worst = 0;
+    cml::slerp_batch(in.q[0].data(), in.q[3].data(), in.t.data(), out.data(), PairCount);
+    cml::slerp_batch(in.soa[0], in.soa[3], in.t.data(), soa, PairCount);
+    for(size_t i=0;i<PairCount;i++){
+        worst = std::max(worst, difference(out[i], cml::slerp(in.q[0][i], in.q[3][i], in.t[i])));
+    }
+    ok &= report("slerp", worst, ScalarBound, sameAsSoA(out, soa));
+    
+    // squad's error is scaled by its conditioning, see SquadBound
+    worst = 0;
+    cml::squad_batch(in.q[0].data(), in.q[1].data(), in.q[2].data(), in.q[3].data(), in.t.data(),
+                     out.data(), PairCount);
+    cml::squad_batch(in.soa[0], in.soa[1], in.soa[2], in.soa[3], in.t.data(), soa, PairCount);
+    for(size_t i=0;i<PairCount;i++){
+        double q[4][4];
+        for(int k=0;k<4;k++){
+            for(int e=0;e<4;e++){
+                q[k][e] = in.q[k][i][e];
+            }
+        }
+        const double t = in.t[i];
+        double ends[4], mids[4], expected[4];
+        slerpDouble(q[0], q[3], t, true, ends);
+        slerpDouble(q[1], q[2], t, false, mids);
+        slerpDouble(ends, mids, 2*t*(1-t), false, expected);
+        double innerCos = 0;
+        double outerCos = 0;
+        for(int e=0;e<4;e++){
+            innerCos += q[1][e]*q[2][e];
+            outerCos += ends[e]*mids[e];
+        }
+        const double sine = std::sqrt(std::max(0.0, 1-std::max(innerCos*innerCos, outerCos*outerCos)));
+        for(int e=0;e<4;e++){
+            worst = std::max(worst, std::fabs(out[i][e]-expected[e])*sine);
+        }
+    }
+    ok &= report("squad", worst, SquadBound, sameAsSoA(out, soa));
+    
+    // an empty batch may be given null arrays
+    const Quat* none = nullptr;
+    cml::nlerp_batch(none, none, nullptr, static_cast<Quat*>(nullptr), 0);
+    cml::slerp_batch(none, none, nullptr, static_cast<Quat*>(nullptr), 0);
+    cml::squad_batch(none, none, none, none, nullptr, static_cast<Quat*>(nullptr), 0);
+    return ok;
+}
+
+/**
+ * Times a function of the pass number and prints nanoseconds per quaternion
+ */
+template<class Function>
+static void timePasses(const char* name, const char* form, Function function, const std::vector<Quat>& out){
+    double sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for(int pass=0;pass<Passes;pass++){
+        function();
+        sum += out[pass][0];
+    }
+    printf("%-6s %-7s %6.2f ns/quaternion  (%g)\n", name, form,
+           seconds(start)/(double(PairCount)*Passes)*1e9, sum);
+}
+
+static void timeAll(const Inputs& in){
+    const float* t = in.t.data();
+    std::vector<Quat> out(PairCount);
+    std::vector<float> outElements[4];
+    float* soa[4];
+    for(int e=0;e<4;e++){
+        outElements[e].resize(PairCount);
+        soa[e] = outElements[e].data();
+    }
+    // the SoA runs copy a result back so the sums show the work was done
+    timePasses("nlerp", "scalar", [&]{
+        for(size_t i=0;i<PairCount;i++){
+            out[i] = cml::nlerp(in.q[0][i], in.q[3][i], t[i]);
+        }
+    }, out);
+    timePasses("nlerp", "AoS", [&]{
+        cml::nlerp_batch(in.q[0].data(), in.q[3].data(), t, out.data(), PairCount);
+    }, out);
+    timePasses("nlerp", "SoA", [&]{
+        cml::nlerp_batch(in.soa[0], in.soa[3], t, soa, PairCount);
+        out[0][0] = soa[0][0];
+    }, out);
+    timePasses("slerp", "scalar", [&]{
+        for(size_t i=0;i<PairCount;i++){
+            out[i] = cml::slerp(in.q[0][i], in.q[3][i], t[i]);
+        }
+    }, out);
+    timePasses("slerp", "AoS", [&]{
+        cml::slerp_batch(in.q[0].data(), in.q[3].data(), t, out.data(), PairCount);
+    }, out);
+    timePasses("slerp", "SoA", [&]{
+        cml::slerp_batch(in.soa[0], in.soa[3], t, soa, PairCount);
+        out[0][0] = soa[0][0];
+    }, out);
+    // squad() is compiled out, so the scalar form is its three slerp() calls,
+    // which always take the shortest arc and so give different results
+    timePasses("squad", "scalar", [&]{
+        for(size_t i=0;i<PairCount;i++){
+            const Quat ends = cml::slerp(in.q[0][i], in.q[3][i], t[i]);
+            const Quat mids = cml::slerp(in.q[1][i], in.q[2][i], t[i]);
+            out[i] = cml::slerp(ends, mids, 2*t[i]*(1-t[i]));
+        }
+    }, out);
+    timePasses("squad", "AoS", [&]{
+        cml::squad_batch(in.q[0].data(), in.q[1].data(), in.q[2].data(), in.q[3].data(), t,
+                         out.data(), PairCount);
+    }, out);
+    timePasses("squad", "SoA", [&]{
+        cml::squad_batch(in.soa[0], in.soa[1], in.soa[2], in.soa[3], t, soa, PairCount);
+        out[0][0] = soa[0][0];
+    }, out);
+}
+
+int main(int argc, const char * argv[]) {
+    Inputs in;
+    makeInputs(in);
+#if defined(CML_SIMD)
+    printf("%zu quaternions, SSE\n", PairCount);
+#else
+    printf("%zu quaternions, scalar\n", PairCount);
+#endif
+    const bool ok = checkAccuracy(in);
+    timeAll(in);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+//
+//  sincos_bench.cpp
+//  Graphics3D Bench
+//
+//  Checks cml::sincos and cml::sincos_batch against the error bounds that
+//  cml/mathlib/sincos.h documents for each policy, and times them against
+//  libm.  It exits with a non-zero status if any bound is exceeded or if the
+//  batch and scalar results differ.  The "Sincos Bench libm" target builds
+//  it with CML_DEFAULT_SINCOS_POLICY set to cml::libm_sincos, so the Euler
+//  rotation timings of the two targets compare the builders' policies.
+//
+
+#include <cml/cml.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/**
+ * The documented range over which the polynomial policies are accurate
+ */
+static const float AngleLimit = 8192.0f;
+static const size_t AngleCount = 1<<20;
+static const int Passes = 50;
+
+static double seconds(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * Angles spread evenly over [-AngleLimit,AngleLimit], plus the points where
+ * the range reduction changes quadrant, which is where it is least accurate
+ */
+static std::vector<float> makeAngles(){
+    std::vector<float> angles(AngleCount);
+    const size_t even = AngleCount/2;
+    for(size_t i=0;i<even;i++){
+        angles[i] = -AngleLimit + 2*AngleLimit*float(i)/float(even-1);
+    }
+    const double quarter = std::atan(1.0);
+    for(size_t i=even;i<AngleCount;i++){
+        const double k = double(i-even) - double((AngleCount-even)/2);
+        angles[i] = float(std::fmod(k*quarter, double(AngleLimit)));
+    }
+    return angles;
+}
+
+/**
+ * Checks one policy's batch results against double precision libm and
+ * against its own scalar results
+ *
+ * @returns true if the error is within bound and the batch matches sincos()
+ */
+template<class Policy>
+static bool checkPolicy(const char* name, const std::vector<float>& angles, const double bound){
+    std::vector<float> s(angles.size()), c(angles.size());
+    cml::sincos_batch(angles.data(), s.data(), c.data(), angles.size(), Policy());
+    double worst = 0;
+    size_t mismatches = 0;
+    for(size_t i=0;i<angles.size();i++){
+        const double a = angles[i];
+        worst = std::max(worst, std::fabs(s[i]-std::sin(a)));
+        worst = std::max(worst, std::fabs(c[i]-std::cos(a)));
+        float ss, cc;
+        cml::sincos(angles[i], ss, cc, Policy());
+        if (std::memcmp(&ss, &s[i], sizeof(float))!=0 || std::memcmp(&cc, &c[i], sizeof(float))!=0){
+            mismatches++;
+        }
+    }
+    const bool ok = worst<=bound && mismatches==0;
+    printf("%-8s max abs error %.3g (bound %.3g), batch/scalar mismatches %zu  %s\n",
+           name, worst, bound, mismatches, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+/**
+ * Times sincos_batch with a policy and prints nanoseconds per angle
+ */
+template<class Policy>
+static void timeBatch(const char* name, const std::vector<float>& angles){
+    std::vector<float> s(angles.size()), c(angles.size());
+    double sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for(int pass=0;pass<Passes;pass++){
+        cml::sincos_batch(angles.data(), s.data(), c.data(), angles.size(), Policy());
+        sum += s[pass] + c[pass];
+    }
+    printf("%-8s batch  %6.2f ns/angle   (%g)\n", name, seconds(start)/(double(angles.size())*Passes)*1e9, sum);
+}
+
+/**
+ * Times cml::matrix_rotation_euler, which Transform3D::Rotate calls for every
+ * sprite update.  It uses CML_DEFAULT_SINCOS_POLICY.
+ */
+static void timeEuler(const std::vector<float>& angles){
+    cml::matrix33f_c m;
+    double sum = 0;
+    const size_t count = angles.size()-2;
+    const auto start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<count;i++){
+        cml::matrix_rotation_euler(m, angles[i], angles[i+1], angles[i+2], cml::euler_order_xyz);
+        sum += m(0,0);
+    }
+    printf("default  euler  %6.2f ns/matrix  (%g)\n", seconds(start)/double(count)*1e9, sum);
+}
+
+int main(int argc, const char * argv[]) {
+    const std::vector<float> angles = makeAngles();
+#if defined(CML_SIMD_SINCOS)
+    printf("sincos over [-%g,%g], %d lanes\n", AngleLimit, AngleLimit, CML_SIMD_SINCOS);
+#else
+    printf("sincos over [-%g,%g], scalar\n", AngleLimit, AngleLimit);
+#endif
+    bool ok = true;
+    ok &= checkPolicy<cml::precise_sincos>("precise", angles, 1.5e-7);
+    ok &= checkPolicy<cml::fast_sincos>("fast", angles, 1.3e-5);
+    timeBatch<cml::libm_sincos>("libm", angles);
+    timeBatch<cml::precise_sincos>("precise", angles);
+    timeBatch<cml::fast_sincos>("fast", angles);
+    timeEuler(angles);
+    return ok ? 0 : 1;
+}
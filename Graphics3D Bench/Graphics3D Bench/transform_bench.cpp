@@ -0,0 +1,114 @@
+//
+//  transform_bench.cpp
+//  Graphics3D Bench
+//
+//  Times Transform3D::TransformPoints on structure-of-arrays and interleaved
+//  buffers against a loop of TransformVec calls over an array of Vector3, at
+//  1K points (in cache), 100K and 10M (in memory).  Each size is run enough
+//  times to transform about 100M points.  It exits with a non-zero status if
+//  either batch path disagrees with TransformVec.
+//
+
+#include "Graphics3D.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace Graphics3D;
+
+/**
+ * The number of points each path transforms at every size
+ */
+static const size_t PointsPerPath = 100000000;
+/**
+ * The largest difference from TransformVec allowed, relative to the size of
+ * the coordinates
+ */
+static const float Tolerance = 1e-5f;
+
+static double seconds(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * Returns the largest difference between a coordinate and the matching one
+ * of a Vector3
+ */
+static float difference(const Vector3& expected, const float x, const float y, const float z){
+    return std::max(std::fabs(expected.GetX()-x),
+                    std::max(std::fabs(expected.GetY()-y), std::fabs(expected.GetZ()-z)));
+}
+
+/**
+ * Times the three paths at one size and checks the batch results
+ *
+ * @returns true if both batch paths agree with TransformVec
+ */
+static bool benchSize(const Transform3D& transform, const size_t count){
+    std::mt19937 random(static_cast<unsigned int>(count));
+    std::uniform_real_distribution<float> coordinate(-100, 100);
+    std::vector<Vector3> points;
+    points.reserve(count);
+    std::vector<float> xs(count), ys(count), zs(count), xyz(count*3);
+    for(size_t i=0;i<count;i++){
+        points.push_back(Vector3(coordinate(random), coordinate(random), coordinate(random)));
+        xs[i] = xyz[i*3] = points[i].GetX();
+        ys[i] = xyz[i*3+1] = points[i].GetY();
+        zs[i] = xyz[i*3+2] = points[i].GetZ();
+    }
+    const size_t passes = std::max<size_t>(1, PointsPerPath/count);
+    
+    std::vector<Vector3> scalar(count);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t pass=0;pass<passes;pass++){
+        for(size_t i=0;i<count;i++){
+            scalar[i] = transform.TransformVec(points[i]);
+        }
+    }
+    const double scalarTime = seconds(start);
+    
+    std::vector<float> outXs(count), outYs(count), outZs(count);
+    start = std::chrono::steady_clock::now();
+    for(size_t pass=0;pass<passes;pass++){
+        transform.TransformPoints(xs.data(), ys.data(), zs.data(),
+                                  outXs.data(), outYs.data(), outZs.data(), count);
+    }
+    const double soaTime = seconds(start);
+    
+    std::vector<float> outXyz(count*3);
+    start = std::chrono::steady_clock::now();
+    for(size_t pass=0;pass<passes;pass++){
+        transform.TransformPoints(xyz.data(), outXyz.data(), count);
+    }
+    const double interleavedTime = seconds(start);
+    
+    float soaError = 0;
+    float interleavedError = 0;
+    for(size_t i=0;i<count;i++){
+        soaError = std::max(soaError, difference(scalar[i], outXs[i], outYs[i], outZs[i]));
+        interleavedError = std::max(interleavedError,
+                                    difference(scalar[i], outXyz[i*3], outXyz[i*3+1], outXyz[i*3+2]));
+    }
+    // the points stay within about 200 units of the origin
+    const bool ok = soaError<=Tolerance*200 && interleavedError<=Tolerance*200;
+    const double transformed = double(count)*passes;
+    printf("%9zu  %11.2f  %8.2f %5.1fx  %12.2f %5.1fx  %s\n", count,
+           scalarTime/transformed*1e9, soaTime/transformed*1e9, scalarTime/soaTime,
+           interleavedTime/transformed*1e9, scalarTime/interleavedTime, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, const char * argv[]) {
+    Transform3D transform;
+    transform.Rotate(Vector3(0.3f, 0.5f, 0.7f));
+    transform.Translate(Vector3(1, 2, 3));
+    printf("ns per point\n   points  TransformVec     SoA            interleaved\n");
+    bool ok = true;
+    for(const size_t count : {1000, 100000, 10000000}){
+        ok &= benchSize(transform, count);
+    }
+    return ok ? 0 : 1;
+}
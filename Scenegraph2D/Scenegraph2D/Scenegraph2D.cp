@@ -2,6 +2,7 @@
 #include "Scenegraph2D.h"
 #include <string>
 #include <stdexcept>
+#include <utility>
 
 
 using namespace Graphics2D;
@@ -13,12 +14,12 @@ Sprite::Sprite(){
     // nop
 }
 
-Sprite::Sprite(G2DImage* image,Rectangle imageSourceRect){
+Sprite::Sprite(G2DImage* image,const Rectangle& imageSourceRect){
     imagePtr.reset(image);
     sourceRect = imageSourceRect;
 }
 
-void Sprite::SetHandle(Vector2 relativePosition){
+void Sprite::SetHandle(const Vector2& relativePosition){
     handle = relativePosition;
     RecalcTransform();
 }
@@ -27,7 +28,7 @@ Vector2 Sprite::GetHandle()const{
     return handle;
 }
 
-void Sprite::SetTranslation(Vector2 xlation){
+void Sprite::SetTranslation(const Vector2& xlation){
     position=xlation;
     RecalcTransform();
 }
@@ -45,13 +46,13 @@ float Sprite::GetRotationInRadians()const{
     return rotation;
 }
 
-Transform2D Sprite::GetTransform()const{
+const Transform2D& Sprite::GetTransform()const{
     return transform;
 }
 
-void Sprite::SetTransform(Transform2D t){
-    //TOOD: Note, needs matrix decomposition from Graphics2D
-    throw std::runtime_error("SetTransform not yet defined");
+void Sprite::SetTransform(const Transform2D& t){
+    t.Decompose(handle, rotation, position);
+    RecalcTransform();
 }
 
 void Sprite::RecalcTransform(){
@@ -65,7 +66,7 @@ void Sprite::Draw(const GraphicsProvider2D* provider)const {
     provider->DrawImage(imagePtr.get(),sourceRect, transform);
 }
 
-void Sprite::Draw(const GraphicsProvider2D* provider,Transform2D transform)const{
+void Sprite::Draw(const GraphicsProvider2D* provider,const Transform2D& transform)const{
     //Note that the local transform overrides the sprite's field
     provider->DrawImage(imagePtr.get(),sourceRect,transform);
 }
@@ -76,19 +77,27 @@ Vector2 Sprite::GetSize()const{
 
 /*** Scenegraph Node Implementation ***/
 
-ScenegraphNode::ScenegraphNode(Sprite sp){
+ScenegraphNode::ScenegraphNode(const Sprite& sp){
     sprite = sp;
 }
 
-SharedNodePtr ScenegraphNode::Create(Sprite sprite){
+ScenegraphNode::ScenegraphNode(Sprite&& sp):sprite(std::move(sp)){
+    // nop
+}
+
+SharedNodePtr ScenegraphNode::Create(const Sprite& sprite){
     return SharedNodePtr(new ScenegraphNode(sprite));
 }
 
+SharedNodePtr ScenegraphNode::Create(Sprite&& sprite){
+    return SharedNodePtr(new ScenegraphNode(std::move(sprite)));
+}
+
 Sprite& ScenegraphNode::GetSprite(){
     return sprite;
 }
 
-void ScenegraphNode::AddChild(SharedNodePtr node){
+void ScenegraphNode::AddChild(const SharedNodePtr& node){
     if (node->parent!=nullptr){
         node->parent->RemoveChild(node);
     }
@@ -96,17 +105,18 @@ void ScenegraphNode::AddChild(SharedNodePtr node){
     node->parent = this; // doesnt pin to avoid circular references
 }
 
-void ScenegraphNode::Draw(const GraphicsProvider2D* provider, Transform2D parentTransform)const{
+void ScenegraphNode::Draw(const GraphicsProvider2D* provider, const Transform2D& parentTransform)const{
     Transform2D worldXform = parentTransform*sprite.GetTransform();
     sprite.Draw(provider, worldXform);
-    for(auto i : children){
+    for(const auto& i : children){
         i->Draw(provider, worldXform);
     }
 }
 
-void ScenegraphNode::RemoveChild(const SharedNodePtr childNode){
-    children.remove(childNode);
+void ScenegraphNode::RemoveChild(const SharedNodePtr& childNode){
+    // clear the parent first, childNode may refer to the list entry being removed
     childNode->parent = nullptr;
+    children.remove(childNode);
 }
 
 //*** Scenegraph Implementation
@@ -119,7 +129,7 @@ static void GraphicsProvider2DKeyCB(const GraphicsProvider2D* provider, int key)
     }
 }
 
-Scenegraph::Scenegraph(std::string windowName, int windowWidth ,int windowHeight){
+Scenegraph::Scenegraph(const std::string& windowName, int windowWidth ,int windowHeight){
     providerPtr.reset(GraphicsProvider2D::MakeNewProvider(windowName,windowWidth,windowHeight));
     providerPtr->user_data_ptr=this;
     providerPtr->SetKeyCallback(GraphicsProvider2DKeyCB);
@@ -129,12 +139,12 @@ void Scenegraph::SetKeyCallback(Scenegraph2DKeyCB cbFunc){
     OnKey=cbFunc;
 }
 
-Sprite Scenegraph::LoadSprite(std::string sprite)const{
+Sprite Scenegraph::LoadSprite(const std::string& sprite)const{
     G2DImage* image = providerPtr->LoadImage(sprite);
     return Sprite(image,Rectangle(0,0,image->GetWidth(),image->GetHeight()));
 }
 
-void Scenegraph::RenderFrame(SharedNodePtr root)const {
+void Scenegraph::RenderFrame(const SharedNodePtr& root)const {
     providerPtr->BeginFrame();
     root->Draw(providerPtr.get(), Transform2D());
     providerPtr->EndFrame();
@@ -86,7 +86,7 @@ namespace Scenegraph2D {
          * @param imageSourceRect a rectangle of pixels to use from a potentially
          * larger G2DImage
          */
-        Sprite(G2DImage* image,Rectangle imageSourceRect);
+        Sprite(G2DImage* image,const Rectangle& imageSourceRect);
         
         /**
          * Sets the image handle.
@@ -95,11 +95,11 @@ namespace Scenegraph2D {
          * rotation and translation. it is specified relative
          * to the bottom left corner of the image.
          */
-        void SetHandle(const Vector2 relativePosition);
+        void SetHandle(const Vector2& relativePosition);
         /** 
          * returns the current handle
          *
-         * @see void SetHandle(const Vector2 relativePosition);
+         * @see void SetHandle(const Vector2& relativePosition);
          *
          * @returns the current image handle in a new Vector2 object
          */
@@ -112,11 +112,11 @@ namespace Scenegraph2D {
          * @param xlation the position of the image handle in the window
          * expressed as a pixel offset from the bottom left window corner
          */
-        void SetTranslation(const Vector2 xlation);
+        void SetTranslation(const Vector2& xlation);
         /**
          * returns the current translation
          *
-         * @see void SetTranslation(const Vector2 xlation);         *
+         * @see void SetTranslation(const Vector2& xlation);         *
          * @returns the current image translation in a new Vector2 object
          */
 
@@ -146,13 +146,19 @@ namespace Scenegraph2D {
          *
          * @returns the current transform
          */
-        Transform2D GetTransform()const;
+        const Transform2D& GetTransform()const;
         
         /**
-         * CURRENTLY UNMPLEMENTED
-         * Will throw unimplemented exception if called.
+         * Sets the current transform
+         *
+         * The transform is decomposed about the current handle into the
+         * translation and rotation that reproduce it, which replace the
+         * sprite's current translation and rotation.  Any scale in the
+         * transform is discarded.
+         *
+         * @param t the transform to take the translation and rotation from
          */
-        void SetTransform(const Transform2D t);
+        void SetTransform(const Transform2D& t);
         
         /**
          * Gets the size of the image
@@ -185,7 +191,7 @@ namespace Scenegraph2D {
          * @param provider The grphics provder whose draw space we are drawing in
          * @param transform he transform to apply to the image when drawn.
          */
-        void Draw(const GraphicsProvider2D* provider,const Transform2D transform)const;
+        void Draw(const GraphicsProvider2D* provider,const Transform2D& transform)const;
     };
     
     /**
@@ -259,7 +265,15 @@ namespace Scenegraph2D {
          * a node has been created will *not* chnage the local transform of
          * the node's sprite.
          */
-        ScenegraphNode(Sprite sprite);
+        ScenegraphNode(const Sprite& sprite);
+        
+        /**
+         * This is the constructor the static Scenegraphnode::Create
+         * method uses to make nodes from a sprite the caller no longer needs
+         *
+         * @param sprite  the sprite object that the created node will take over
+         */
+        ScenegraphNode(Sprite&& sprite);
         
         public:
         /**
@@ -277,7 +291,19 @@ namespace Scenegraph2D {
          * scenegraph node.
          * @returns a handle that points to the created node
          */
-        static SharedNodePtr Create(Sprite sprite);
+        static SharedNodePtr Create(const Sprite& sprite);
+        
+        /**
+         * The factory method to create ScenegraphNodes from a temporary sprite
+         *
+         * This is just like the previous method except that the sprite's
+         * contents are moved into the node rather than copied, which saves
+         * a reference count increment and decrement on its model.
+         *
+         * @param sprite The sprite to move into the created node
+         * @returns a handle that points to the created node
+         */
+        static SharedNodePtr Create(Sprite&& sprite);
         /**
          * Returns a reference to the sprite within this scenegraph node
          *
@@ -295,7 +321,7 @@ namespace Scenegraph2D {
          *
          * @params node  the node to make a child of this one.
          */
-        void AddChild(SharedNodePtr node);
+        void AddChild(const SharedNodePtr& node);
         /**
          * Draws the node and all its chilsren
          *
@@ -310,14 +336,14 @@ namespace Scenegraph2D {
          * @param parentTransfrom the transformed world space to use as the context
          * for creating this node's transfromed world space.
          */
-        void Draw(const GraphicsProvider2D* provider, Transform2D parentTransform)const;
+        void Draw(const GraphicsProvider2D* provider, const Transform2D& parentTransform)const;
         
         /**
          * Removs a child node from this node's children list
          *
          * @param childNode the handle of the child to remove from our children
          */
-        void RemoveChild(const SharedNodePtr childNode);
+        void RemoveChild(const SharedNodePtr& childNode);
     };
     
     /**
@@ -360,7 +386,7 @@ namespace Scenegraph2D {
          * @param windowWidth width of the window to create in pixels
          * @param windowHeight height of the window to create in pixels
          */
-        Scenegraph(std::string name, int windowWidth,int windowHeight);
+        Scenegraph(const std::string& name, int windowWidth,int windowHeight);
         /**
          * Loads a sprite from a file path
          *
@@ -374,7 +400,7 @@ namespace Scenegraph2D {
          * in either case identifies an image file to load for the Sprite's
          * internal image.
          */
-        Sprite LoadSprite(std::string path) const;
+        Sprite LoadSprite(const std::string& path) const;
         /**
          * Sets the function to call in order to proccess key
          * events in the Scenegra[h's window.
@@ -393,7 +419,7 @@ namespace Scenegraph2D {
          *
          * @param root  the root of the scenegraph node tree to draw
          */
-        void RenderFrame(const SharedNodePtr root)const;
+        void RenderFrame(const SharedNodePtr& root)const;
     };
 }
 
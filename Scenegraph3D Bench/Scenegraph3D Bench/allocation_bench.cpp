@@ -0,0 +1,104 @@
+//
+//  allocation_bench.cpp
+//  Scenegraph3D Bench
+//
+//  Counts the heap allocations made by a frame of Vector3-heavy sprite work:
+//  for each of 10K sprites it reads the translation, moves it by a velocity
+//  scaled with operator*, sets the translation, handle and rotation, and
+//  transforms a point with TransformVec.  Global operator new is replaced
+//  with a counting one, so the count covers everything the frame allocates.
+//
+//  It exits with a non-zero status if a frame allocates at all, since
+//  Vector3, Quaternion and Transform3D are all meant to be plain values.
+//
+
+#include "Graphics3D.h"
+#include "Scenegraph3D.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace Scenegraph3D;
+
+static const size_t SpriteCount = 10000;
+static const int Frames = 100;
+
+/**
+ * The number of calls to operator new so far.  The bench is single threaded.
+ */
+static size_t allocations = 0;
+
+void* operator new(size_t size){
+    allocations++;
+    if (void* block = std::malloc(size ? size : 1)){
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept{
+    std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept{
+    std::free(block);
+}
+
+static double seconds(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * One frame of sprite updates
+ *
+ * @returns a sum of the transformed points, so the work cannot be dropped
+ */
+static float frame(std::vector<Sprite3D>& sprites, const std::vector<Vector3>& velocities,
+                   const Transform3D& camera, const int frameNumber){
+    const float dt = 1.0f/60;
+    float sum = 0;
+    for(size_t i=0;i<sprites.size();i++){
+        Sprite3D& sprite = sprites[i];
+        const Vector3 position = sprite.GetTranslation();
+        const Vector3 step = velocities[i]*dt;
+        sprite.SetTranslation(Vector3(position.GetX()+step.GetX(),
+                                      position.GetY()+step.GetY(),
+                                      position.GetZ()+step.GetZ()));
+        sprite.SetHandle(step/2);
+        sprite.SetRotationInRadians(Vector3(0, 0.01f*float(frameNumber), 0.02f*float(i)));
+        const Vector3 viewed = camera.TransformVec(sprite.GetTranslation());
+        sum += viewed.GetZ();
+    }
+    return sum;
+}
+
+int main(int argc, const char * argv[]) {
+    std::vector<Sprite3D> sprites(SpriteCount);
+    std::vector<Vector3> velocities;
+    velocities.reserve(SpriteCount);
+    for(size_t i=0;i<SpriteCount;i++){
+        sprites[i].SetTranslation(Vector3(float(i%100), float(i/100), 0));
+        velocities.push_back(Vector3(1, float(i%7)-3, 0.5f));
+    }
+    Sprite3D cameraSprite;
+    cameraSprite.SetTranslation(Vector3(0, 0, -50));
+    cameraSprite.SetRotationInRadians(Vector3(0.1f, 0.2f, 0));
+    const Transform3D camera = cameraSprite.GetTransform();
+
+    float sum = frame(sprites, velocities, camera, 0);
+    const size_t before = allocations;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i=1;i<=Frames;i++){
+        sum += frame(sprites, velocities, camera, i);
+    }
+    const double elapsed = seconds(start);
+    const size_t perFrame = (allocations-before)/Frames;
+
+    printf("%zu sprites, %d frames\n", SpriteCount, Frames);
+    printf("operator new calls per frame: %zu (%.2f per sprite)\n",
+           perFrame, double(perFrame)/SpriteCount);
+    printf("time per frame: %.3f ms   (%g)\n", elapsed/Frames*1e3, sum);
+    return perFrame==0 ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+//
+//  bvh_bench.cpp
+//  Scenegraph3D Bench
+//
+//  Times the SpatialIndex on a synthetic scene of about a million nodes
+//  with models: building it with the SAH, refitting it when a share of the
+//  nodes move, the incremental rebuilds that keep its cost down as nodes
+//  drift further, and ray and sphere query throughput.
+//
+//  The Scenegraph only brings the nodes' bounds up to date; its own index is
+//  off, and the bench fills an index of its own so that the index updates
+//  can be timed apart from the transform pass.  The scene sits behind the
+//  camera, so nothing is drawn.
+//
+//  It exits with a non-zero status if the index ever holds a different
+//  number of nodes than the scene.
+//
+//  usage: bvh_bench [texture.png [node count]]
+//
+
+#include "Graphics3D.h"
+#include "Scenegraph3D.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Scenegraph3D;
+
+static const size_t DefaultNodes = 1<<20;
+static const size_t GroupSize = 1024;
+static const float SceneSize = 1000;
+static const int DriftFrames = 50;
+static const size_t Queries = 100000;
+
+static double seconds(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * Moves some of the nodes, brings their bounds up to date, and times telling
+ * the index of them
+ *
+ * @returns the time EndUpdate and the Place calls took, in seconds
+ */
+static double moveNodes(Scenegraph& scenegraph, SpatialIndex& index, const SharedNodePtr& root,
+                        std::vector<SharedNodePtr>& nodes, const size_t count, const float step,
+                        std::mt19937& random){
+    std::uniform_real_distribution<float> offset(-step, step);
+    std::uniform_int_distribution<size_t> pick(0, nodes.size()-1);
+    std::vector<ScenegraphNode*> moved;
+    for(size_t i=0;i<count;i++){
+        ScenegraphNode* node = nodes[pick(random)].get();
+        Sprite3D& sprite = node->GetSprite();
+        const Vector3 position = sprite.GetTranslation();
+        sprite.SetTranslation(Vector3(position.GetX()+offset(random), position.GetY()+offset(random),
+                                      position.GetZ()+offset(random)));
+        moved.push_back(node);
+    }
+    scenegraph.RenderFrame(root);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    index.BeginUpdate();
+    for(ScenegraphNode* node : moved){
+        index.Place(node, true);
+    }
+    index.EndUpdate(root.get());
+    return seconds(start);
+}
+
+int main(int argc, const char * argv[]) {
+    const std::string texture = argc>1 ? argv[1] : "mandrill.png";
+    const size_t nodeCount = argc>2 ? std::strtoul(argv[2], nullptr, 10) : DefaultNodes;
+    Scenegraph scenegraph("Scenegraph3D BVH Bench", 320, 240);
+    Sprite3D sprite = scenegraph.MakeTexturedSphere(0.5f, 6, 12, texture);
+    
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> coordinate(0, SceneSize);
+    // behind the camera, so the whole scene is culled
+    Sprite3D rootSprite;
+    rootSprite.SetTranslation(Vector3(-SceneSize/2, -SceneSize/2, 2*SceneSize));
+    SharedNodePtr root = ScenegraphNode::Create(rootSprite);
+    std::vector<SharedNodePtr> nodes;
+    SharedNodePtr group;
+    for(size_t i=0;i<nodeCount;i++){
+        if (i%GroupSize==0){
+            group = ScenegraphNode::Create(Sprite3D());
+            root->AddChild(group);
+        }
+        Sprite3D nodeSprite(sprite);
+        nodeSprite.SetTranslation(Vector3(coordinate(random), coordinate(random), coordinate(random)));
+        nodes.push_back(ScenegraphNode::Create(nodeSprite));
+        group->AddChild(nodes.back());
+    }
+    scenegraph.RenderFrame(root);
+    
+    bool ok = true;
+    SpatialIndex index;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    index.BeginUpdate();
+    for(const SharedNodePtr& node : nodes){
+        index.Place(node.get(), true);
+    }
+    index.EndUpdate(root.get());
+    const double build = seconds(start);
+    start = std::chrono::steady_clock::now();
+    index.Rebuild();
+    const double rebuild = seconds(start);
+    ok &= index.GetCount()==nodeCount;
+    printf("%zu nodes: first update %.1f ms, full SAH rebuild %.1f ms, cost %.2f\n",
+           nodeCount, build*1e3, rebuild*1e3, index.GetCost());
+    
+    printf("\nrefit after small moves\n moved   update ms  cost   reinserted  rebuilt leaves\n");
+    for(size_t moved : {nodeCount/1000, nodeCount/100, nodeCount/10}){
+        const double time = moveNodes(scenegraph, index, root, nodes, moved, 1, random);
+        ok &= index.GetCount()==nodeCount;
+        printf("%7zu  %9.2f  %5.2f  %10zu  %zu\n", moved, time*1e3, index.GetCost(),
+               index.GetUpdateStats().reinserted, index.GetUpdateStats().rebuiltLeaves);
+    }
+    
+    // a tenth of the nodes drifting far enough to swap places with their
+    // neighbours keeps the rebuilds at their limit each update; a hundredth
+    // drifting less should only rebuild the subtrees around them
+    for(const size_t share : {10, 100}){
+        const float step = SceneSize/(2*share);
+        printf("\ndrift: %d frames moving 1/%zu of the nodes up to %g units each\n", DriftFrames, share, step);
+        double driftTime = 0;
+        double worst = 0;
+        size_t reinserted = 0;
+        size_t rebuiltLeaves = 0;
+        for(int frame=0;frame<DriftFrames;frame++){
+            const double time = moveNodes(scenegraph, index, root, nodes, nodeCount/share, step, random);
+            driftTime += time;
+            worst = std::max(worst, time);
+            reinserted += index.GetUpdateStats().reinserted;
+            rebuiltLeaves += index.GetUpdateStats().rebuiltLeaves;
+            ok &= index.GetCount()==nodeCount;
+        }
+        const float driftCost = index.GetCost();
+        start = std::chrono::steady_clock::now();
+        index.Rebuild();
+        printf(" mean update %.2f ms, worst %.2f ms, %zu nodes reinserted, %zu leaves rebuilt\n",
+               driftTime/DriftFrames*1e3, worst*1e3, reinserted, rebuiltLeaves);
+        printf(" cost %.2f, against %.2f after a full rebuild taking %.1f ms\n",
+               driftCost, index.GetCost(), seconds(start)*1e3);
+    }
+    
+    std::uniform_real_distribution<float> unit(-1, 1);
+    std::vector<Vector3> origins;
+    std::vector<Vector3> directions;
+    for(size_t i=0;i<Queries;i++){
+        origins.push_back(Vector3(coordinate(random)-SceneSize/2, coordinate(random)-SceneSize/2,
+                                  coordinate(random)+1.5f*SceneSize));
+        directions.push_back(Vector3(unit(random), unit(random), unit(random)));
+    }
+    size_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<Queries;i++){
+        hits += index.Raycast(origins[i], directions[i], SceneSize).node!=nullptr;
+    }
+    const double rays = seconds(start);
+    std::vector<ScenegraphNode*> found;
+    start = std::chrono::steady_clock::now();
+    for(size_t i=0;i<Queries;i++){
+        found.clear();
+        index.QuerySphere(origins[i], 5, found);
+    }
+    const double spheres = seconds(start);
+    printf("\n%.2f M rays/s (%zu of %zu hit), %.2f M sphere queries/s\n",
+           Queries/rays*1e-6, hits, Queries, Queries/spheres*1e-6);
+    return ok ? 0 : 1;
+}
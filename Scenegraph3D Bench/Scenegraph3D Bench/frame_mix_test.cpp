@@ -0,0 +1,111 @@
+//
+//  frame_mix_test.cpp
+//  Scenegraph3D Bench
+//
+//  Checks that the two forms of RenderFrame can be mixed.  A random tree of
+//  nodes in front of the camera is moved and rearranged between frames, and
+//  each frame is drawn either from the root or relative to a camera at the
+//  origin of cell 0.  After each frame from the root, a floating origin frame
+//  with nothing changed is drawn as well: it culls every node on its own, so
+//  it is the reference the subtree bounds and the spatial index must agree
+//  with.  This runs with one worker and with four, with the spatial index
+//  off and on.
+//
+//  It exits with a non-zero status on the first disagreement.
+//
+//  usage: frame_mix_test [texture.png]
+//
+
+#include "Graphics3D.h"
+#include "Scenegraph3D.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Scenegraph3D;
+
+static const size_t NodeCount = 400;
+static const int Frames = 500;
+
+/**
+ * Runs the frames with one set of options
+ *
+ * @returns true if every frame from the root agreed with the reference
+ */
+static bool runFrames(Scenegraph& scenegraph, const Sprite3D& sprite, const unsigned int workers,
+                      const bool indexed){
+    scenegraph.SetWorkerCount(workers);
+    scenegraph.SetSpatialIndexEnabled(indexed);
+    std::mt19937 random(workers*2+indexed);
+    std::uniform_real_distribution<float> offset(-1.5f, 1.5f);
+    std::uniform_int_distribution<size_t> pick(1, NodeCount-1);
+    
+    // parents[i] is the index of node i's parent, and every parent comes
+    // before its children, so a node can never be moved under its own subtree
+    std::vector<SharedNodePtr> nodes;
+    std::vector<size_t> parents;
+    std::vector<size_t> childCounts(NodeCount, 0);
+    Sprite3D rootSprite(sprite);
+    rootSprite.SetTranslation(Vector3(0, 0, -5));
+    nodes.push_back(ScenegraphNode::Create(rootSprite));
+    parents.push_back(0);
+    for(size_t i=1;i<NodeCount;i++){
+        Sprite3D nodeSprite(sprite);
+        nodeSprite.SetTranslation(Vector3(offset(random), offset(random), offset(random)));
+        nodes.push_back(ScenegraphNode::Create(nodeSprite));
+        parents.push_back(std::uniform_int_distribution<size_t>(0, i-1)(random));
+        childCounts[parents[i]]++;
+        nodes[parents[i]]->AddChild(nodes[i]);
+    }
+    const SharedNodePtr& root = nodes[0];
+    const WorldCell cameraCell(0, 0, 0);
+    const Transform3D camera;
+    for(int frame=0;frame<Frames;frame++){
+        for(int i=0;i<5;i++){
+            Sprite3D& nodeSprite = nodes[pick(random)]->GetSprite();
+            nodeSprite.SetTranslation(Vector3(offset(random), offset(random), offset(random)));
+        }
+        // move a childless node under an earlier one
+        const size_t leaf = pick(random);
+        if (childCounts[leaf]==0){
+            const size_t newParent = std::uniform_int_distribution<size_t>(0, leaf-1)(random);
+            nodes[parents[leaf]]->RemoveChild(nodes[leaf]);
+            childCounts[parents[leaf]]--;
+            parents[leaf] = newParent;
+            childCounts[newParent]++;
+            nodes[newParent]->AddChild(nodes[leaf]);
+        }
+        if (random()%2==0){
+            scenegraph.RenderFrame(root, cameraCell, camera);
+            continue;
+        }
+        scenegraph.RenderFrame(root);
+        const FrameStats stats = scenegraph.GetFrameStats();
+        const SpatialIndex* index = scenegraph.GetSpatialIndex();
+        scenegraph.RenderFrame(root, cameraCell, camera);
+        const FrameStats& reference = scenegraph.GetFrameStats();
+        if (stats.nodesDrawn!=reference.nodesDrawn || stats.nodesCulled!=reference.nodesCulled ||
+            (index!=nullptr && index->GetCount()!=NodeCount)){
+            printf("%u workers, index %s, frame %d: drew %zu and culled %zu, expected %zu and %zu\n",
+                   workers, indexed ? "on" : "off", frame, stats.nodesDrawn, stats.nodesCulled,
+                   reference.nodesDrawn, reference.nodesCulled);
+            return false;
+        }
+    }
+    printf("%u workers, index %s: %d frames agree\n", workers, indexed ? "on" : "off", Frames);
+    return true;
+}
+
+int main(int argc, const char * argv[]) {
+    const std::string texture = argc>1 ? argv[1] : "mandrill.png";
+    Scenegraph scenegraph("Scenegraph3D Frame Mix Test", 320, 240);
+    const Sprite3D sprite = scenegraph.MakeTexturedSphere(0.1f, 6, 12, texture);
+    bool ok = true;
+    for(const unsigned int workers : {1, 4}){
+        for(const bool indexed : {false, true}){
+            ok &= runFrames(scenegraph, sprite, workers, indexed);
+        }
+    }
+    return ok ? 0 : 1;
+}
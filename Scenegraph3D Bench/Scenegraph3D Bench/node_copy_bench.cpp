@@ -0,0 +1,142 @@
+//
+//  node_copy_bench.cpp
+//  Scenegraph3D Bench
+//
+//  Counts the copies of node handles (SharedNodePtr) made while drawing a
+//  tree of about 100K nodes with ScenegraphNode::Draw.  Each copy costs an
+//  atomic increment and an atomic decrement of the node's reference count.
+//
+//  A shared_ptr copy cannot be hooked, so the bench draws through its own
+//  provider and models instead: every model knows its node, and DrawModel
+//  records how many references to the node exist beyond the one in its
+//  parent's list of children.  A copy of the handle made by the parent's
+//  children loop is alive while the node draws, so it is counted there.
+//
+//  It exits with a non-zero status if any copy is counted, or if a node is
+//  not drawn exactly once per frame.
+//
+
+#include "Graphics3D.h"
+#include "Scenegraph3D.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace Scenegraph3D;
+
+/**
+ * The shape of the tree: every node above the last level has Fanout
+ * children, Depth levels below the root
+ */
+static const int Fanout = 10;
+static const int Depth = 5;
+static const int Frames = 20;
+
+static double seconds(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/**
+ * A model with no vertices that remembers the node drawing it
+ */
+class CountingModel : public G3DModel {
+public:
+    std::weak_ptr<ScenegraphNode> node;
+
+    unsigned int GetTextureName()const{ return 0; }
+    unsigned int GetVertexCount()const{ return 0; }
+    const float* GetPositions()const{ return nullptr; }
+    const float* GetNormals()const{ return nullptr; }
+    G3DVertexRange EditVertices(const unsigned int first, const unsigned int count){
+        throw std::runtime_error("CountingModel has no vertices to edit");
+    }
+    void MarkVerticesDirty(const unsigned int first, const unsigned int count){}
+    unsigned int GetDirtySpanCount()const{ return 0; }
+};
+
+/**
+ * A provider that draws nothing, and counts the node handles alive beyond
+ * the parent's reference as each model is drawn
+ */
+class CountingProvider : public GraphicsProvider3D {
+public:
+    mutable size_t drawn = 0;
+    mutable size_t copies = 0;
+
+    void BeginFrame()const{}
+    void DrawModel(const G3DModel* model, const Transform3D& transform)const{
+        const CountingModel* counting = static_cast<const CountingModel*>(model);
+        drawn++;
+        copies += size_t(counting->node.use_count()-1);
+    }
+    void DrawModels(const G3DModel* const models[], const float* const matrices[],
+                    const size_t count, G3DDrawStats& stats)const{
+        for(size_t i=0;i<count;i++){
+            DrawModel(models[i], Transform3D(matrices[i]));
+        }
+    }
+    void GetFrustumPlanes(float planes[6][4])const{
+        throw std::runtime_error("CountingProvider has no frustum");
+    }
+    void EndFrame()const{}
+    void SetKeyCallback(const KeyCallback keyCallback){}
+    void DoKey(const int key)const{}
+    G3DModel* MakeTexturedSphere(const float radius, const unsigned int rings,
+                                 const unsigned int sectors, const std::string& texturePath)const{
+        return new CountingModel();
+    }
+};
+
+/**
+ * Makes a node whose model knows it
+ */
+static SharedNodePtr makeNode(const float x, const float y){
+    CountingModel* model = new CountingModel();
+    Sprite3D sprite(model);
+    sprite.SetTranslation(Vector3(x, y, 0));
+    SharedNodePtr node = ScenegraphNode::Create(sprite);
+    model->node = node;
+    return node;
+}
+
+static void addChildren(const SharedNodePtr& parent, const int depth, size_t& count){
+    if (depth==0){
+        return;
+    }
+    for(int i=0;i<Fanout;i++){
+        SharedNodePtr child = makeNode(float(i)-4.5f, 1);
+        parent->AddChild(child);
+        count++;
+        addChildren(child, depth-1, count);
+    }
+}
+
+int main(int argc, const char * argv[]) {
+    SharedNodePtr root = makeNode(0, 0);
+    size_t nodeCount = 1;
+    addChildren(root, Depth, nodeCount);
+
+    CountingProvider provider;
+    const Transform3D identity;
+    double best = 1e9;
+    bool ok = true;
+    for(int frame=0;frame<Frames;frame++){
+        provider.drawn = 0;
+        provider.copies = 0;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        root->Draw(&provider, identity);
+        best = std::min(best, seconds(start));
+        ok = ok && provider.drawn==nodeCount && provider.copies==0;
+    }
+
+    printf("%zu nodes, %zu drawn per frame\n", nodeCount, provider.drawn);
+    printf("node handle copies per frame: %zu (%zu atomic operations)\n",
+           provider.copies, provider.copies*2);
+    printf("best frame: %.3f ms\n", best*1e3);
+    if (!ok){
+        printf("FAIL: expected every node drawn once and no handle copies\n");
+    }
+    return ok ? 0 : 1;
+}
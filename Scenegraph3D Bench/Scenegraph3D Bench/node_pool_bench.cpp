@@ -0,0 +1,82 @@
+//
+//  node_pool_bench.cpp
+//  Scenegraph3D Bench
+//
+//  Times building and tearing down a scene of about 1M nodes, which is
+//  mostly the node pool and the children lists.  Each run creates the nodes,
+//  attaches them into a tree with a fanout of 10, then drops the handles so
+//  the whole tree is destroyed.  The first run starts from an empty pool;
+//  the later ones rebuild straight after a teardown.  No frames are rendered
+//  in between, so the pool still holds the slabs the teardown emptied, as it
+//  would for a scene rebuilt within 120 frames.
+//
+//  It exits with a non-zero status if a run does not create and destroy
+//  every node.
+//
+
+#include "Graphics3D.h"
+#include "Scenegraph3D.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+using namespace Scenegraph3D;
+
+/**
+ * The shape of the tree: every node above the last level has Fanout
+ * children, Depth levels below the root
+ */
+static const size_t Fanout = 10;
+static const int Depth = 6;
+static const int Runs = 4;
+
+static double seconds(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc, const char * argv[]) {
+    size_t nodeCount = 0;
+    size_t levelSize = 1;
+    for(int level=0;level<=Depth;level++){
+        nodeCount += levelSize;
+        levelSize *= Fanout;
+    }
+
+    printf("%zu nodes, fanout %zu\n", nodeCount, Fanout);
+    printf("run          create ms  attach ms  teardown ms  total ms\n");
+    Sprite3D sprite;
+    bool ok = true;
+    std::vector<SharedNodePtr> nodes;
+    nodes.reserve(nodeCount);
+    for(int run=0;run<Runs;run++){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(size_t i=0;i<nodeCount;i++){
+            nodes.push_back(ScenegraphNode::Create(sprite));
+        }
+        const double create = seconds(start);
+
+        // breadth first, so node i's children are nodes i*Fanout+1 onwards
+        start = std::chrono::steady_clock::now();
+        for(size_t i=1;i<nodeCount;i++){
+            nodes[(i-1)/Fanout]->AddChild(nodes[i]);
+        }
+        const double attach = seconds(start);
+
+        std::weak_ptr<ScenegraphNode> leaf = nodes.back();
+        SharedNodePtr root = nodes.front();
+        start = std::chrono::steady_clock::now();
+        nodes.clear();
+        ok = ok && !leaf.expired();
+        root.reset();
+        const double teardown = seconds(start);
+        ok = ok && leaf.expired();
+
+        printf("%-12s %9.1f %10.1f %12.1f %9.1f\n", run==0 ? "first" : "rebuild",
+               create*1e3, attach*1e3, teardown*1e3, (create+attach+teardown)*1e3);
+    }
+    if (!ok){
+        printf("FAIL: a run did not create and destroy the whole tree\n");
+    }
+    return ok ? 0 : 1;
+}
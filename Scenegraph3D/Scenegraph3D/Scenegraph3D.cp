@@ -2,10 +2,300 @@
 #include "Scenegraph3D.h"
 #include <string>
 #include <stdexcept>
+#include <utility>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <new>
+#include <cstddef>
+#include <limits>
+#include <cfloat>
+#include <cstdlib>
 
 
 using namespace Scenegraph3D;
 
+//*** Node pool Implementation
+
+namespace Scenegraph3D {
+    /**
+     * Hands out blocks of one size, carved from large slabs
+     *
+     * A block comes from the first slab with room, most recently freed block
+     * first, or else from the slab's unused end, so blocks allocated one after
+     * another are next to each other.  Each slab counts its live blocks, and a
+     * slab whose blocks have all been freed becomes a spare.  Spares are used
+     * before any new slab, so a scene rebuilt straight after a teardown finds
+     * its memory already paged in.  AgeSpares, called once a frame, gives a
+     * spare back to the heap once it has gone unused for SpareFrames frames.
+     *
+     * Slabs are aligned to their own size, so the slab a block belongs to is
+     * found by masking off the low bits of its address.
+     */
+    class NodePool {
+    public:
+        NodePool(const size_t size, const size_t alignment);
+        void* Allocate();
+        void Free(void* block);
+        
+        /**
+         * Counts a frame for every pool, and gives back the spares that have
+         * gone unused for SpareFrames frames
+         */
+        static void AgeSpares();
+        
+    private:
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+        
+        /**
+         * The header at the start of each slab.  The slabs with room are
+         * doubly linked so a slab can be unlinked when it fills or empties.
+         * Spares are singly linked through next, newest first, and note the
+         * frame they became spare.
+         */
+        struct Slab {
+            Slab* prev;
+            Slab* next;
+            FreeBlock* freeList;
+            char* unused;
+            size_t live;
+            size_t spareSince;
+        };
+        
+        /**
+         * The size and alignment of a slab, in bytes
+         */
+        static const size_t SlabBytes = size_t(1)<<20;
+        /**
+         * The number of frames a spare is kept for, about two seconds at 60
+         * frames a second
+         */
+        static const size_t SpareFrames = 120;
+        
+        // nodes may be created and released on any thread
+        std::mutex lock;
+        size_t blockSize;
+        size_t firstBlock;
+        Slab* withRoom=nullptr;
+        Slab* spares=nullptr;
+        /**
+         * The frames counted by AgeSpares
+         */
+        size_t frame=0;
+        /**
+         * The next pool in the list AgeSpares walks.  Pools are never
+         * destroyed, so the list only grows.
+         */
+        NodePool* nextPool=nullptr;
+        
+        static std::mutex& PoolsLock();
+        static NodePool* pools;
+        
+        Slab* NewSlab();
+        bool HasRoom(const Slab* slab)const;
+        void Link(Slab* slab);
+        void Unlink(Slab* slab);
+    };
+    
+    /**
+     * The allocator ScenegraphNode::Create passes to std::allocate_shared
+     *
+     * Single objects, which is to say nodes along with their reference counts,
+     * come from a NodePool for their type.  Anything else goes to the heap.
+     * It is a friend of ScenegraphNode so that it can use the node's private
+     * constructors.
+     */
+    template<typename T> class NodePoolAllocator {
+    public:
+        typedef T value_type;
+        
+        NodePoolAllocator(){}
+        template<typename U> NodePoolAllocator(const NodePoolAllocator<U>&){}
+        
+        T* allocate(const size_t count){
+            if (count!=1){
+                return static_cast<T*>(::operator new(count*sizeof(T)));
+            }
+            return static_cast<T*>(Pool().Allocate());
+        }
+        
+        void deallocate(T* block, const size_t count){
+            if (count!=1){
+                ::operator delete(block);
+            } else {
+                Pool().Free(block);
+            }
+        }
+        
+        template<typename U, typename... Args> void construct(U* p, Args&&... args){
+            ::new((void*)p) U(std::forward<Args>(args)...);
+        }
+        
+        template<typename U> void destroy(U* p){
+            p->~U();
+        }
+        
+        template<typename U> struct rebind {
+            typedef NodePoolAllocator<U> other;
+        };
+        
+    private:
+        static NodePool& Pool(){
+            static_assert(alignof(T)<=alignof(std::max_align_t), "NodePool blocks are only max_align_t aligned");
+            // never destroyed, as nodes may outlive static destruction
+            static NodePool* pool = new NodePool(sizeof(T), alignof(T));
+            return *pool;
+        }
+    };
+    
+    template<typename T, typename U>
+    bool operator==(const NodePoolAllocator<T>&, const NodePoolAllocator<U>&){
+        return true;
+    }
+    
+    template<typename T, typename U>
+    bool operator!=(const NodePoolAllocator<T>&, const NodePoolAllocator<U>&){
+        return false;
+    }
+}
+
+const size_t NodePool::SlabBytes;
+const size_t NodePool::SpareFrames;
+NodePool* NodePool::pools = nullptr;
+
+std::mutex& NodePool::PoolsLock(){
+    // never destroyed, like the pools themselves
+    static std::mutex* poolsLock = new std::mutex();
+    return *poolsLock;
+}
+
+NodePool::NodePool(const size_t size, const size_t alignment){
+    const size_t align = std::max(alignment, alignof(FreeBlock));
+    blockSize = (std::max(size, sizeof(FreeBlock))+align-1)/align*align;
+    firstBlock = (sizeof(Slab)+align-1)/align*align;
+    if (firstBlock+blockSize>SlabBytes){
+        throw std::runtime_error("NodePool: the blocks are too large for a slab");
+    }
+    std::lock_guard<std::mutex> guard(PoolsLock());
+    nextPool = pools;
+    pools = this;
+}
+
+void NodePool::AgeSpares(){
+    std::lock_guard<std::mutex> poolsGuard(PoolsLock());
+    for(NodePool* pool=pools;pool!=nullptr;pool=pool->nextPool){
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->frame++;
+        // the spares are newest first, so the old ones are all at the end
+        Slab** link = &pool->spares;
+        while(*link!=nullptr && pool->frame-(*link)->spareSince<SpareFrames){
+            link = &(*link)->next;
+        }
+        Slab* old = *link;
+        *link = nullptr;
+        while(old!=nullptr){
+            Slab* next = old->next;
+            free(old);
+            old = next;
+        }
+    }
+}
+
+NodePool::Slab* NodePool::NewSlab(){
+    void* memory = nullptr;
+    if (posix_memalign(&memory, SlabBytes, SlabBytes)!=0){
+        throw std::bad_alloc();
+    }
+    Slab* slab = static_cast<Slab*>(memory);
+    slab->freeList = nullptr;
+    slab->unused = reinterpret_cast<char*>(slab)+firstBlock;
+    slab->live = 0;
+    return slab;
+}
+
+bool NodePool::HasRoom(const Slab* slab)const{
+    return slab->freeList!=nullptr ||
+           slab->unused+blockSize<=reinterpret_cast<const char*>(slab)+SlabBytes;
+}
+
+void NodePool::Link(Slab* slab){
+    slab->prev = nullptr;
+    slab->next = withRoom;
+    if (withRoom!=nullptr){
+        withRoom->prev = slab;
+    }
+    withRoom = slab;
+}
+
+void NodePool::Unlink(Slab* slab){
+    if (slab->prev!=nullptr){
+        slab->prev->next = slab->next;
+    } else {
+        withRoom = slab->next;
+    }
+    if (slab->next!=nullptr){
+        slab->next->prev = slab->prev;
+    }
+}
+
+void* NodePool::Allocate(){
+    std::lock_guard<std::mutex> guard(lock);
+    if (withRoom==nullptr){
+        if (spares!=nullptr){
+            Slab* slab = spares;
+            spares = slab->next;
+            Link(slab);
+        } else {
+            Link(NewSlab());
+        }
+    }
+    Slab* slab = withRoom;
+    void* block;
+    if (slab->freeList!=nullptr){
+        block = slab->freeList;
+        slab->freeList = slab->freeList->next;
+    } else {
+        block = slab->unused;
+        slab->unused += blockSize;
+    }
+    slab->live++;
+    if (!HasRoom(slab)){
+        Unlink(slab);
+    }
+    return block;
+}
+
+void NodePool::Free(void* block){
+    std::lock_guard<std::mutex> guard(lock);
+    Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(block)&~uintptr_t(SlabBytes-1));
+    const bool wasFull = !HasRoom(slab);
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = slab->freeList;
+    slab->freeList = freed;
+    slab->live--;
+    if (slab->live==0){
+        if (!wasFull){
+            Unlink(slab);
+        }
+        // start the spare afresh, so it hands out blocks in address order
+        slab->freeList = nullptr;
+        slab->unused = reinterpret_cast<char*>(slab)+firstBlock;
+        slab->spareSince = frame;
+        slab->next = spares;
+        spares = slab;
+    } else if (wasFull){
+        Link(slab);
+    }
+}
+
 /*** Sprite Implementation ***/
 
 Sprite3D::Sprite3D(){
@@ -16,95 +306,2150 @@ Sprite3D::Sprite3D(G3DModel* model){
     modelPtr.reset(model);
 }
 
-void Sprite3D::SetHandle(Vector3 relativePosition){
+Sprite3D::Sprite3D(const Sprite3D& other):
+    handle(other.handle),position(other.position),rotation(other.rotation),
+    transform(other.transform),transformDirty(other.transformDirty),modelPtr(other.modelPtr){
+    // the copy belongs to no node yet
+}
+
+Sprite3D::Sprite3D(Sprite3D&& other):
+    handle(other.handle),position(other.position),rotation(other.rotation),
+    transform(other.transform),transformDirty(other.transformDirty),modelPtr(std::move(other.modelPtr)){
+    // the copy belongs to no node yet
+}
+
+Sprite3D& Sprite3D::operator=(const Sprite3D& other){
+    handle = other.handle;
+    position = other.position;
+    rotation = other.rotation;
+    modelPtr = other.modelPtr;
+    MarkChanged();
+    return *this;
+}
+
+Sprite3D& Sprite3D::operator=(Sprite3D&& other){
+    handle = other.handle;
+    position = other.position;
+    rotation = other.rotation;
+    modelPtr = std::move(other.modelPtr);
+    MarkChanged();
+    return *this;
+}
+
+void Sprite3D::MarkChanged(){
+    transformDirty = true;
+    localChanged = true;
+    if (owner!=nullptr){
+        owner->MarkVisit();
+    }
+}
+
+void Sprite3D::SetHandle(const Vector3& relativePosition){
     handle = relativePosition;
-    RecalcTransform();
+    MarkChanged();
 }
 
 Vector3 Sprite3D::GetHandle()const{
     return handle;
 }
 
-void Sprite3D::SetTranslation(Vector3 xlation){
+void Sprite3D::SetTranslation(const Vector3& xlation){
     position=xlation;
-    RecalcTransform();
+    MarkChanged();
 }
 
 Vector3 Sprite3D::GetTranslation()const{
     return position;
 }
 
-void Sprite3D::SetRotationInRadians(Vector3 radians){
-    rotation=radians;
-    RecalcTransform();
+void Sprite3D::SetRotation(const Quaternion& rot){
+    rotation=rot;
+    MarkChanged();
 }
 
-Vector3 Sprite3D::GetRotationInRadians()const{
+Quaternion Sprite3D::GetRotation()const{
     return rotation;
 }
 
-Transform3D Sprite3D::GetTransform()const{
+void Sprite3D::SetRotationInRadians(const Vector3& radians){
+    SetRotation(Quaternion::FromEulerAngles(radians));
+}
+
+Vector3 Sprite3D::GetRotationInRadians()const{
+    return rotation.ToEulerAngles();
+}
+
+const Transform3D& Sprite3D::GetTransform()const{
+    if (transformDirty){
+        RecalcTransform();
+    }
     return transform;
 }
 
-void Sprite3D::SetTransform(Transform3D t){
-    //TOOD: Note, needs matrix decomposition from Graphics2D
-    throw std::runtime_error("SetTransform not yet defined");
+void Sprite3D::SetTransform(const Transform3D& t){
+    t.Decompose(handle, rotation, position);
+    MarkChanged();
 }
 
-void Sprite3D::RecalcTransform(){
-    transform = Transform3D(); // start from identity
-    transform.Translate(handle * -1);
-    transform.Rotate(rotation);
-    transform.Translate(position);
+void Sprite3D::SetTransforms(Sprite3D* const sprites[], const float matrices[][16], const size_t count){
+    // decompose in fixed size batches so no scratch memory needs to be allocated
+    const size_t batchSize = 256;
+    Vector3 handles[batchSize];
+    Quaternion rotations[batchSize];
+    Vector3 positions[batchSize];
+    for(size_t start=0;start<count;start+=batchSize){
+        const size_t len = std::min(batchSize, count-start);
+        for(size_t i=0;i<len;i++){
+            handles[i] = sprites[start+i]->handle;
+        }
+        Transform3D::Decompose(&matrices[start], handles, rotations, positions, len);
+        for(size_t i=0;i<len;i++){
+            Sprite3D* sprite = sprites[start+i];
+            sprite->rotation = rotations[i];
+            sprite->position = positions[i];
+            sprite->MarkChanged();
+        }
+    }
+}
+
+void Sprite3D::RecalcTransform()const{
+    transform = Transform3D(handle, rotation, position);
+    transformDirty = false;
 }
 
 void Sprite3D::Draw(const GraphicsProvider3D* provider)const {
-    provider->DrawModel(modelPtr.get(),transform);
+    provider->DrawModel(modelPtr.get(),GetTransform());
 }
 
-void Sprite3D::Draw(const GraphicsProvider3D* provider,Transform3D transform)const{
+void Sprite3D::Draw(const GraphicsProvider3D* provider,const Transform3D& transform)const{
     //Note that the local transform overrides the sprite's field
     provider->DrawModel(modelPtr.get(), transform);
 }
 
 Vector3 Sprite3D::GetSize()const{
-    throw std::runtime_error("Sprite3D::GetSize is currently unimplemented ");
+    if (!modelPtr){
+        return Vector3(0, 0, 0);
+    }
+    const G3DBounds& bounds = modelPtr->GetBounds();
+    return Vector3(bounds.boxMax.GetX()-bounds.boxMin.GetX(),
+                   bounds.boxMax.GetY()-bounds.boxMin.GetY(),
+                   bounds.boxMax.GetZ()-bounds.boxMin.GetZ());
+}
+
+/*** WorldCell Implementation ***/
+
+WorldCell WorldCell::FromPosition(const double x, const double y, const double z,
+                                  const float cellSize, Vector3& offset){
+    const double cx = std::floor(x/cellSize);
+    const double cy = std::floor(y/cellSize);
+    const double cz = std::floor(z/cellSize);
+    offset = Vector3(x-cx*cellSize, y-cy*cellSize, z-cz*cellSize);
+    return WorldCell(cx,cy,cz);
 }
 
 /*** Scenegraph Node Implementation ***/
 
-ScenegraphNode::ScenegraphNode(Sprite3D sp){
-    sprite = sp;
+ScenegraphNode::ScenegraphNode(const Sprite3D& sp):sprite(sp){
+    sprite.owner = this;
 }
 
-SharedNodePtr ScenegraphNode::Create(Sprite3D sprite){
-    return SharedNodePtr(new ScenegraphNode(sprite));
+ScenegraphNode::ScenegraphNode(Sprite3D&& sp):sprite(std::move(sp)){
+    sprite.owner = this;
+}
+
+ScenegraphNode::~ScenegraphNode(){
+    if (spatialIndex!=nullptr){
+        spatialIndex->Forget(this);
+    }
+}
+
+SharedNodePtr ScenegraphNode::Create(const Sprite3D& sprite){
+    return std::allocate_shared<ScenegraphNode>(NodePoolAllocator<ScenegraphNode>(), sprite);
+}
+
+SharedNodePtr ScenegraphNode::Create(Sprite3D&& sprite){
+    return std::allocate_shared<ScenegraphNode>(NodePoolAllocator<ScenegraphNode>(), std::move(sprite));
 }
 
 Sprite3D& ScenegraphNode::GetSprite(){
     return sprite;
 }
 
-void ScenegraphNode::AddChild(SharedNodePtr node){
-    if (node->parent!=nullptr){
-        node->parent->RemoveChild(node);
+void ScenegraphNode::AddChild(const SharedNodePtr& node){
+    ScenegraphNode* const oldParent = node->parent;
+    if (oldParent!=nullptr){
+        // move the old list entry across, so the handle is never released;
+        // node may refer to that entry
+        children.splice(children.end(), oldParent->children, node->siblingPos);
+        oldParent->boundsDirty = true;
+        oldParent->MarkVisit();
+    } else {
+        node->siblingPos = children.insert(children.end(), node);
     }
-    children.push_back(node);
     node->parent = this; // doesnt pin to avoid circular references
+    node->worldDirty = true;
+    boundsDirty = true;
+    node->MarkVisit();
 }
 
-void ScenegraphNode::Draw(const GraphicsProvider3D* provider, Transform3D parentTransform)const{
+void ScenegraphNode::AddChildren(const SharedNodePtr nodes[], const size_t count){
+    for(size_t i=0;i<count;i++){
+        AddChild(nodes[i]);
+    }
+}
+
+void ScenegraphNode::Draw(const GraphicsProvider3D* provider, const Transform3D& parentTransform)const{
     Transform3D worldXform = parentTransform*sprite.GetTransform();
     sprite.Draw(provider, worldXform);
-    for(auto i : children){
+    for(const auto& i : children){
         i->Draw(provider, worldXform);
     }
 }
 
-void ScenegraphNode::RemoveChild(const SharedNodePtr childNode){
-    children.remove(childNode);
+bool ScenegraphNode::RefreshWorldTransform(const Transform3D& parentWorld, const bool parentChanged,
+                                           size_t& recomputed){
+    if (!parentChanged && !worldDirty && !sprite.localChanged){
+        return false;
+    }
+    worldTransform = parentWorld*sprite.GetTransform();
+    worldDirty = false;
+    boundsDirty = true;
+    sprite.localChanged = false;
+    recomputed++;
+    return true;
+}
+
+/**
+ * Transforms a model's bounding sphere into a sphere (x,y,z,radius) around the
+ * transformed model.  The radius grows by the largest scale along any axis.
+ */
+static void TransformSphere(const float matrix[16], const G3DModel* model, float sphere[4]){
+    if (model==nullptr){
+        sphere[3] = -1;
+        return;
+    }
+    const G3DBounds& bounds = model->GetBounds();
+    const float x = bounds.center.GetX();
+    const float y = bounds.center.GetY();
+    const float z = bounds.center.GetZ();
+    float scaleSq = 0;
+    for(int column=0;column<3;column++){
+        const float* axis = matrix+column*4;
+        scaleSq = std::max(scaleSq, axis[0]*axis[0]+axis[1]*axis[1]+axis[2]*axis[2]);
+    }
+    sphere[0] = matrix[0]*x+matrix[4]*y+matrix[8]*z+matrix[12];
+    sphere[1] = matrix[1]*x+matrix[5]*y+matrix[9]*z+matrix[13];
+    sphere[2] = matrix[2]*x+matrix[6]*y+matrix[10]*z+matrix[14];
+    sphere[3] = bounds.radius*std::sqrt(scaleSq);
+}
+
+/**
+ * Grows a sphere to hold another one.  Spheres with negative radii are empty.
+ */
+static void MergeSphere(float into[4], const float other[4]){
+    if (other[3]<0){
+        return;
+    }
+    if (into[3]<0){
+        std::copy(other, other+4, into);
+        return;
+    }
+    const float dx = other[0]-into[0];
+    const float dy = other[1]-into[1];
+    const float dz = other[2]-into[2];
+    const float distance = std::sqrt(dx*dx+dy*dy+dz*dz);
+    if (distance+other[3]<=into[3]){
+        return;
+    }
+    if (distance+into[3]<=other[3]){
+        std::copy(other, other+4, into);
+        return;
+    }
+    const float radius = (distance+into[3]+other[3])*0.5f;
+    const float shift = (radius-into[3])/distance;
+    into[0] += dx*shift;
+    into[1] += dy*shift;
+    into[2] += dz*shift;
+    into[3] = radius;
+}
+
+enum SphereSide { SphereOutside, SphereCrossing, SphereInside };
+
+/**
+ * Finds whether a sphere is outside, crossing or inside a set of frustum planes
+ */
+static SphereSide ClassifySphere(const float planes[6][4], const float sphere[4]){
+    SphereSide side = SphereInside;
+    for(int i=0;i<6;i++){
+        const float distance = planes[i][0]*sphere[0]+planes[i][1]*sphere[1]+
+                               planes[i][2]*sphere[2]+planes[i][3];
+        if (distance<-sphere[3]){
+            return SphereOutside;
+        }
+        if (distance<sphere[3]){
+            side = SphereCrossing;
+        }
+    }
+    return side;
+}
+
+bool ScenegraphNode::RefreshOwnBounds(const bool childrenChanged){
+    if (!boundsDirty && !childrenChanged){
+        return false;
+    }
+    TransformSphere(worldTransform.GetOGLData(), sprite.modelPtr.get(), modelBounds);
+    modelBoundsVersion = sprite.modelPtr ? sprite.modelPtr->GetBoundsVersion() : 0;
+    std::copy(modelBounds, modelBounds+4, subtreeBounds);
+    subtreeNodes = 1;
+    subtreeModels = sprite.modelPtr ? 1 : 0;
+    for(const auto& i : children){
+        MergeSphere(subtreeBounds, i->subtreeBounds);
+        subtreeNodes += i->subtreeNodes;
+        subtreeModels += i->subtreeModels;
+    }
+    boundsDirty = false;
+    return true;
+}
+
+void ScenegraphNode::MarkVisit(){
+    visitPending = true;
+    // the node may have just been moved under parents that are not marked
+    for(ScenegraphNode* node=parent; node!=nullptr && !node->visitPending; node=node->parent){
+        node->visitPending = true;
+    }
+}
+
+void ScenegraphNode::MarkStaleModelBounds(){
+    if (sprite.modelPtr && sprite.modelPtr->GetBoundsVersion()!=modelBoundsVersion){
+        boundsDirty = true;
+        MarkVisit();
+    }
+    for(const auto& i : children){
+        i->MarkStaleModelBounds();
+    }
+}
+
+bool ScenegraphNode::RefreshBounds(const Transform3D& parentWorld, const bool parentChanged,
+                                   size_t& recomputed, SpatialIndex* index){
+    const bool changed = RefreshWorldTransform(parentWorld, parentChanged, recomputed);
+    const bool moved = boundsDirty;
+    visitPending = false;
+    bool childrenChanged = false;
+    for(const auto& i : children){
+        // nothing in an unmarked subtree has changed
+        if (changed || i->visitPending){
+            childrenChanged |= i->RefreshBounds(worldTransform, changed, recomputed, index);
+        }
+    }
+    const bool boundsChanged = RefreshOwnBounds(childrenChanged);
+    if (index!=nullptr && (moved ? sprite.modelPtr || spatialIndex==index :
+                                   sprite.modelPtr && spatialIndex!=index)){
+        index->Place(this, moved);
+    }
+    return boundsChanged;
+}
+
+void ScenegraphNode::AddModel(RenderList& list)const{
+    list.Add(sprite.modelPtr.get(), worldTransform);
+}
+
+void ScenegraphNode::Collect(RenderList& list, const float (*planes)[4], FrameStats& stats)const{
+    if (planes!=nullptr && subtreeBounds[3]>=0){
+        const SphereSide side = ClassifySphere(planes, subtreeBounds);
+        if (side==SphereOutside){
+            stats.nodesCulled += subtreeNodes;
+            return;
+        }
+        if (side==SphereInside){
+            planes = nullptr;
+        }
+    }
+    if (sprite.modelPtr){
+        if (planes!=nullptr && ClassifySphere(planes, modelBounds)==SphereOutside){
+            stats.nodesCulled++;
+        } else {
+            list.Add(sprite.modelPtr.get(), worldTransform);
+            stats.nodesDrawn++;
+        }
+    } else {
+        stats.nodesDrawn++;
+    }
+    for(const auto& i : children){
+        i->Collect(list, planes, stats);
+    }
+}
+
+void ScenegraphNode::SetCell(const WorldCell& offset){
+    cell = offset;
+}
+
+const WorldCell& ScenegraphNode::GetCell()const{
+    return cell;
+}
+
+void ScenegraphNode::CollectRelative(RenderList& list, const Transform3D& cameraTransform,
+                                     const WorldCell& parentCell, const float cellSize,
+                                     const float planes[6][4], FrameStats& stats)const{
+    const WorldCell nodeCell(parentCell.x+cell.x, parentCell.y+cell.y, parentCell.z+cell.z);
+    Transform3D relativeXform = worldTransform;
+    relativeXform.Translate(Vector3(nodeCell.x*cellSize, nodeCell.y*cellSize, nodeCell.z*cellSize));
+    if (sprite.modelPtr){
+        const Transform3D eyeXform = cameraTransform*relativeXform;
+        float eyeBounds[4];
+        TransformSphere(eyeXform.GetOGLData(), sprite.modelPtr.get(), eyeBounds);
+        if (ClassifySphere(planes, eyeBounds)==SphereOutside){
+            stats.nodesCulled++;
+        } else {
+            list.Add(sprite.modelPtr.get(), eyeXform);
+            stats.nodesDrawn++;
+        }
+    } else {
+        stats.nodesDrawn++;
+    }
+    for(const auto& i : children){
+        i->CollectRelative(list, cameraTransform, nodeCell, cellSize, planes, stats);
+    }
+}
+
+void ScenegraphNode::RemoveChild(const SharedNodePtr& childNode){
+    if (childNode->parent!=this){
+        return;
+    }
+    // clear the parent first, childNode may refer to the list entry being removed
     childNode->parent = nullptr;
+    childNode->worldDirty = true;
+    boundsDirty = true;
+    MarkVisit();
+    children.erase(childNode->siblingPos);
+}
+
+void ScenegraphNode::RemoveChildren(const SharedNodePtr childNodes[], const size_t count){
+    for(size_t i=0;i<count;i++){
+        RemoveChild(childNodes[i]);
+    }
+}
+
+void ScenegraphNode::Reparent(const SharedNodePtr nodes[], const size_t count, const SharedNodePtr& newParent){
+    if (newParent){
+        newParent->AddChildren(nodes, count);
+        return;
+    }
+    for(size_t i=0;i<count;i++){
+        if (nodes[i]->parent!=nullptr){
+            nodes[i]->parent->RemoveChild(nodes[i]);
+        }
+    }
+}
+
+//*** Spatial Index Implementation
+
+/**
+ * Returns half the surface area of a box, which is all the SAH needs
+ */
+static float BoxArea(const float lo[3], const float hi[3]){
+    const float dx = hi[0]-lo[0];
+    const float dy = hi[1]-lo[1];
+    const float dz = hi[2]-lo[2];
+    return dx*dy+dy*dz+dz*dx;
+}
+
+/**
+ * Returns half the surface area of the box around two boxes
+ */
+static float UnionArea(const float loA[3], const float hiA[3], const float loB[3], const float hiB[3]){
+    float lo[3];
+    float hi[3];
+    for(int i=0;i<3;i++){
+        lo[i] = std::min(loA[i], loB[i]);
+        hi[i] = std::max(hiA[i], hiB[i]);
+    }
+    return BoxArea(lo, hi);
+}
+
+/**
+ * Returns true if box A holds all of box B
+ */
+static bool BoxContains(const float loA[3], const float hiA[3], const float loB[3], const float hiB[3]){
+    for(int i=0;i<3;i++){
+        if (loB[i]<loA[i] || hiB[i]>hiA[i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the SAH cost of a subtree, its summed areas over the area of its root
+ */
+static float SubtreeCost(const float areaSum, const float area){
+    return area>0 ? areaSum/area : 0;
+}
+
+/**
+ * Finds whether a box is outside, crossing or inside a set of frustum planes
+ */
+static SphereSide ClassifyBox(const float planes[6][4], const float lo[3], const float hi[3]){
+    SphereSide side = SphereInside;
+    for(int i=0;i<6;i++){
+        // the distances of the corners farthest along and against the normal
+        float farthest = planes[i][3];
+        float nearest = planes[i][3];
+        for(int axis=0;axis<3;axis++){
+            const float n = planes[i][axis];
+            farthest += n*(n>=0 ? hi[axis] : lo[axis]);
+            nearest += n*(n>=0 ? lo[axis] : hi[axis]);
+        }
+        if (farthest<0){
+            return SphereOutside;
+        }
+        if (nearest<0){
+            side = SphereCrossing;
+        }
+    }
+    return side;
+}
+
+/**
+ * Finds where a ray enters a box, if it does within a distance
+ *
+ * Where the direction is zero the inverse is +infinity, and a ray starting on
+ * a face of that slab gives a NaN distance to it.  std::min and std::max
+ * return their first argument when compared with NaN, and the arguments are
+ * ordered so that the NaN drops out, leaving the ray inside the slab.
+ *
+ * @param entry set to the distance along the ray where it enters the box, or
+ * 0 if it starts inside
+ * @returns true if the ray passes through the box within maxDistance
+ */
+static bool RayHitsBox(const float origin[3], const float inverse[3], const float lo[3],
+                       const float hi[3], const float maxDistance, float& entry){
+    float tNear = 0;
+    float tFar = maxDistance;
+    for(int i=0;i<3;i++){
+        const float t0 = (lo[i]-origin[i])*inverse[i];
+        const float t1 = (hi[i]-origin[i])*inverse[i];
+        tNear = std::max(tNear, std::min(t0, t1));
+        tFar = std::min(tFar, std::max(t1, t0));
+    }
+    entry = tNear;
+    return tNear<=tFar;
+}
+
+/**
+ * Returns the height of a node with two children, saturating at the largest
+ * height a node can hold
+ */
+template<typename Node>
+static uint16_t ParentHeight(const Node& left, const Node& right){
+    return static_cast<uint16_t>(std::min(0xFFFF, std::max(left.height, right.height)+1));
+}
+
+/**
+ * Returns the number of leaves under a node, which is 1 for a leaf
+ */
+template<typename Node>
+static uint32_t LeafCount(const Node& node){
+    return node.item!=nullptr ? 1 : node.leaves;
+}
+
+/**
+ * Visits a hierarchy depth first without a stack, by following parent links
+ * back up.  enter(index) is called for each node reached from above, and
+ * returns true to go on into its children.  Only the subtree under start is
+ * visited.
+ */
+template<typename NodeVector, typename Enter>
+static void WalkTree(const NodeVector& nodes, const uint32_t start, Enter enter){
+    const uint32_t stop = nodes[start].parent;
+    uint32_t index = start;
+    uint32_t previous = stop;
+    while(index!=stop){
+        const auto& node = nodes[index];
+        uint32_t next = node.parent;
+        if (previous==node.parent){
+            if (enter(index)){
+                next = node.left;
+            }
+        } else if (previous==node.left){
+            next = node.right;
+        }
+        previous = index;
+        index = next;
+    }
+}
+
+struct SpatialIndex::BuildItem {
+    float lo[3];
+    float hi[3];
+    ScenegraphNode* item;
+    
+    /**
+     * Returns twice the center of the box, which bins just as well
+     */
+    float Center(const int axis)const{
+        return lo[axis]+hi[axis];
+    }
+};
+
+/**
+ * Finds the box around the centers of some build items
+ */
+template<typename BuildItem>
+static void CenterBounds(const BuildItem* items, const size_t count, float centerLo[3], float centerHi[3]){
+    std::fill(centerLo, centerLo+3, FLT_MAX);
+    std::fill(centerHi, centerHi+3, -FLT_MAX);
+    for(size_t i=0;i<count;i++){
+        for(int axis=0;axis<3;axis++){
+            centerLo[axis] = std::min(centerLo[axis], items[i].Center(axis));
+            centerHi[axis] = std::max(centerHi[axis], items[i].Center(axis));
+        }
+    }
+}
+
+SpatialIndex::SpatialIndex(){
+    // nop
+}
+
+SpatialIndex::~SpatialIndex(){
+    for(const Node& node : nodes){
+        if (node.item!=nullptr){
+            node.item->spatialIndex = nullptr;
+        }
+    }
+}
+
+uint32_t SpatialIndex::AllocateNode(){
+    uint32_t index;
+    if (freeNodes.empty()){
+        index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    } else {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    Node& node = nodes[index];
+    node.areaSum = 0;
+    node.builtArea = 0;
+    node.parent = NoNode;
+    node.left = NoNode;
+    node.right = NoNode;
+    node.stamp = stamp;
+    node.addedSlot = NoNode;
+    node.height = 0;
+    node.dirty = false;
+    node.item = nullptr;
+    return index;
+}
+
+void SpatialIndex::FreeNode(const uint32_t index){
+    nodes[index].item = nullptr;
+    nodes[index].left = NoNode;
+    freeNodes.push_back(index);
+}
+
+void SpatialIndex::SetLeafBox(const uint32_t leaf){
+    Node& node = nodes[leaf];
+    const float* sphere = node.item->modelBounds;
+    for(int i=0;i<3;i++){
+        node.lo[i] = sphere[i]-sphere[3];
+        node.hi[i] = sphere[i]+sphere[3];
+    }
+}
+
+void SpatialIndex::InsertLeaf(const uint32_t leaf){
+    leafCount++;
+    if (root==NoNode){
+        root = leaf;
+        nodes[leaf].parent = NoNode;
+        return;
+    }
+    float lo[3];
+    float hi[3];
+    std::copy(nodes[leaf].lo, nodes[leaf].lo+3, lo);
+    std::copy(nodes[leaf].hi, nodes[leaf].hi+3, hi);
+    // go down while pairing the leaf with a child adds less area than pairing it here
+    uint32_t sibling = root;
+    while(nodes[sibling].item==nullptr){
+        const Node& node = nodes[sibling];
+        const float combined = UnionArea(node.lo, node.hi, lo, hi);
+        const float inherited = combined-BoxArea(node.lo, node.hi);
+        float childCost[2];
+        const uint32_t children[2] = { node.left, node.right };
+        for(int i=0;i<2;i++){
+            const Node& child = nodes[children[i]];
+            childCost[i] = UnionArea(child.lo, child.hi, lo, hi)+inherited;
+            if (child.item==nullptr){
+                childCost[i] -= BoxArea(child.lo, child.hi);
+            }
+        }
+        if (combined<childCost[0] && combined<childCost[1]){
+            break;
+        }
+        sibling = childCost[0]<childCost[1] ? node.left : node.right;
+    }
+    const uint32_t oldParent = nodes[sibling].parent;
+    const uint32_t parent = AllocateNode();
+    Node& node = nodes[parent];
+    node.parent = oldParent;
+    node.left = sibling;
+    node.right = leaf;
+    for(int i=0;i<3;i++){
+        node.lo[i] = std::min(nodes[sibling].lo[i], lo[i]);
+        node.hi[i] = std::max(nodes[sibling].hi[i], hi[i]);
+    }
+    const float area = BoxArea(node.lo, node.hi);
+    node.areaSum = area+nodes[sibling].areaSum;
+    node.builtArea = area;
+    node.leaves = LeafCount(nodes[sibling])+1;
+    node.height = ParentHeight(nodes[sibling], nodes[leaf]);
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+    if (oldParent==NoNode){
+        root = parent;
+    } else if (nodes[oldParent].left==sibling){
+        nodes[oldParent].left = parent;
+    } else {
+        nodes[oldParent].right = parent;
+    }
+    // grow the boxes above now, so that the next insert sees this leaf
+    for(uint32_t i=oldParent;i!=NoNode;i=nodes[i].parent){
+        for(int axis=0;axis<3;axis++){
+            nodes[i].lo[axis] = std::min(nodes[i].lo[axis], lo[axis]);
+            nodes[i].hi[axis] = std::max(nodes[i].hi[axis], hi[axis]);
+        }
+    }
+    MarkDirty(parent);
+}
+
+/**
+ * Takes a leaf out of the hierarchy without freeing it
+ */
+void SpatialIndex::UnlinkLeaf(const uint32_t leaf){
+    leafCount--;
+    const uint32_t parent = nodes[leaf].parent;
+    if (parent==NoNode){
+        root = NoNode;
+        return;
+    }
+    const uint32_t sibling = nodes[parent].left==leaf ? nodes[parent].right : nodes[parent].left;
+    const uint32_t grandparent = nodes[parent].parent;
+    nodes[sibling].parent = grandparent;
+    if (grandparent==NoNode){
+        root = sibling;
+    } else if (nodes[grandparent].left==parent){
+        nodes[grandparent].left = sibling;
+    } else {
+        nodes[grandparent].right = sibling;
+    }
+    FreeNode(parent);
+    MarkDirty(grandparent);
+}
+
+void SpatialIndex::RemoveLeaf(const uint32_t leaf){
+    UnlinkLeaf(leaf);
+    FreeNode(leaf);
+}
+
+/**
+ * Marks an internal node and those above it for refitting.  The nodes above a
+ * dirty node are always dirty, so this stops at the first one that is.
+ */
+void SpatialIndex::MarkDirty(uint32_t index){
+    while(index!=NoNode && !nodes[index].dirty){
+        nodes[index].dirty = true;
+        index = nodes[index].parent;
+    }
+}
+
+/**
+ * Recomputes the boxes, area sums and leaf counts of the dirty nodes under
+ * index, children first
+ */
+void SpatialIndex::RefitDirty(const uint32_t index){
+    Node& node = nodes[index];
+    if (nodes[node.left].dirty){
+        RefitDirty(node.left);
+    }
+    if (nodes[node.right].dirty){
+        RefitDirty(node.right);
+    }
+    const Node& left = nodes[node.left];
+    const Node& right = nodes[node.right];
+    for(int i=0;i<3;i++){
+        node.lo[i] = std::min(left.lo[i], right.lo[i]);
+        node.hi[i] = std::max(left.hi[i], right.hi[i]);
+    }
+    node.areaSum = BoxArea(node.lo, node.hi)+left.areaSum+right.areaSum;
+    node.leaves = LeafCount(left)+LeafCount(right);
+    node.height = ParentHeight(left, right);
+}
+
+/**
+ * Recomputes the boxes, area sums and leaf counts from index up to the root
+ */
+void SpatialIndex::RefitUp(uint32_t index){
+    for(;index!=NoNode;index=nodes[index].parent){
+        Node& node = nodes[index];
+        const Node& left = nodes[node.left];
+        const Node& right = nodes[node.right];
+        for(int i=0;i<3;i++){
+            node.lo[i] = std::min(left.lo[i], right.lo[i]);
+            node.hi[i] = std::max(left.hi[i], right.hi[i]);
+        }
+        node.areaSum = BoxArea(node.lo, node.hi)+left.areaSum+right.areaSum;
+        node.leaves = LeafCount(left)+LeafCount(right);
+        node.height = ParentHeight(left, right);
+    }
+}
+
+/**
+ * Clears the dirty flags under index, rebuilding the highest subtrees whose
+ * root's box has grown too far, so long as their leaves fit in the budget
+ *
+ * @param budget the number of leaves that may still be rebuilt, less those
+ * that are
+ */
+void SpatialIndex::RebuildDegraded(const uint32_t index, size_t& budget){
+    Node& node = nodes[index];
+    node.dirty = false;
+    if (BoxArea(node.lo, node.hi)>RebuildRatio*node.builtArea && node.leaves<=budget){
+        budget -= node.leaves;
+        Rebuild(index);
+        return;
+    }
+    // a rebuild below may move nodes, so look the children up again each time
+    if (nodes[nodes[index].left].dirty){
+        RebuildDegraded(nodes[index].left, budget);
+    }
+    if (nodes[nodes[index].right].dirty){
+        RebuildDegraded(nodes[index].right, budget);
+    }
+}
+
+/**
+ * Returns the number of halvings that take a count down to one
+ */
+static unsigned int CeilLog2(size_t count){
+    unsigned int levels = 0;
+    for(count--;count>0;count>>=1){
+        levels++;
+    }
+    return levels;
+}
+
+/**
+ * Builds a subtree with the binned SAH, and returns its root.  The nodes are
+ * allocated parent first, so a fresh node array is laid out depth first.
+ *
+ * Where the SAH could take a leaf deeper than MaxDepth, the items are split
+ * at the median instead, which halves them at every level.
+ *
+ * @param depth the number of levels above the subtree's root
+ */
+uint32_t SpatialIndex::Build(BuildItem* items, const size_t count,
+                             const float centerLo[3], const float centerHi[3], const unsigned int depth){
+    const uint32_t index = AllocateNode();
+    if (count==1){
+        Node& leaf = nodes[index];
+        std::copy(items[0].lo, items[0].lo+3, leaf.lo);
+        std::copy(items[0].hi, items[0].hi+3, leaf.hi);
+        leaf.item = items[0].item;
+        leaf.item->spatialLeaf = index;
+        return index;
+    }
+    // split across the widest spread of centers; small subtrees have as many
+    // bins as items, which splits them as well
+    static const int MaxBins = 16;
+    const int bins = static_cast<int>(std::min<size_t>(MaxBins, count));
+    int axis = 0;
+    for(int i=1;i<3;i++){
+        if (centerHi[i]-centerLo[i]>centerHi[axis]-centerLo[axis]){
+            axis = i;
+        }
+    }
+    const float extent = centerHi[axis]-centerLo[axis];
+    const float scale = extent>0 ? bins/extent : 0;
+    const auto binOf = [&](const BuildItem& item){
+        return std::min(bins-1, static_cast<int>((item.Center(axis)-centerLo[axis])*scale));
+    };
+    struct Bin {
+        size_t count;
+        float lo[3];
+        float hi[3];
+        void Clear(){
+            count = 0;
+            std::fill(lo, lo+3, FLT_MAX);
+            std::fill(hi, hi+3, -FLT_MAX);
+        }
+        void Grow(const float otherLo[3], const float otherHi[3]){
+            for(int i=0;i<3;i++){
+                lo[i] = std::min(lo[i], otherLo[i]);
+                hi[i] = std::max(hi[i], otherHi[i]);
+            }
+        }
+    } binned[MaxBins];
+    const bool useSah = depth+1+CeilLog2(count)<=MaxDepth;
+    int bestSplit = 0;
+    if (extent>0 && useSah){
+        for(int b=0;b<bins;b++){
+            binned[b].Clear();
+        }
+        for(size_t i=0;i<count;i++){
+            Bin& bin = binned[binOf(items[i])];
+            bin.count++;
+            bin.Grow(items[i].lo, items[i].hi);
+        }
+        // sweep from the right for the boxes right of each split, then from the left
+        float rightArea[MaxBins];
+        size_t rightCount[MaxBins];
+        Bin right;
+        right.Clear();
+        for(int b=bins-1;b>0;b--){
+            right.count += binned[b].count;
+            right.Grow(binned[b].lo, binned[b].hi);
+            rightArea[b] = right.count ? BoxArea(right.lo, right.hi) : 0;
+            rightCount[b] = right.count;
+        }
+        Bin left;
+        left.Clear();
+        float bestCost = std::numeric_limits<float>::max();
+        for(int b=1;b<bins;b++){
+            left.count += binned[b-1].count;
+            left.Grow(binned[b-1].lo, binned[b-1].hi);
+            if (left.count==0 || rightCount[b]==0){
+                continue;
+            }
+            const float cost = BoxArea(left.lo, left.hi)*left.count+rightArea[b]*rightCount[b];
+            if (cost<bestCost){
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+    }
+    // when all the centers coincide any split is as good as another
+    size_t middle = count/2;
+    float leftLo[3];
+    float leftHi[3];
+    float rightLo[3];
+    float rightHi[3];
+    std::copy(centerLo, centerLo+3, leftLo);
+    std::copy(centerHi, centerHi+3, leftHi);
+    std::copy(centerLo, centerLo+3, rightLo);
+    std::copy(centerHi, centerHi+3, rightHi);
+    if (bestSplit>0){
+        // partition, finding the center bounds of each side along the way
+        std::fill(leftLo, leftLo+3, FLT_MAX);
+        std::fill(leftHi, leftHi+3, -FLT_MAX);
+        std::fill(rightLo, rightLo+3, FLT_MAX);
+        std::fill(rightHi, rightHi+3, -FLT_MAX);
+        size_t i = 0;
+        size_t j = count;
+        while(i<j){
+            float* lo = rightLo;
+            float* hi = rightHi;
+            size_t placed;
+            if (binOf(items[i])<bestSplit){
+                lo = leftLo;
+                hi = leftHi;
+                placed = i++;
+            } else {
+                std::swap(items[i], items[--j]);
+                placed = j;
+            }
+            for(int k=0;k<3;k++){
+                lo[k] = std::min(lo[k], items[placed].Center(k));
+                hi[k] = std::max(hi[k], items[placed].Center(k));
+            }
+        }
+        middle = i;
+    } else if (extent>0){
+        std::nth_element(items, items+middle, items+count, [axis](const BuildItem& a, const BuildItem& b){
+            return a.Center(axis)<b.Center(axis);
+        });
+        CenterBounds(items, middle, leftLo, leftHi);
+        CenterBounds(items+middle, count-middle, rightLo, rightHi);
+    }
+    const uint32_t left = Build(items, middle, leftLo, leftHi, depth+1);
+    const uint32_t right = Build(items+middle, count-middle, rightLo, rightHi, depth+1);
+    Node& node = nodes[index];
+    node.left = left;
+    node.right = right;
+    nodes[left].parent = index;
+    nodes[right].parent = index;
+    for(int i=0;i<3;i++){
+        node.lo[i] = std::min(nodes[left].lo[i], nodes[right].lo[i]);
+        node.hi[i] = std::max(nodes[left].hi[i], nodes[right].hi[i]);
+    }
+    const float area = BoxArea(node.lo, node.hi);
+    node.areaSum = area+nodes[left].areaSum+nodes[right].areaSum;
+    node.builtArea = area;
+    node.leaves = static_cast<uint32_t>(count);
+    node.height = ParentHeight(nodes[left], nodes[right]);
+    return index;
+}
+
+/**
+ * Rebuilds the subtree under an internal node in place
+ */
+void SpatialIndex::Rebuild(const uint32_t index){
+    const uint32_t parent = nodes[index].parent;
+    const bool isLeft = parent!=NoNode && nodes[parent].left==index;
+    unsigned int depth = 0;
+    for(uint32_t i=parent;i!=NoNode;i=nodes[i].parent){
+        depth++;
+    }
+    std::vector<BuildItem> items;
+    Dismantle(index, items);
+    float centerLo[3];
+    float centerHi[3];
+    CenterBounds(items.data(), items.size(), centerLo, centerHi);
+    const uint32_t subtree = Build(items.data(), items.size(), centerLo, centerHi, depth);
+    stats.rebuiltLeaves += items.size();
+    nodes[subtree].parent = parent;
+    if (parent==NoNode){
+        root = subtree;
+        return;
+    }
+    if (isLeft){
+        nodes[parent].left = subtree;
+    } else {
+        nodes[parent].right = subtree;
+    }
+    // the boxes above are the same, but their area sums are not
+    RefitUp(parent);
+}
+
+/**
+ * Rebuilds the smallest subtree on the deepest path that Build can bring
+ * back within MaxDepth
+ */
+void SpatialIndex::RebuildDeepest(){
+    uint32_t index = root;
+    uint32_t chosen = root;
+    for(unsigned int depth=0;nodes[index].item==nullptr;depth++){
+        if (depth+CeilLog2(nodes[index].leaves)<=MaxDepth){
+            chosen = index;
+        }
+        const Node& node = nodes[index];
+        index = nodes[node.left].height>=nodes[node.right].height ? node.left : node.right;
+    }
+    Rebuild(chosen);
+}
+
+/**
+ * Frees the nodes of a subtree, and returns its leaves as build items
+ */
+void SpatialIndex::Dismantle(const uint32_t index, std::vector<BuildItem>& items){
+    const Node& node = nodes[index];
+    if (node.item!=nullptr){
+        BuildItem item;
+        std::copy(node.lo, node.lo+3, item.lo);
+        std::copy(node.hi, node.hi+3, item.hi);
+        item.item = node.item;
+        items.push_back(item);
+        FreeNode(index);
+        return;
+    }
+    const uint32_t left = node.left;
+    const uint32_t right = node.right;
+    FreeNode(index);
+    Dismantle(left, items);
+    Dismantle(right, items);
+}
+
+void SpatialIndex::CollectItems(const uint32_t index, std::vector<ScenegraphNode*>& results)const{
+    WalkTree(nodes, index, [&](const uint32_t i){
+        if (nodes[i].item!=nullptr){
+            results.push_back(nodes[i].item);
+            return false;
+        }
+        return true;
+    });
+}
+
+void SpatialIndex::Forget(ScenegraphNode* item){
+    const uint32_t leaf = item->spatialLeaf;
+    item->spatialIndex = nullptr;
+    const uint32_t slot = nodes[leaf].addedSlot;
+    if (slot!=NoNode){
+        // not linked in yet, so just drop it from added
+        added[slot] = added.back();
+        nodes[added[slot]].addedSlot = slot;
+        added.pop_back();
+        FreeNode(leaf);
+        return;
+    }
+    RemoveLeaf(leaf);
+}
+
+/**
+ * Stamps the leaves of the nodes of a tree that are in this index
+ */
+void SpatialIndex::StampTree(const ScenegraphNode* node){
+    if (node->spatialIndex==this){
+        nodes[node->spatialLeaf].stamp = stamp;
+    }
+    for(const auto& i : node->children){
+        StampTree(i.get());
+    }
+}
+
+/**
+ * Removes the leaves whose nodes are no longer in a tree
+ */
+void SpatialIndex::RemoveDetached(const ScenegraphNode* treeRoot){
+    stamp++;
+    StampTree(treeRoot);
+    for(uint32_t i=0;i<nodes.size();i++){
+        if (nodes[i].item!=nullptr && nodes[i].stamp!=stamp){
+            Forget(nodes[i].item);
+            stats.removed++;
+        }
+    }
+}
+
+void SpatialIndex::BeginUpdate(){
+    added.clear();
+    moved.clear();
+    stats = UpdateStats();
+}
+
+void SpatialIndex::Place(ScenegraphNode* node, const bool hasMoved){
+    if (node->spatialIndex==this){
+        if (node->modelBounds[3]<0){
+            Forget(node);
+            stats.removed++;
+        } else if (hasMoved){
+            SetLeafBox(node->spatialLeaf);
+            moved.push_back(node->spatialLeaf);
+        }
+        return;
+    }
+    if (node->modelBounds[3]<0){
+        return;
+    }
+    if (node->spatialIndex!=nullptr){
+        node->spatialIndex->Forget(node);
+    }
+    const uint32_t leaf = AllocateNode();
+    nodes[leaf].item = node;
+    nodes[leaf].addedSlot = static_cast<uint32_t>(added.size());
+    SetLeafBox(leaf);
+    node->spatialIndex = this;
+    node->spatialLeaf = leaf;
+    added.push_back(leaf);
+}
+
+void SpatialIndex::EndUpdate(const ScenegraphNode* treeRoot){
+    // every node of the tree with a model has been placed, so if the index
+    // holds more, some have left the tree without being destroyed
+    if (leafCount+added.size()!=treeRoot->subtreeModels){
+        RemoveDetached(treeRoot);
+    }
+    stats.inserted = added.size();
+    stats.moved = moved.size();
+    if (root==NoNode || added.size()>leafCount){
+        // building from scratch beats inserting more leaves than there are
+        Rebuild();
+    } else {
+        for(const uint32_t leaf : added){
+            nodes[leaf].addedSlot = NoNode;
+            InsertLeaf(leaf);
+        }
+        added.clear();
+        for(const uint32_t leaf : moved){
+            const uint32_t parent = nodes[leaf].parent;
+            // the group of about eight leaves it was built into
+            uint32_t group = parent;
+            for(unsigned int i=1;i<ReinsertLevels && group!=NoNode && nodes[group].parent!=NoNode;i++){
+                group = nodes[group].parent;
+            }
+            if (group==NoNode || BoxContains(nodes[group].lo, nodes[group].hi,
+                                             nodes[leaf].lo, nodes[leaf].hi)){
+                MarkDirty(parent);
+            } else {
+                // refitting would stretch the group's boxes after it
+                UnlinkLeaf(leaf);
+                InsertLeaf(leaf);
+                stats.reinserted++;
+            }
+        }
+        if (nodes[root].dirty){
+            RefitDirty(root);
+            size_t budget = leafCount/RebuildShare;
+            RebuildDegraded(root, budget);
+        }
+        while(nodes[root].height>MaxDepth){
+            // inserts have gone too deep for Raycast's stack
+            RebuildDeepest();
+        }
+    }
+    moved.clear();
+}
+
+void SpatialIndex::Rebuild(){
+    std::vector<BuildItem> items;
+    items.reserve(leafCount+added.size());
+    if (root!=NoNode){
+        Dismantle(root, items);
+    }
+    for(const uint32_t leaf : added){
+        Dismantle(leaf, items);
+    }
+    added.clear();
+    // every node is free now, so start over with a compact array
+    nodes.clear();
+    freeNodes.clear();
+    nodes.reserve(items.size()*2);
+    leafCount = items.size();
+    root = NoNode;
+    if (!items.empty()){
+        float centerLo[3];
+        float centerHi[3];
+        CenterBounds(items.data(), items.size(), centerLo, centerHi);
+        root = Build(items.data(), items.size(), centerLo, centerHi, 0);
+        nodes[root].parent = NoNode;
+        stats.rebuiltLeaves += items.size();
+    }
+}
+
+SpatialIndex::RayHit SpatialIndex::Raycast(const Vector3& origin, const Vector3& direction,
+                                           const float maxDistance)const{
+    RayHit hit;
+    const float o[3] = { origin.GetX(), origin.GetY(), origin.GetZ() };
+    const float d[3] = { direction.GetX(), direction.GetY(), direction.GetZ() };
+    const float a = d[0]*d[0]+d[1]*d[1]+d[2]*d[2];
+    if (root==NoNode || a==0){
+        return hit;
+    }
+    float inverse[3];
+    for(int i=0;i<3;i++){
+        // +infinity for -0 as well, which RayHitsBox needs
+        inverse[i] = d[i]!=0 ? 1/d[i] : std::numeric_limits<float>::infinity();
+    }
+    float nearest = maxDistance;
+    // nodes to visit, with where the ray enters them; the nearer child is visited first
+    struct Entry {
+        uint32_t index;
+        float distance;
+    };
+    // each level down pops one entry and pushes at most two, and the
+    // hierarchy is no more than MaxDepth levels deep
+    Entry stack[MaxDepth+1];
+    size_t stackSize = 0;
+    float entry;
+    if (RayHitsBox(o, inverse, nodes[root].lo, nodes[root].hi, nearest, entry)){
+        stack[stackSize++] = { root, entry };
+    }
+    while(stackSize>0){
+        const Entry top = stack[--stackSize];
+        if (top.distance>nearest){
+            continue;
+        }
+        const Node& node = nodes[top.index];
+        if (node.item!=nullptr){
+            const float* sphere = node.item->modelBounds;
+            const float oc[3] = { o[0]-sphere[0], o[1]-sphere[1], o[2]-sphere[2] };
+            const float b = d[0]*oc[0]+d[1]*oc[1]+d[2]*oc[2];
+            const float c = oc[0]*oc[0]+oc[1]*oc[1]+oc[2]*oc[2]-sphere[3]*sphere[3];
+            float t = 0;
+            if (c>0){
+                const float discriminant = b*b-a*c;
+                if (b>0 || discriminant<0){
+                    continue;
+                }
+                t = (-b-std::sqrt(discriminant))/a;
+            }
+            if (t<nearest || (hit.node==nullptr && t<=nearest)){
+                nearest = t;
+                hit.node = node.item;
+                hit.distance = t;
+            }
+            continue;
+        }
+        float leftEntry;
+        float rightEntry;
+        const Node& left = nodes[node.left];
+        const Node& right = nodes[node.right];
+        const bool hitsLeft = RayHitsBox(o, inverse, left.lo, left.hi, nearest, leftEntry);
+        const bool hitsRight = RayHitsBox(o, inverse, right.lo, right.hi, nearest, rightEntry);
+        if (hitsLeft && hitsRight){
+            const bool leftFirst = leftEntry<=rightEntry;
+            stack[stackSize++] = leftFirst ? Entry{ node.right, rightEntry } : Entry{ node.left, leftEntry };
+            stack[stackSize++] = leftFirst ? Entry{ node.left, leftEntry } : Entry{ node.right, rightEntry };
+        } else if (hitsLeft){
+            stack[stackSize++] = { node.left, leftEntry };
+        } else if (hitsRight){
+            stack[stackSize++] = { node.right, rightEntry };
+        }
+    }
+    return hit;
+}
+
+size_t SpatialIndex::QuerySphere(const Vector3& center, const float radius,
+                                 std::vector<ScenegraphNode*>& results)const{
+    const size_t before = results.size();
+    if (root==NoNode){
+        return 0;
+    }
+    const float c[3] = { center.GetX(), center.GetY(), center.GetZ() };
+    WalkTree(nodes, root, [&](const uint32_t index){
+        const Node& node = nodes[index];
+        float distanceSq = 0;
+        for(int i=0;i<3;i++){
+            const float outside = std::max(node.lo[i]-c[i], c[i]-node.hi[i]);
+            if (outside>0){
+                distanceSq += outside*outside;
+            }
+        }
+        if (distanceSq>radius*radius){
+            return false;
+        }
+        if (node.item==nullptr){
+            return true;
+        }
+        const float* sphere = node.item->modelBounds;
+        const float dx = sphere[0]-c[0];
+        const float dy = sphere[1]-c[1];
+        const float dz = sphere[2]-c[2];
+        const float reach = radius+sphere[3];
+        if (dx*dx+dy*dy+dz*dz<=reach*reach){
+            results.push_back(node.item);
+        }
+        return false;
+    });
+    return results.size()-before;
+}
+
+size_t SpatialIndex::QueryFrustum(const float planes[6][4], std::vector<ScenegraphNode*>& results)const{
+    const size_t before = results.size();
+    if (root==NoNode){
+        return 0;
+    }
+    WalkTree(nodes, root, [&](const uint32_t index){
+        const Node& node = nodes[index];
+        const SphereSide side = ClassifyBox(planes, node.lo, node.hi);
+        if (side==SphereOutside){
+            return false;
+        }
+        if (side==SphereInside){
+            CollectItems(index, results);
+            return false;
+        }
+        if (node.item==nullptr){
+            return true;
+        }
+        if (ClassifySphere(planes, node.item->modelBounds)!=SphereOutside){
+            results.push_back(node.item);
+        }
+        return false;
+    });
+    return results.size()-before;
+}
+
+size_t SpatialIndex::GetCount()const{
+    return leafCount;
+}
+
+float SpatialIndex::GetCost()const{
+    if (root==NoNode){
+        return 0;
+    }
+    const Node& node = nodes[root];
+    return SubtreeCost(node.areaSum, BoxArea(node.lo, node.hi));
+}
+
+const SpatialIndex::UpdateStats& SpatialIndex::GetUpdateStats()const{
+    return stats;
+}
+
+/*** Flat Scene Implementation ***/
+
+FlatNodePtr::FlatNodePtr(){
+    // nop
+}
+
+FlatNodePtr::FlatNodePtr(FlatScene* sc, const uint32_t nodeId):scene(sc),id(nodeId){
+    scene->Retain(id);
+}
+
+FlatNodePtr::FlatNodePtr(const FlatNodePtr& other):scene(other.scene),id(other.id){
+    if (scene!=nullptr){
+        scene->Retain(id);
+    }
+}
+
+FlatNodePtr::FlatNodePtr(FlatNodePtr&& other):scene(other.scene),id(other.id){
+    other.scene = nullptr;
+}
+
+FlatNodePtr& FlatNodePtr::operator=(const FlatNodePtr& other){
+    // retain first in case other refers to the same node
+    if (other.scene!=nullptr){
+        other.scene->Retain(other.id);
+    }
+    if (scene!=nullptr){
+        scene->Release(id);
+    }
+    scene = other.scene;
+    id = other.id;
+    return *this;
+}
+
+FlatNodePtr& FlatNodePtr::operator=(FlatNodePtr&& other){
+    if (this!=&other){
+        if (scene!=nullptr){
+            scene->Release(id);
+        }
+        scene = other.scene;
+        id = other.id;
+        other.scene = nullptr;
+    }
+    return *this;
+}
+
+FlatNodePtr::~FlatNodePtr(){
+    if (scene!=nullptr){
+        scene->Release(id);
+    }
+}
+
+FlatNodePtr::operator bool()const{
+    return scene!=nullptr;
+}
+
+bool FlatNodePtr::operator==(const FlatNodePtr& other)const{
+    return scene==other.scene && (scene==nullptr || id==other.id);
+}
+
+bool FlatNodePtr::operator!=(const FlatNodePtr& other)const{
+    return !(*this==other);
+}
+
+void FlatNodePtr::AddChild(const FlatNodePtr& node)const{
+    if (node.scene!=scene){
+        throw std::runtime_error("FlatNodePtr::AddChild: the child is in a different scene");
+    }
+    const uint32_t parentRow = scene->rows[id];
+    const uint32_t childRow = scene->rows[node.id];
+    for(uint32_t row=parentRow;row!=FlatScene::NoIndex;row=scene->parents[row]){
+        if (row==childRow){
+            throw std::runtime_error("FlatNodePtr::AddChild: a node cannot be a child of itself or its descendants");
+        }
+    }
+    if (scene->parents[childRow]!=FlatScene::NoIndex){
+        scene->Unlink(childRow);
+    }
+    scene->Link(parentRow, childRow);
+}
+
+void FlatNodePtr::RemoveChild(const FlatNodePtr& node)const{
+    if (node.scene!=scene || scene->parents[scene->rows[node.id]]!=scene->rows[id]){
+        return;
+    }
+    scene->Unlink(scene->rows[node.id]);
+}
+
+FlatNodePtr FlatNodePtr::GetParent()const{
+    const uint32_t parentRow = scene->parents[scene->rows[id]];
+    if (parentRow==FlatScene::NoIndex){
+        return FlatNodePtr();
+    }
+    return FlatNodePtr(scene, scene->ids[parentRow]);
+}
+
+void FlatNodePtr::SetLocalTransform(const Transform3D& transform)const{
+    const uint32_t row = scene->rows[id];
+    scene->locals[row] = transform;
+    scene->MarkDirty(row);
+}
+
+const Transform3D& FlatNodePtr::GetLocalTransform()const{
+    return scene->locals[scene->rows[id]];
+}
+
+const Transform3D& FlatNodePtr::GetWorldTransform()const{
+    return scene->worlds[scene->rows[id]];
+}
+
+const uint32_t FlatScene::NoIndex;
+
+FlatScene::FlatScene(){
+    // nop
+}
+
+FlatNodePtr FlatScene::Create(const Sprite3D& sprite){
+    uint32_t id;
+    if (freeIds.empty()){
+        id = rows.size();
+        rows.push_back(0);
+        refCounts.push_back(0);
+    } else {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    // a new root at the end leaves the rows in depth first order
+    const uint32_t row = ids.size();
+    rows[id] = row;
+    locals.push_back(sprite.GetTransform());
+    worlds.push_back(locals.back());
+    parents.push_back(NoIndex);
+    firstChildren.push_back(NoIndex);
+    nextSiblings.push_back(NoIndex);
+    models.push_back(sprite.modelPtr);
+    lastChildren.push_back(NoIndex);
+    prevSiblings.push_back(NoIndex);
+    worldDirty.push_back(0);
+    subtreeEnds.push_back(row+1);
+    ids.push_back(id);
+    return FlatNodePtr(this, id);
+}
+
+void FlatScene::Retain(const uint32_t id){
+    refCounts[id]++;
+}
+
+void FlatScene::Release(const uint32_t id){
+    if (--refCounts[id]==0 && parents[rows[id]]==NoIndex){
+        Destroy(rows[id]);
+    }
+}
+
+void FlatScene::MarkDirty(const uint32_t row){
+    if (!worldDirty[row]){
+        worldDirty[row] = 1;
+        dirtyRows.push_back(row);
+    }
+}
+
+void FlatScene::Link(const uint32_t parent, const uint32_t child){
+    parents[child] = parent;
+    nextSiblings[child] = NoIndex;
+    prevSiblings[child] = lastChildren[parent];
+    if (lastChildren[parent]==NoIndex){
+        firstChildren[parent] = child;
+    } else {
+        nextSiblings[lastChildren[parent]] = child;
+    }
+    lastChildren[parent] = child;
+    MarkDirty(child);
+    orderDirty = true;
+}
+
+void FlatScene::Unlink(const uint32_t child){
+    const uint32_t parent = parents[child];
+    const uint32_t prev = prevSiblings[child];
+    const uint32_t next = nextSiblings[child];
+    if (prev==NoIndex){
+        firstChildren[parent] = next;
+    } else {
+        nextSiblings[prev] = next;
+    }
+    if (next==NoIndex){
+        lastChildren[parent] = prev;
+    } else {
+        prevSiblings[next] = prev;
+    }
+    parents[child] = NoIndex;
+    nextSiblings[child] = prevSiblings[child] = NoIndex;
+    orderDirty = true;
+    // without a parent or a handle the child is no longer referenced
+    if (refCounts[ids[child]]==0){
+        Destroy(child);
+    } else {
+        MarkDirty(child);
+    }
+}
+
+void FlatScene::Destroy(const uint32_t row){
+    // the nodes waiting to be destroyed are chained through their nextSiblings,
+    // which they no longer need, so this allocates nothing
+    uint32_t pending = row;
+    nextSiblings[row] = NoIndex;
+    while(pending!=NoIndex){
+        const uint32_t node = pending;
+        pending = nextSiblings[node];
+        uint32_t child = firstChildren[node];
+        while(child!=NoIndex){
+            const uint32_t next = nextSiblings[child];
+            parents[child] = NoIndex;
+            prevSiblings[child] = NoIndex;
+            if (refCounts[ids[child]]==0){
+                nextSiblings[child] = pending;
+                pending = child;
+            } else {
+                nextSiblings[child] = NoIndex;
+                MarkDirty(child);
+            }
+            child = next;
+        }
+        firstChildren[node] = lastChildren[node] = NoIndex;
+        nextSiblings[node] = prevSiblings[node] = NoIndex;
+        models[node].reset();
+        freeIds.push_back(ids[node]);
+        ids[node] = NoIndex;
+    }
+    orderDirty = true;
+}
+
+/**
+ * Moves the values of an array into a new order of rows
+ *
+ * order lists the old row for each new row.  Rows before first keep their
+ * place, so only the values after them are moved.
+ */
+template<typename T>
+static void PermuteRows(std::vector<T>& values, const std::vector<uint32_t>& order, const size_t first){
+    std::vector<T> tail(std::make_move_iterator(values.begin()+first),
+                        std::make_move_iterator(values.end()));
+    values.resize(order.size());
+    for(size_t i=first;i<order.size();i++){
+        values[i] = std::move(tail[order[i]-first]);
+    }
+}
+
+static uint32_t RemapRow(const std::vector<uint32_t>& newRows, const uint32_t row){
+    return row==FlatScene::NoIndex ? FlatScene::NoIndex : newRows[row];
+}
+
+void FlatScene::Reorder(){
+    if (!orderDirty){
+        return;
+    }
+    // walk every tree depth first, listing the rows in their new order
+    std::vector<uint32_t> order;
+    order.reserve(GetNodeCount());
+    for(uint32_t root=0;root<ids.size();root++){
+        if (ids[root]==NoIndex || parents[root]!=NoIndex){
+            continue;
+        }
+        uint32_t row = root;
+        for(;;){
+            order.push_back(row);
+            if (firstChildren[row]!=NoIndex){
+                row = firstChildren[row];
+                continue;
+            }
+            while(row!=root && nextSiblings[row]==NoIndex){
+                row = parents[row];
+            }
+            if (row==root){
+                break;
+            }
+            row = nextSiblings[row];
+        }
+    }
+    
+    const size_t count = order.size();
+    std::vector<uint32_t> newRows(ids.size(), NoIndex);
+    for(uint32_t i=0;i<count;i++){
+        newRows[order[i]] = i;
+    }
+    
+    // rows before the first one that moves stay where they are
+    size_t first = 0;
+    while(first<count && order[first]==first){
+        first++;
+    }
+    PermuteRows(locals, order, first);
+    PermuteRows(models, order, first);
+    PermuteRows(ids, order, first);
+    PermuteRows(parents, order, first);
+    PermuteRows(firstChildren, order, first);
+    PermuteRows(nextSiblings, order, first);
+    PermuteRows(lastChildren, order, first);
+    PermuteRows(prevSiblings, order, first);
+    PermuteRows(worlds, order, first);
+    PermuteRows(worldDirty, order, first);
+    
+    for(uint32_t i=0;i<count;i++){
+        parents[i] = RemapRow(newRows, parents[i]);
+        firstChildren[i] = RemapRow(newRows, firstChildren[i]);
+        nextSiblings[i] = RemapRow(newRows, nextSiblings[i]);
+        lastChildren[i] = RemapRow(newRows, lastChildren[i]);
+        prevSiblings[i] = RemapRow(newRows, prevSiblings[i]);
+    }
+    // the dirty rows have moved, and those of destroyed nodes are gone
+    dirtyRows.clear();
+    for(uint32_t i=0;i<count;i++){
+        if (worldDirty[i]){
+            dirtyRows.push_back(i);
+        }
+    }
+    for(uint32_t i=first;i<count;i++){
+        rows[ids[i]] = i;
+    }
+    
+    // children come after their parents, so one backwards pass finds the subtree ends
+    subtreeEnds.resize(count);
+    for(uint32_t i=0;i<count;i++){
+        subtreeEnds[i] = i+1;
+    }
+    for(uint32_t i=count;i-->0;){
+        if (parents[i]!=NoIndex){
+            subtreeEnds[parents[i]] = std::max(subtreeEnds[parents[i]], subtreeEnds[i]);
+        }
+    }
+    orderDirty = false;
+}
+
+void FlatScene::Update(){
+    Reorder();
+    // in row order, each dirty row's subtree is one run of rows that covers
+    // any dirty rows inside it, so each run is recomputed once
+    std::sort(dirtyRows.begin(), dirtyRows.end());
+    uint32_t end = 0;
+    for(const uint32_t row : dirtyRows){
+        worldDirty[row] = 0;
+        if (row<end){
+            continue;
+        }
+        end = subtreeEnds[row];
+        for(uint32_t i=row;i<end;i++){
+            const uint32_t parent = parents[i];
+            if (parent==NoIndex){
+                worlds[i] = locals[i];
+            } else {
+                worlds[i] = worlds[parent]*locals[i];
+            }
+        }
+    }
+    dirtyRows.clear();
+}
+
+void FlatScene::Draw(const GraphicsProvider3D* provider, const FlatNodePtr& root)const{
+    if (root.scene!=this){
+        throw std::runtime_error("FlatScene::Draw: the root is not in this scene");
+    }
+    if (orderDirty){
+        throw std::runtime_error("FlatScene::Draw: the scene has changed shape since the last Update");
+    }
+    const uint32_t end = subtreeEnds[rows[root.id]];
+    for(uint32_t i=rows[root.id];i<end;i++){
+        provider->DrawModel(models[i].get(), worlds[i]);
+    }
+}
+
+void FlatScene::Collect(RenderList& list, const FlatNodePtr& root, FrameStats& stats)const{
+    if (root.scene!=this){
+        throw std::runtime_error("FlatScene::Collect: the root is not in this scene");
+    }
+    if (orderDirty){
+        throw std::runtime_error("FlatScene::Collect: the scene has changed shape since the last Update");
+    }
+    const uint32_t end = subtreeEnds[rows[root.id]];
+    for(uint32_t i=rows[root.id];i<end;i++){
+        if (models[i]){
+            list.Add(models[i].get(), worlds[i]);
+        }
+    }
+    stats.nodesDrawn += end-rows[root.id];
+}
+
+size_t FlatScene::GetNodeCount()const{
+    return rows.size()-freeIds.size();
+}
+
+//*** RenderList Implementation
+
+uint64_t RenderList::MakeKey(const G3DModel* model, const float matrix[16]){
+    // the camera looks down -z.  Flipping all the bits of a negative float and
+    // just the sign bit of a positive one makes the bits sort the way the values
+    // do, so draws behind the eye still keep their order
+    const float depth = -matrix[14];
+    uint32_t depthBits;
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    depthBits ^= (depthBits&0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+    return (uint64_t(model->GetTextureName()&0xFFFF)<<48) |
+           (uint64_t(model->GetId()&0xFFFFFF)<<24) |
+           (depthBits>>8);
+}
+
+void RenderList::Clear(){
+    packets.clear();
+    models.clear();
+    matrices.clear();
+}
+
+void RenderList::Add(const G3DModel* model, const Transform3D& transform){
+    const float* matrix = transform.GetOGLData();
+    packets.push_back(Packet{MakeKey(model, matrix), (uint32_t)models.size()});
+    models.push_back(model);
+    matrices.insert(matrices.end(), matrix, matrix+16);
+}
+
+void RenderList::Sort(){
+    const size_t count = packets.size();
+    if (count<2){
+        return;
+    }
+    // one pass counts all eight bytes of every key
+    size_t histograms[8][256] = {};
+    for(const Packet& p : packets){
+        for(unsigned int b=0;b<8;b++){
+            histograms[b][(p.key>>(b*8))&0xFF]++;
+        }
+    }
+    scratch.resize(count);
+    Packet* from = packets.data();
+    Packet* to = scratch.data();
+    for(unsigned int b=0;b<8;b++){
+        const unsigned int shift = b*8;
+        size_t* offsets = histograms[b];
+        if (offsets[(from[0].key>>shift)&0xFF]==count){
+            continue; // every key has the same byte here
+        }
+        size_t offset = 0;
+        for(unsigned int d=0;d<256;d++){
+            const size_t n = offsets[d];
+            offsets[d] = offset;
+            offset += n;
+        }
+        for(size_t i=0;i<count;i++){
+            to[offsets[(from[i].key>>shift)&0xFF]++] = from[i];
+        }
+        std::swap(from, to);
+    }
+    if (from!=packets.data()){
+        packets.swap(scratch);
+    }
+}
+
+void RenderList::Submit(const GraphicsProvider3D* provider, G3DDrawStats& stats){
+    const size_t count = packets.size();
+    sortedModels.resize(count);
+    sortedMatrices.resize(count);
+    for(size_t i=0;i<count;i++){
+        const uint32_t index = packets[i].index;
+        sortedModels[i] = models[index];
+        sortedMatrices[i] = &matrices[index*16];
+    }
+    provider->DrawModels(sortedModels.data(), sortedMatrices.data(), count, stats);
+}
+
+size_t RenderList::GetCount()const{
+    return packets.size();
+}
+
+//*** TransformWorkers Implementation
+
+namespace Scenegraph3D {
+    /**
+     * A work stealing pool that refreshes the world transforms and bounds of a tree
+     *
+     * Each task is a node whose parent's world transform is already up to date.
+     * A worker refreshes the node and then either queues its children or, once
+     * it has enough queued work, descends into them itself.  Workers take the
+     * newest task from their own queue and steal the oldest, and so usually the
+     * largest, subtree from the others when theirs runs dry.  Every node is
+     * refreshed by exactly one worker from its parent's finished transform, so
+     * the results are the same as the serial draw's.
+     *
+     * Bounds are merged children first.  Each node counts down its unfinished
+     * children, and whichever worker finishes the last of them merges the
+     * node's bounds and moves on to its parent, so the whole update is a single
+     * pass over the tree.  Nodes to place in the spatial index are listed per
+     * worker and placed by the calling thread once the pass is done, since the
+     * index is not thread safe.
+     *
+     * The thread calling Update is worker 0; the others are threads that sleep
+     * between frames, and also while there is nothing for them to steal.
+     */
+    class TransformWorkers {
+    public:
+        explicit TransformWorkers(const unsigned int count);
+        ~TransformWorkers();
+        
+        unsigned int GetCount()const;
+        
+        /**
+         * Refreshes the world transforms and bounds of root and its descendants
+         *
+         * @param index if not nullptr, the spatial index to place each node that
+         * has a model in, between its BeginUpdate and EndUpdate
+         * @returns the number of world transforms recomputed
+         */
+        size_t Update(ScenegraphNode* root, const bool rootChanged, SpatialIndex* index);
+        
+    private:
+        /**
+         * A node to refresh, and the world transform of its parent
+         */
+        struct Task {
+            ScenegraphNode* node;
+            const Transform3D* parentWorld;
+            bool parentChanged;
+        };
+        
+        /**
+         * A node to place in the spatial index, and whether its bounds moved
+         */
+        struct Placement {
+            ScenegraphNode* node;
+            bool moved;
+        };
+        
+        struct Worker {
+            std::mutex lock;
+            std::deque<Task> tasks;
+            // tasks.size(), readable without the lock
+            std::atomic<size_t> queued{0};
+            size_t recomputed=0;
+            std::vector<Placement> placements;
+        };
+        
+        /**
+         * A worker descends into children itself rather than queueing them
+         * once it has this many tasks queued
+         */
+        static const size_t QueueTarget = 2;
+        
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        // tasks queued or being processed in the current frame
+        std::atomic<size_t> pending{0};
+        // the root of the current update, and the index to list placements for
+        ScenegraphNode* updateRoot=nullptr;
+        const SpatialIndex* placing=nullptr;
+        
+        std::mutex frameLock;
+        std::condition_variable frameStart;
+        std::condition_variable frameEnd;
+        unsigned int frame=0;
+        unsigned int busy=0;
+        bool stopping=false;
+        
+        // workers with nothing to do wait on idleWake until a task is
+        // queued or the frame is done
+        std::mutex idleLock;
+        std::condition_variable idleWake;
+        std::atomic<unsigned int> idle{0};
+        
+        void ThreadMain(const unsigned int index);
+        void Work(const unsigned int index);
+        void Process(Worker& worker, const Task& task);
+        void Finish(Worker& worker, ScenegraphNode* node);
+        void Push(Worker& worker, const Task& task);
+        bool Pop(Worker& worker, Task& task);
+        bool Steal(const unsigned int thief, Task& task);
+        bool AnyQueued()const;
+        void WakeIdle(const bool all);
+        
+        TransformWorkers(const TransformWorkers&)=delete;
+        TransformWorkers& operator=(const TransformWorkers&)=delete;
+    };
+}
+
+const size_t TransformWorkers::QueueTarget;
+
+TransformWorkers::TransformWorkers(const unsigned int count){
+    for(unsigned int i=0;i<count;i++){
+        workers.emplace_back(new Worker());
+    }
+    for(unsigned int i=1;i<count;i++){
+        threads.emplace_back(&TransformWorkers::ThreadMain, this, i);
+    }
+}
+
+TransformWorkers::~TransformWorkers(){
+    {
+        std::lock_guard<std::mutex> guard(frameLock);
+        stopping = true;
+    }
+    frameStart.notify_all();
+    for(auto& i : threads){
+        i.join();
+    }
+}
+
+unsigned int TransformWorkers::GetCount()const{
+    return (unsigned int)workers.size();
+}
+
+size_t TransformWorkers::Update(ScenegraphNode* root, const bool rootChanged, SpatialIndex* index){
+    const Transform3D identity;
+    for(auto& i : workers){
+        i->recomputed = 0;
+        i->placements.clear();
+    }
+    updateRoot = root;
+    placing = index;
+    Push(*workers[0], Task{root, &identity, rootChanged});
+    {
+        std::lock_guard<std::mutex> guard(frameLock);
+        busy = (unsigned int)threads.size();
+        frame++;
+    }
+    frameStart.notify_all();
+    Work(0);
+    {
+        // the other workers may still be on their way out
+        std::unique_lock<std::mutex> guard(frameLock);
+        frameEnd.wait(guard, [this]{ return busy==0; });
+    }
+    size_t recomputed = 0;
+    for(auto& i : workers){
+        recomputed += i->recomputed;
+        for(const Placement& placement : i->placements){
+            index->Place(placement.node, placement.moved);
+        }
+    }
+    return recomputed;
+}
+
+void TransformWorkers::ThreadMain(const unsigned int index){
+    unsigned int seen = 0;
+    for(;;){
+        {
+            std::unique_lock<std::mutex> guard(frameLock);
+            frameStart.wait(guard, [&]{ return stopping || frame!=seen; });
+            if (stopping){
+                return;
+            }
+            seen = frame;
+        }
+        Work(index);
+        {
+            std::lock_guard<std::mutex> guard(frameLock);
+            if (--busy==0){
+                frameEnd.notify_one();
+            }
+        }
+    }
+}
+
+void TransformWorkers::Work(const unsigned int index){
+    Worker& worker = *workers[index];
+    Task task;
+    while(pending.load()!=0){
+        if (Pop(worker, task) || Steal(index, task)){
+            Process(worker, task);
+            if (pending.fetch_sub(1)==1){
+                WakeIdle(true);
+            }
+        } else {
+            // the counts are sequentially consistent, so either a pusher sees
+            // this worker idle or this worker sees its task
+            std::unique_lock<std::mutex> guard(idleLock);
+            idle++;
+            idleWake.wait(guard, [this]{ return pending.load()==0 || AnyQueued(); });
+            idle--;
+        }
+    }
+}
+
+void TransformWorkers::Process(Worker& worker, const Task& task){
+    ScenegraphNode* node = task.node;
+    const bool changed = node->RefreshWorldTransform(*task.parentWorld, task.parentChanged,
+                                                     worker.recomputed);
+    node->visitPending = false;
+    node->childBoundsChanged.store(false, std::memory_order_relaxed);
+    node->unfinishedChildren.store((uint32_t)node->children.size()+1, std::memory_order_relaxed);
+    uint32_t skipped = 0;
+    for(const auto& i : node->children){
+        if (!changed && !i->visitPending){
+            skipped++;
+            continue;
+        }
+        const Task child{i.get(), &node->worldTransform, changed};
+        if (worker.queued.load(std::memory_order_relaxed)<QueueTarget){
+            Push(worker, child);
+        } else {
+            Process(worker, child);
+        }
+    }
+    // this node's own count keeps the total above zero
+    node->unfinishedChildren.fetch_sub(skipped, std::memory_order_relaxed);
+    Finish(worker, node);
+}
+
+void TransformWorkers::Finish(Worker& worker, ScenegraphNode* node){
+    // the last of a node and its children to finish merges its bounds, and
+    // then counts it off its parent
+    while(node->unfinishedChildren.fetch_sub(1, std::memory_order_acq_rel)==1){
+        const bool moved = node->boundsDirty;
+        const bool changed = node->RefreshOwnBounds(node->childBoundsChanged.load(std::memory_order_relaxed));
+        // only nodes with models have bounds of their own.  The index is only
+        // told of those that moved, are new to it or have lost their models
+        const bool hasModel = node->modelBounds[3]>=0;
+        const bool inIndex = node->spatialIndex==placing;
+        if (placing!=nullptr && (moved ? hasModel || inIndex : hasModel && !inIndex)){
+            worker.placements.push_back(Placement{node, moved});
+        }
+        if (node==updateRoot){
+            return;
+        }
+        node = node->parent;
+        if (changed){
+            node->childBoundsChanged.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+void TransformWorkers::Push(Worker& worker, const Task& task){
+    // count the task before anyone can finish it
+    pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        worker.tasks.push_back(task);
+        worker.queued.store(worker.tasks.size());
+    }
+    if (idle.load()!=0){
+        WakeIdle(false);
+    }
+}
+
+bool TransformWorkers::Pop(Worker& worker, Task& task){
+    if (worker.queued.load(std::memory_order_relaxed)==0){
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(worker.lock);
+    if (worker.tasks.empty()){
+        return false;
+    }
+    task = worker.tasks.back();
+    worker.tasks.pop_back();
+    worker.queued.store(worker.tasks.size(), std::memory_order_relaxed);
+    return true;
+}
+
+bool TransformWorkers::Steal(const unsigned int thief, Task& task){
+    const size_t count = workers.size();
+    for(size_t i=1;i<count;i++){
+        Worker& victim = *workers[(thief+i)%count];
+        if (victim.queued.load(std::memory_order_relaxed)==0){
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty()){
+            continue;
+        }
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        victim.queued.store(victim.tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool TransformWorkers::AnyQueued()const{
+    for(const auto& i : workers){
+        if (i->queued.load()!=0){
+            return true;
+        }
+    }
+    return false;
+}
+
+void TransformWorkers::WakeIdle(const bool all){
+    // taking the lock means a worker about to wait has either checked for
+    // work already, and will be woken, or will see it when it checks
+    std::lock_guard<std::mutex> guard(idleLock);
+    if (all){
+        idleWake.notify_all();
+    } else {
+        idleWake.notify_one();
+    }
 }
 
 //*** Scenegraph Implementation
@@ -117,10 +2462,24 @@ static void GraphicsProvider3DKeyCB(const GraphicsProvider3D* provider, int key)
     }
 }
 
-Scenegraph::Scenegraph(std::string windowName, int windowWidth ,int windowHeight){
+/**
+ * Sorts and draws a frame's render list, and records the binds it took
+ */
+static void SubmitRenderList(RenderList& list, const GraphicsProvider3D* provider, FrameStats& stats){
+    list.Sort();
+    G3DDrawStats drawStats;
+    list.Submit(provider, drawStats);
+    stats.vertexArrayBinds = drawStats.vertexArrayBinds;
+    stats.textureBinds = drawStats.textureBinds;
+    stats.vertexArrayBindsSaved = drawStats.draws-drawStats.vertexArrayBinds;
+    stats.textureBindsSaved = drawStats.draws-drawStats.textureBinds;
+}
+
+Scenegraph::Scenegraph(const std::string& windowName, int windowWidth ,int windowHeight){
     providerPtr.reset(GraphicsProvider3D::MakeNewProvider(windowName,windowWidth,windowHeight));
     providerPtr->user_data_ptr=this;
     providerPtr->SetKeyCallback(GraphicsProvider3DKeyCB);
+    SetWorkerCount(1);
 }
 
 void Scenegraph::SetKeyCallback(Scenegraph3DKeyCB cbFunc){
@@ -128,13 +2487,130 @@ void Scenegraph::SetKeyCallback(Scenegraph3DKeyCB cbFunc){
 }
 
 Sprite3D Scenegraph::MakeTexturedSphere(const float radius, const unsigned int rings,
-                                        const unsigned int sectors,const std::string texturePath)const{
+                                        const unsigned int sectors,const std::string& texturePath)const{
     G3DModel* model = providerPtr->MakeTexturedSphere(radius, rings, sectors, texturePath);
     return Sprite3D(model);
 }
 
-void Scenegraph::RenderFrame(SharedNodePtr root)const {
+void Scenegraph::MarkStaleModelBounds(ScenegraphNode* root, const bool rootChanged)const{
+    const unsigned int boundsUpdates = G3DModel::GetBoundsUpdateCount();
+    // a new root has all its bounds recomputed anyway
+    if (boundsUpdates!=lastBoundsUpdateCount && !rootChanged){
+        root->MarkStaleModelBounds();
+    }
+    lastBoundsUpdateCount = boundsUpdates;
+}
+
+void Scenegraph::RenderFrame(const SharedNodePtr& root)const {
+    providerPtr->BeginFrame();
+    NodePool::AgeSpares();
+    frameStats = FrameStats();
+    bool rootChanged = root.get()!=lastRoot;
+    lastRoot = root.get();
+    MarkStaleModelBounds(root.get(), rootChanged);
+    if (indexPtr){
+        indexPtr->BeginUpdate();
+    }
+    if (workersPtr->GetCount()>1){
+        frameStats.transformsRecomputed = workersPtr->Update(root.get(), rootChanged, indexPtr.get());
+    } else {
+        root->RefreshBounds(Transform3D(), rootChanged, frameStats.transformsRecomputed, indexPtr.get());
+    }
+    // the world transforms are the modelview, so these planes are in world coordinates
+    float planes[6][4];
+    providerPtr->GetFrustumPlanes(planes);
+    renderList.Clear();
+    if (indexPtr){
+        indexPtr->EndUpdate(root.get());
+        visibleNodes.clear();
+        indexPtr->QueryFrustum(planes, visibleNodes);
+        for(const ScenegraphNode* node : visibleNodes){
+            node->AddModel(renderList);
+        }
+        frameStats.nodesDrawn = visibleNodes.size();
+        frameStats.nodesCulled = indexPtr->GetCount()-visibleNodes.size();
+    } else {
+        root->Collect(renderList, planes, frameStats);
+    }
+    SubmitRenderList(renderList, providerPtr.get(), frameStats);
+    providerPtr->EndFrame();
+}
+
+void Scenegraph::RenderFrame(const SharedNodePtr& root, const WorldCell& cameraCell,
+                             const Transform3D& cameraTransform)const {
     providerPtr->BeginFrame();
-    root->Draw(providerPtr.get(), Transform3D());
+    NodePool::AgeSpares();
+    const WorldCell originCell(-cameraCell.x, -cameraCell.y, -cameraCell.z);
+    frameStats = FrameStats();
+    const bool rootChanged = root.get()!=lastRoot;
+    lastRoot = root.get();
+    MarkStaleModelBounds(root.get(), rootChanged);
+    // bringing the bounds up to date clears the marks that would lead the
+    // next RenderFrame(root) to the nodes that moved, so the index is told
+    // of them now
+    if (indexPtr){
+        indexPtr->BeginUpdate();
+    }
+    if (workersPtr->GetCount()>1){
+        frameStats.transformsRecomputed = workersPtr->Update(root.get(), rootChanged, indexPtr.get());
+    } else {
+        root->RefreshBounds(Transform3D(), rootChanged, frameStats.transformsRecomputed, indexPtr.get());
+    }
+    if (indexPtr){
+        indexPtr->EndUpdate(root.get());
+    }
+    float planes[6][4];
+    providerPtr->GetFrustumPlanes(planes);
+    renderList.Clear();
+    root->CollectRelative(renderList, cameraTransform, originCell, cellSize, planes, frameStats);
+    SubmitRenderList(renderList, providerPtr.get(), frameStats);
     providerPtr->EndFrame();
-}
\ No newline at end of file
+}
+
+void Scenegraph::RenderFrame(FlatScene& scene, const FlatNodePtr& root)const {
+    scene.Update();
+    providerPtr->BeginFrame();
+    NodePool::AgeSpares();
+    frameStats = FrameStats();
+    renderList.Clear();
+    scene.Collect(renderList, root, frameStats);
+    SubmitRenderList(renderList, providerPtr.get(), frameStats);
+    providerPtr->EndFrame();
+}
+
+void Scenegraph::SetCellSize(const float size){
+    cellSize = size;
+}
+
+float Scenegraph::GetCellSize()const{
+    return cellSize;
+}
+
+const FrameStats& Scenegraph::GetFrameStats()const{
+    return frameStats;
+}
+
+void Scenegraph::SetWorkerCount(const unsigned int count){
+    const unsigned int workers = count ? count : std::max(1u, std::thread::hardware_concurrency());
+    if (!workersPtr || workersPtr->GetCount()!=workers){
+        workersPtr = std::make_shared<TransformWorkers>(workers);
+    }
+}
+
+unsigned int Scenegraph::GetWorkerCount()const{
+    return workersPtr->GetCount();
+}
+
+void Scenegraph::SetSpatialIndexEnabled(const bool enabled){
+    if (!enabled){
+        indexPtr.reset();
+    } else if (!indexPtr){
+        indexPtr = std::make_shared<SpatialIndex>();
+        // visit every node next frame, so they are all entered
+        lastRoot = nullptr;
+    }
+}
+
+const SpatialIndex* Scenegraph::GetSpatialIndex()const{
+    return indexPtr.get();
+}
@@ -13,6 +13,9 @@
 #include <memory>
 #include <string>
 #include <list>
+#include <vector>
+#include <cstdint>
+#include <atomic>
 
 using namespace Graphics3D;
 
@@ -21,6 +24,16 @@ using namespace Graphics3D;
 
 namespace Scenegraph3D {
     
+    /**
+     * Forward declaration of a ScenegraphNode
+     *
+     * Scenegraph nodes are combined to form a tree that describes
+     * their relationships to each other.
+     * This foward declataion is necessary so a Sprite3D can point to the
+     * node holding it, and so ScenegraphNodes can point to each other
+     */
+    class ScenegraphNode; // foward decl
+    
     /**
      * This class defines a Sprite object
      *
@@ -31,7 +44,10 @@ namespace Scenegraph3D {
      *  origin for both translation and rotation
      */
     class Sprite3D {
-        
+        // A FlatScene takes the transform and model straight from a sprite
+        friend class FlatScene;
+        // A ScenegraphNode clears localChanged when it picks up the change
+        friend class ScenegraphNode;
         
     private:
         /**
@@ -47,25 +63,48 @@ namespace Scenegraph3D {
         /**
          * The rotation of the image about the handle
          */
-        Vector3 rotation;
+        Quaternion rotation;
         /**
          * A transform matrix used to hold and apply the combination
-         * of the above 3 values
+         * of the above 3 values.  It is rebuilt lazily, the next time
+         * it is needed after one of them has changed, so setting several
+         * of them in a row only rebuilds it once.
+         */
+        mutable Transform3D transform;
+        /**
+         * Set when handle, position or rotation have changed since
+         * transform was last rebuilt
+         */
+        mutable bool transformDirty=false;
+        /**
+         * Set along with transformDirty, but only cleared by the
+         * ScenegraphNode holding the sprite once it has recomputed its
+         * world transform to match
+         */
+        bool localChanged=true;
+        /**
+         * The ScenegraphNode holding this sprite, or nullptr.  It is told of
+         * each change so RenderFrame can find the changed nodes without
+         * walking the whole tree.  Copies of the sprite do not inherit it.
          */
-        Transform3D transform;
+        ScenegraphNode* owner=nullptr;
         
         std::shared_ptr<G3DModel> modelPtr;
         /**
          * used internally to update the transform when position, rotation
          * or handle change
          */
-        void RecalcTransform();
+        void RecalcTransform()const;
+        /**
+         * Marks the transform for rebuilding and tells the owning node
+         */
+        void MarkChanged();
         
     public:
         /**
          * A default constructor that makes a sprite with unset fields.
          *
-         * This exists primaruly for the use of the default copy constructor which
+         * This exists primaruly for the use of the copy constructor which
          * will set all the new Sprite's fields from the oen being copied.
          */
         Sprite3D();
@@ -80,6 +119,20 @@ namespace Scenegraph3D {
          */
         Sprite3D(G3DModel* model);
         
+        /**
+         * Copies a sprite's fields, except for the node that holds it
+         */
+        Sprite3D(const Sprite3D& other);
+        Sprite3D(Sprite3D&& other);
+        /**
+         * Replaces this sprite's fields with another's
+         *
+         * A sprite in a ScenegraphNode stays in that node, which picks up
+         * the new transform and model at the next RenderFrame.
+         */
+        Sprite3D& operator=(const Sprite3D& other);
+        Sprite3D& operator=(Sprite3D&& other);
+        
         /**
          * Sets the image handle.
          *
@@ -87,11 +140,11 @@ namespace Scenegraph3D {
          * rotation and translation. it is specified relative
          * to the bottom left corner of the image.
          */
-        void SetHandle(const Vector3 relativePosition);
+        void SetHandle(const Vector3& relativePosition);
         /**
          * returns the current handle
          *
-         * @see void SetHandle(const Vector3 relativePosition);
+         * @see void SetHandle(const Vector3& relativePosition);
          *
          * @returns the current image handle in a new Vector3 object
          */
@@ -104,11 +157,11 @@ namespace Scenegraph3D {
          * @param xlation the position of the image handle in the window
          * expressed as a pixel offset from the bottom left window corner
          */
-        void SetTranslation(const Vector3 xlation);
+        void SetTranslation(const Vector3& xlation);
         /**
          * returns the current translation
          *
-         * @see void SetTranslation(const Vector3 xlation);         *
+         * @see void SetTranslation(const Vector3& xlation);         *
          * @returns the current image translation in a new Vector3 object
          */
         
@@ -117,15 +170,35 @@ namespace Scenegraph3D {
         /**
          * Sets the current rotation about the handle
          *
-         * @param radians current rotation in radians
+         * @param rotation the current rotation
+         */
+        void SetRotation(const Quaternion& rotation);
+        /**
+         * returns the current rotation
+         *
+         * @see  void SetRotation(const Quaternion& rotation);
+         *
+         * @returns the current rotation about the handle
+         */
+        Quaternion GetRotation()const;
+        
+        /**
+         * Sets the current rotation about the handle
+         *
+         * This is a convenience that converts the euler angles to a
+         * Quaternion and calls SetRotation.
+         *
+         * @param radians current rotation in radians, applied in the order x,y,z
          */
-        void SetRotationInRadians(Vector3 radians);
+        void SetRotationInRadians(const Vector3& radians);
         /**
          * returns the current rotation
          *
          * @see  void SetRotationInRadians(float radians);;
          *
-         * @returns the current rotation about the handle in radians
+         * @returns the current rotation about the handle in radians.  These
+         * describe the same rotation as the angles last set, but may not be
+         * the same angles.
          */
         
         Vector3 GetRotationInRadians()const;
@@ -138,21 +211,42 @@ namespace Scenegraph3D {
          *
          * @returns the current transform
          */
-        Transform3D GetTransform()const;
+        const Transform3D& GetTransform()const;
         
         /**
-         * CURRENTLY UNMPLEMENTED
-         * Will throw unimplemented exception if called.
+         * Sets the current transform
+         *
+         * The transform is decomposed about the current handle into the
+         * translation and rotation that reproduce it, which replace the
+         * sprite's current translation and rotation.  Any scale in the
+         * transform is discarded.
+         *
+         * @param t the transform to take the translation and rotation from
          */
-        void SetTransform(const Transform3D t);
+        void SetTransform(const Transform3D& t);
         
         /**
-         * Gets the size of the image
+         * Sets the transforms of many sprites at once
          *
-         * The size of the image are the width andd height of the sourceRectangle
-         * in a Vector3 where x==width and y==height.
+         * This is just like calling SetTransform on each sprite with the
+         * matching matrix, but decomposes the matrices in batches so that
+         * importing a large number of poses takes advantage of SIMD.
          *
-         * @returns a Vector3 where x==width and y==height.
+         * @param sprites the sprites whose transforms are to be set
+         * @param matrices the column major 4x4 matrix for each sprite, in the
+         * same order as Transform3D::GetOGLData returns
+         * @param count the number of sprites and matrices
+         */
+        static void SetTransforms(Sprite3D* const sprites[], const float matrices[][16], const size_t count);
+        
+        /**
+         * Gets the size of the model
+         *
+         * This is the size of the model's bounding box in its own coordinates,
+         * before the sprite's transform is applied.
+         *
+         * @returns a Vector3 of the box's width, height and depth, or zeros if
+         * the sprite has no model
          */
         Vector3 GetSize()const;
         
@@ -177,18 +271,165 @@ namespace Scenegraph3D {
          * @param provider The grphics provder whose draw space we are drawing in
          * @param transform he transform to apply to the image when drawn.
          */
-        void Draw(const GraphicsProvider3D* provider,const Transform3D transform)const;
+        void Draw(const GraphicsProvider3D* provider,const Transform3D& transform)const;
+    };
+    
+    /***
+     * This is a coarse position in a large world, counted in whole cells
+     *
+     * Scenes that are too large for float coordinates to stay precise far from
+     * the origin can place nodes in cells.  A node's position is then its cell
+     * times the Scenegraph's cell size plus its ordinary float transform, which
+     * only needs to be precise within a cell.  Cells are integers so that the
+     * distance between any two of them is always exact.
+     **/
+    class WorldCell {
+        public:
+            int64_t x,y,z;
+        
+        WorldCell(){
+            x=y=z=0;
+        }
+        
+        WorldCell(const int64_t cx,const int64_t cy,const int64_t cz){
+            x=cx;
+            y=cy;
+            z=cz;
+        }
+        
+        /**
+         * Splits a double precision world position into a cell and an offset
+         *
+         * @param x the world X coordinate
+         * @param y the world Y coordinate
+         * @param z the world Z coordinate
+         * @param cellSize the length of a cell's edge in world units
+         * @param offset receives the position relative to the returned cell's origin
+         * @returns the cell containing the position
+         */
+        static WorldCell FromPosition(const double x, const double y, const double z,
+                                      const float cellSize, Vector3& offset);
     };
     
     /**
-     * Forward declaration of a ScenegraphNode
+     * Counts of the work done to render a frame
      *
-     * Scenegraph nodes are combined to form a tree that describes
-     * their relationships to each other.
-     * This foward declataion is necessary so the definition of a
-     * ScenegraphNode can have pointers to other ScenegraphNodes
+     * @see Scenegraph::GetFrameStats
      */
-    class ScenegraphNode; // foward decl
+    struct FrameStats {
+        /**
+         * The number of nodes drawn
+         */
+        size_t nodesDrawn=0;
+        /**
+         * The number of nodes skipped because their bounds were outside the
+         * view frustum, including every node of a culled subtree
+         */
+        size_t nodesCulled=0;
+        /**
+         * The number of nodes whose world transforms had to be recomputed
+         * because they or one of their ancestors had changed
+         */
+        size_t transformsRecomputed=0;
+        /**
+         * The number of times a model's vertex arrays or a texture was bound
+         */
+        size_t vertexArrayBinds=0;
+        size_t textureBinds=0;
+        /**
+         * The number of binds saved by sorting the draws, compared to drawing
+         * each model with its own binds in tree order
+         */
+        size_t vertexArrayBindsSaved=0;
+        size_t textureBindsSaved=0;
+    };
+    
+    /**
+     * A frame's draws, sorted to cut down on GL state changes
+     *
+     * Scenegraph::RenderFrame first walks the tree and adds a packet to the list
+     * for each model, then sorts the packets and submits them as one batch.  A
+     * packet is a 64 bit sort key and the index of its world matrix.  From the
+     * top bits down, the key holds the model's texture, the model's id and its
+     * eye space depth, so draws sharing a texture and then a model end up together,
+     * and each model's draws go front to back.
+     *
+     * The list keeps its storage from frame to frame, so a steady scene renders
+     * without allocating.
+     */
+    class RenderList {
+    private:
+        /**
+         * One draw: its sort key and the index of its model and matrix
+         */
+        struct Packet {
+            uint64_t key;
+            uint32_t index;
+        };
+        
+        std::vector<Packet> packets;
+        /**
+         * The other buffer of the radix sort
+         */
+        std::vector<Packet> scratch;
+        /**
+         * The models and matrices, 16 floats each, in the order they were added
+         */
+        std::vector<const G3DModel*> models;
+        std::vector<float> matrices;
+        /**
+         * The sorted models and matrices handed to the provider
+         */
+        std::vector<const G3DModel*> sortedModels;
+        std::vector<const float*> sortedMatrices;
+        
+        /**
+         * Builds the sort key of a draw
+         *
+         * @param model the model to draw
+         * @param matrix the column major matrix it is drawn with
+         * @returns the key, whose low 24 bits order the draw by its signed
+         * eye space depth
+         */
+        static uint64_t MakeKey(const G3DModel* model, const float matrix[16]);
+        
+    public:
+        /**
+         * Removes all the packets, keeping the storage
+         */
+        void Clear();
+        /**
+         * Adds a draw to the list
+         *
+         * @param model the model to draw
+         * @param transform the transform to draw it with, taking it to eye coordinates
+         */
+        void Add(const G3DModel* model, const Transform3D& transform);
+        /**
+         * Sorts the packets by key with an LSD radix sort, skipping the passes over
+         * bytes that all keys share
+         */
+        void Sort();
+        /**
+         * Draws the packets in their current order with GraphicsProvider3D::DrawModels
+         *
+         * @param provider the provider to draw with
+         * @param stats has the draws and binds added to it
+         */
+        void Submit(const GraphicsProvider3D* provider, G3DDrawStats& stats);
+        /**
+         * @returns the number of packets in the list
+         */
+        size_t GetCount()const;
+    };
+    
+    /**
+     * The allocator ScenegraphNode::Create makes nodes with.  It is defined
+     * in Scenegraph3D.cp.
+     */
+    template<typename T> class NodePoolAllocator; // foward decl
+    
+    class SpatialIndex; // foward decl
     
     /**
      * This is for convenience and readbaility
@@ -213,7 +454,17 @@ namespace Scenegraph3D {
      * logic to concatenate transforms going down the draw tree.
      */
     class ScenegraphNode {
-        
+        // The Scenegraph starts the floating origin draw
+        // at the root node
+        friend class Scenegraph;
+        // The workers refresh world transforms and bounds ahead of the draw
+        friend class TransformWorkers;
+        // Create allocates nodes through the pool, which constructs them
+        template<typename T> friend class NodePoolAllocator;
+        // The index reads the bounds and keeps track of its entries
+        friend class SpatialIndex;
+        // A sprite marks its node when it changes
+        friend class Sprite3D;
         
     private:
         /**
@@ -231,6 +482,12 @@ namespace Scenegraph3D {
          * destroys all its current members.)
          */
         std::list<SharedNodePtr> children;
+        /**
+         * Where this node's handle is in its parent's children list, so that it
+         * can be removed or moved to another parent without searching the list.
+         * Only valid while parent is set.
+         */
+        std::list<SharedNodePtr>::iterator siblingPos;
         /**
          * This is a back pointer back up the tree to the node's parent.
          * it is primarily used from removing a node from the tree.
@@ -239,6 +496,167 @@ namespace Scenegraph3D {
          * with children in memory.
          */
         ScenegraphNode* parent=nullptr;//does not pin parent
+        /**
+         * The coarse offset of this node from its parent, in whole cells.
+         * It is only used by floating origin rendering, and is applied along
+         * the world axes regardless of any rotation of the parent.
+         */
+        WorldCell cell;
+        
+        /**
+         * This node's world transform, which is its parent's world transform
+         * times its sprite's transform, as of the last frame it was rendered in
+         */
+        Transform3D worldTransform;
+        /**
+         * Set when worldTransform must be recomputed even though neither the
+         * sprite nor the parent's world transform has changed, because the node
+         * has been given a new parent or none
+         */
+        bool worldDirty=true;
+        /**
+         * The bounding sphere of this node's model in world coordinates, as
+         * x, y, z and radius.  The radius is negative if the node has no model.
+         */
+        float modelBounds[4];
+        /**
+         * The model's bounds version that modelBounds was computed from
+         */
+        unsigned int modelBoundsVersion=0;
+        /**
+         * The bounding sphere of this node's model and those of all its
+         * descendants, in the same form as modelBounds
+         */
+        float subtreeBounds[4];
+        /**
+         * The number of nodes in the subtree rooted here, counting this one,
+         * and the number of them that have models
+         */
+        size_t subtreeNodes=1;
+        size_t subtreeModels=0;
+        /**
+         * Set when the bounds must be recomputed because the world transform
+         * changed, a child was added or removed, or the model's bounds were
+         * updated
+         */
+        bool boundsDirty=true;
+        /**
+         * Set when this node or one of its descendants has changed since the
+         * last RenderFrame.  Every ancestor of a node with it set has it set
+         * too, so RenderFrame only walks down into subtrees that have it.
+         */
+        bool visitPending=true;
+        /**
+         * Used by TransformWorkers to merge the bounds of the subtree once all
+         * of it has been refreshed.  These are the children still to finish,
+         * plus one for this node, and whether the bounds of any of them changed.
+         */
+        std::atomic<uint32_t> unfinishedChildren{0};
+        std::atomic<bool> childBoundsChanged{false};
+        /**
+         * The spatial index this node is a leaf of, or nullptr
+         */
+        SpatialIndex* spatialIndex=nullptr;
+        /**
+         * The node of spatialIndex that is this node's leaf
+         */
+        uint32_t spatialLeaf=0;
+        
+        /**
+         * Recomputes worldTransform if it is out of date
+         *
+         * @param parentWorld the parent's world transform
+         * @param parentChanged true if parentWorld has changed since this node's
+         * world transform was last computed
+         * @param recomputed incremented if the world transform is recomputed
+         * @returns true if the world transform was recomputed
+         */
+        bool RefreshWorldTransform(const Transform3D& parentWorld, const bool parentChanged,
+                                   size_t& recomputed);
+        
+        /**
+         * Recomputes modelBounds, subtreeBounds and subtreeNodes if the world
+         * transform or a child's bounds have changed
+         *
+         * @param childrenChanged true if the subtreeBounds of a child changed
+         * @returns true if subtreeBounds changed
+         */
+        bool RefreshOwnBounds(const bool childrenChanged);
+        
+        /**
+         * Sets visitPending on this node and its ancestors, stopping at the
+         * first ancestor that already has it
+         */
+        void MarkVisit();
+        
+        /**
+         * Marks each node of this subtree whose model has had UpdateBounds
+         * called since its modelBounds were computed, so the next RefreshBounds
+         * recomputes them
+         */
+        void MarkStaleModelBounds();
+        
+        /**
+         * Brings the world transforms and bounds of the node and its descendants up to date
+         *
+         * This is the first pass of Scenegraph::RenderFrame.  It only recomputes
+         * the world transforms of nodes whose sprites have changed or that are
+         * below a node whose world transform changed, and only recomputes the
+         * bounds of subtrees in which something moved, was added or was removed.
+         *
+         * @param parentWorld the parent's world transform
+         * @param parentChanged true if parentWorld has changed since the last frame
+         * @param recomputed incremented for each world transform recomputed
+         * @param index if not nullptr, the spatial index to place the nodes that
+         * have moved, or gained or lost a model, in
+         * @returns true if subtreeBounds changed
+         */
+        bool RefreshBounds(const Transform3D& parentWorld, const bool parentChanged,
+                           size_t& recomputed, SpatialIndex* index);
+        
+        /**
+         * Adds the node's model to a render list at its world transform
+         *
+         * This is how Scenegraph draws the nodes its spatial index finds in view.
+         */
+        void AddModel(RenderList& list)const;
+        
+        /**
+         * Adds the node and its children that are in view to a render list
+         *
+         * This is the second pass of Scenegraph::RenderFrame, after RefreshBounds.
+         * A subtree whose bounds are outside a frustum plane is skipped whole,
+         * and once a subtree is found to be wholly inside, its descendants are
+         * not tested again.
+         *
+         * @param list  the render list to add the draws to
+         * @param planes the frustum planes in world coordinates, or nullptr if
+         * the subtree is known to be in view
+         * @param stats counts the nodes drawn and culled
+         */
+        void Collect(RenderList& list, const float (*planes)[4], FrameStats& stats)const;
+        
+        /**
+         * Adds the node and all its children to a render list relative to a camera's cell
+         *
+         * This is the recursive traversal used by floating origin rendering.  The
+         * float transforms are the cached world transforms Collect uses, which
+         * RefreshBounds must have brought up to date, while the cell offsets are
+         * summed separately as integers.  Only the difference between a node's
+         * cell and the camera's is converted to float, just before listing.
+         * Subtree bounds are not kept in this form, so each node is culled
+         * on its own.
+         *
+         * @param list  the render list to add the draws to
+         * @param cameraTransform the view transform of the camera about its cell's origin
+         * @param parentCell the parent's cell minus the camera's cell
+         * @param cellSize the length of a cell's edge in world units
+         * @param planes the frustum planes in eye coordinates
+         * @param stats counts the nodes drawn and culled
+         */
+        void CollectRelative(RenderList& list, const Transform3D& cameraTransform,
+                             const WorldCell& parentCell, const float cellSize,
+                             const float planes[6][4], FrameStats& stats)const;
         
         /**
          * This is the constructor the static Scenegraphnode::Create
@@ -251,9 +669,22 @@ namespace Scenegraph3D {
          * a node has been created will *not* chnage the local transform of
          * the node's sprite.
          */
-        ScenegraphNode(Sprite3D sprite);
+        ScenegraphNode(const Sprite3D& sprite);
+        
+        /**
+         * This is the constructor the static Scenegraphnode::Create
+         * method uses to make nodes from a sprite the caller no longer needs
+         *
+         * @param sprite  the sprite object that the created node will take over
+         */
+        ScenegraphNode(Sprite3D&& sprite);
         
     public:
+        /**
+         * Takes the node out of any spatial index it is in
+         */
+        ~ScenegraphNode();
+        
         /**
          * The factory method to create ScenegraphNodes
          *
@@ -265,11 +696,29 @@ namespace Scenegraph3D {
          * a node has been created will *not* chnage the local transform of
          * the node's sprite.
          *
+         * Nodes and their reference counts are allocated together, from
+         * slabs shared by all nodes, so nodes created one after another sit
+         * next to each other in memory.  Build a subtree in one go to keep
+         * it together.  A slab goes back to the heap once all its nodes have
+         * been destroyed.
+         *
          * @param sprite The sprite 'template' to use to define this
          * scenegraph node.
          * @returns a handle that points to the created node
          */
-        static SharedNodePtr Create(Sprite3D sprite);
+        static SharedNodePtr Create(const Sprite3D& sprite);
+        
+        /**
+         * The factory method to create ScenegraphNodes from a temporary sprite
+         *
+         * This is just like the previous method except that the sprite's
+         * contents are moved into the node rather than copied, which saves
+         * a reference count increment and decrement on its model.
+         *
+         * @param sprite The sprite to move into the created node
+         * @returns a handle that points to the created node
+         */
+        static SharedNodePtr Create(Sprite3D&& sprite);
         /**
          * Returns a reference to the sprite within this scenegraph node
          *
@@ -285,9 +734,37 @@ namespace Scenegraph3D {
          * a child of another node automatically removes it from the children of its old
          * parent and re-writes its parent pointer.
          *
+         * This takes constant time, however many children either parent has.
+         *
          * @params node  the node to make a child of this one.
          */
-        void AddChild(SharedNodePtr node);
+        void AddChild(const SharedNodePtr& node);
+        /**
+         * Adds a number of nodes as children of this one
+         *
+         * This is the same as calling AddChild for each node in turn, and the nodes
+         * end up last among the children in the order given.
+         *
+         * @param nodes the nodes to make children of this one
+         * @param count the number of nodes
+         */
+        void AddChildren(const SharedNodePtr nodes[], const size_t count);
+        
+        /**
+         * Sets the coarse offset of this node from its parent
+         *
+         * @see WorldCell
+         *
+         * @param offset the offset in whole cells along the world axes
+         */
+        void SetCell(const WorldCell& offset);
+        /**
+         * returns the coarse offset of this node from its parent
+         *
+         * @returns the offset in whole cells along the world axes
+         */
+        const WorldCell& GetCell()const;
+        
         /**
          * Draws the node and all its chilsren
          *
@@ -302,14 +779,525 @@ namespace Scenegraph3D {
          * @param parentTransfrom the transformed world space to use as the context
          * for creating this node's transfromed world space.
          */
-        void Draw(const GraphicsProvider3D* provider, Transform3D parentTransform)const;
+        void Draw(const GraphicsProvider3D* provider, const Transform3D& parentTransform)const;
         
         /**
          * Removs a child node from this node's children list
          *
+         * This takes constant time.  Nodes that are not children of this node
+         * are left alone.
+         *
          * @param childNode the handle of the child to remove from our children
          */
-        void RemoveChild(const SharedNodePtr childNode);
+        void RemoveChild(const SharedNodePtr& childNode);
+        /**
+         * Removes a number of child nodes from this node's children list
+         *
+         * @param childNodes the handles of the children to remove
+         * @param count the number of handles
+         */
+        void RemoveChildren(const SharedNodePtr childNodes[], const size_t count);
+        /**
+         * Moves a number of nodes to a new parent, wherever they are now
+         *
+         * @param nodes the nodes to move
+         * @param count the number of nodes
+         * @param newParent the node to make their parent, or an empty handle to
+         * remove them from their parents
+         */
+        static void Reparent(const SharedNodePtr nodes[], const size_t count, const SharedNodePtr& newParent);
+    };
+    
+    class FlatScene; // forward decl
+    
+    /**
+     * A handle to a node in a FlatScene
+     *
+     * This plays the part for a FlatScene that SharedNodePtr plays for
+     * ScenegraphNodes.  Handles are reference counted.  A node stays in its
+     * scene while a handle refers to it or while it is the child of a node
+     * that stays, so removing a node from its parent destroys it, along with
+     * any of its descendants that have no handles of their own, once the
+     * last handle to it goes away.
+     *
+     * A handle refers to its scene by pointer, so the FlatScene must outlive
+     * every handle to its nodes.  A default constructed handle refers to no node.
+     */
+    class FlatNodePtr {
+        friend class FlatScene;
+        
+    private:
+        /**
+         * The scene the node is in, or nullptr for an empty handle
+         */
+        FlatScene* scene=nullptr;
+        /**
+         * The node's id in the scene.  Unlike its position in the scene's
+         * arrays, this never changes while the node exists.
+         */
+        uint32_t id=0;
+        
+        /**
+         * Used by FlatScene to make a new handle, which counts as a
+         * reference to the node
+         */
+        FlatNodePtr(FlatScene* scene, const uint32_t id);
+        
+    public:
+        FlatNodePtr();
+        FlatNodePtr(const FlatNodePtr& other);
+        FlatNodePtr(FlatNodePtr&& other);
+        FlatNodePtr& operator=(const FlatNodePtr& other);
+        FlatNodePtr& operator=(FlatNodePtr&& other);
+        ~FlatNodePtr();
+        
+        /**
+         * @returns true if this handle refers to a node
+         */
+        explicit operator bool()const;
+        bool operator==(const FlatNodePtr& other)const;
+        bool operator!=(const FlatNodePtr& other)const;
+        
+        /**
+         * Adds a node as the last child of this one
+         *
+         * As with ScenegraphNode::AddChild, a node that already has a parent is
+         * first removed from it.
+         *
+         * @param node the node to make a child of this one, which must be in the same scene
+         * and must not be this node or one of its ancestors
+         */
+        void AddChild(const FlatNodePtr& node)const;
+        
+        /**
+         * Removes a node from this node's children
+         *
+         * Nothing happens if the node is not a child of this one.
+         *
+         * @param node the child to remove
+         */
+        void RemoveChild(const FlatNodePtr& node)const;
+        
+        /**
+         * @returns a handle to this node's parent, or an empty handle if it has none
+         */
+        FlatNodePtr GetParent()const;
+        
+        /**
+         * Sets the transform of this node relative to its parent
+         *
+         * The node's world transform, and those of its descendants, pick up the
+         * change at the next FlatScene::Update.
+         *
+         * @param transform the new local transform
+         */
+        void SetLocalTransform(const Transform3D& transform)const;
+        /**
+         * @returns the transform of this node relative to its parent
+         */
+        const Transform3D& GetLocalTransform()const;
+        /**
+         * @returns the transform of this node relative to the root of its tree,
+         * as of the last FlatScene::Update
+         */
+        const Transform3D& GetWorldTransform()const;
+    };
+    
+    /**
+     * A scene store that keeps its nodes in flat arrays
+     *
+     * This is an alternative to a tree of ScenegraphNodes for very large scenes.
+     * Rather than being separate heap objects, the nodes are rows in a set of
+     * parallel arrays: local transforms, world transforms, parent indices,
+     * first child and next sibling indices, and models.  The rows are kept in
+     * depth first order, so every parent comes before its children and every
+     * subtree is one contiguous run of rows.  Update is then a single forward
+     * loop over the arrays, and Draw is a single loop over one run, with no
+     * pointer chasing.
+     *
+     * Changing the shape of the tree only relinks indices.  The rows are put
+     * back into depth first order, in one pass, by the next Update.
+     *
+     * Clients refer to nodes through FlatNodePtr handles.
+     */
+    class FlatScene {
+        friend class FlatNodePtr;
+        // The Scenegraph lists the draws of a tree to sort them
+        friend class Scenegraph;
+        
+    public:
+        /**
+         * The index used for a missing parent, child or sibling
+         */
+        static const uint32_t NoIndex = UINT32_MAX;
+        
+    private:
+        /**
+         * The per node arrays, indexed by the node's row
+         */
+        std::vector<Transform3D> locals;
+        std::vector<Transform3D> worlds;
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> firstChildren;
+        std::vector<uint32_t> nextSiblings;
+        std::vector<std::shared_ptr<G3DModel>> models;
+        /**
+         * The last child and the previous sibling of each node, so that adding
+         * or removing a child does not walk the existing ones
+         */
+        std::vector<uint32_t> lastChildren;
+        std::vector<uint32_t> prevSiblings;
+        /**
+         * One past the last row of each node's subtree.  Only valid while
+         * the rows are in order.
+         */
+        std::vector<uint32_t> subtreeEnds;
+        /**
+         * The id of the node in each row, or NoIndex for a destroyed node
+         * whose row has not been reclaimed yet
+         */
+        std::vector<uint32_t> ids;
+        
+        /**
+         * The row of each node, and the number of handles to it, indexed by id
+         */
+        std::vector<uint32_t> rows;
+        std::vector<uint32_t> refCounts;
+        /**
+         * Ids of destroyed nodes, for reuse
+         */
+        std::vector<uint32_t> freeIds;
+        
+        /**
+         * Set for each node whose world transform must be recomputed because
+         * its local transform or its parent has changed
+         */
+        std::vector<uint8_t> worldDirty;
+        /**
+         * The rows with worldDirty set, in no particular order
+         */
+        std::vector<uint32_t> dirtyRows;
+        
+        /**
+         * Set when the rows are no longer in depth first order
+         */
+        bool orderDirty=false;
+        
+        /**
+         * Marks a row's world transform, and so those of its descendants,
+         * as needing to be recomputed
+         */
+        void MarkDirty(const uint32_t row);
+        
+        /**
+         * Adds the models of a node and all its descendants to a render list
+         * at the world transforms computed by the last Update
+         *
+         * @param list the render list to add the draws to
+         * @param root the node to list along with its descendants
+         * @param stats counts the nodes drawn
+         */
+        void Collect(RenderList& list, const FlatNodePtr& root, FrameStats& stats)const;
+        
+        /**
+         * Handle reference counting
+         */
+        void Retain(const uint32_t id);
+        void Release(const uint32_t id);
+        
+        /**
+         * Links and unlinks a child row from its parent's list of children
+         */
+        void Link(const uint32_t parent, const uint32_t child);
+        void Unlink(const uint32_t child);
+        
+        /**
+         * Destroys the node in a row and those of its descendants that
+         * have no handles.  Descendants with handles are detached and
+         * become the roots of trees of their own.
+         */
+        void Destroy(const uint32_t row);
+        
+        /**
+         * Puts the rows back into depth first order, dropping the rows of
+         * destroyed nodes
+         */
+        void Reorder();
+        
+        // handles point to the scene, so it cannot be copied
+        FlatScene(const FlatScene&)=delete;
+        FlatScene& operator=(const FlatScene&)=delete;
+        
+    public:
+        FlatScene();
+        
+        /**
+         * Creates a node, as the root of a tree of its own
+         *
+         * The node's local transform is the sprite's current transform and it
+         * draws the sprite's model.  As with ScenegraphNode::Create, later
+         * changes to the sprite do not affect the node.
+         *
+         * @param sprite the sprite to take the transform and model from
+         * @returns a handle to the new node
+         */
+        FlatNodePtr Create(const Sprite3D& sprite);
+        
+        /**
+         * Recomputes the world transforms of the nodes that have changed
+         *
+         * This first restores depth first order if the shape of the tree has
+         * changed.  Then, for each node whose local transform was set or that
+         * was moved to a new parent since the last Update, it makes one forward
+         * pass over that node's subtree, multiplying each local transform by its
+         * parent's world transform.  A root's world transform is its local
+         * transform.  Runs of rows in which nothing changed are skipped.
+         */
+        void Update();
+        
+        /**
+         * Draws a node and all its descendants
+         *
+         * The nodes are drawn with the world transforms computed by the last
+         * Update, which must have been called since the shape of the tree last
+         * changed.
+         *
+         * @param provider the graphics provider that owns the window to draw within
+         * @param root the node to draw along with its descendants
+         */
+        void Draw(const GraphicsProvider3D* provider, const FlatNodePtr& root)const;
+        
+        /**
+         * @returns the number of nodes in the scene
+         */
+        size_t GetNodeCount()const;
+    };
+    
+    /**
+     * A dynamic bounding volume hierarchy over the nodes of a tree
+     *
+     * The index holds a box around the world bounds of every node that has a
+     * model, and answers ray, sphere and frustum queries without walking the
+     * scenegraph.  It is owned by a Scenegraph and kept up to date by its
+     * RenderFrame(root) calls; see Scenegraph::SetSpatialIndexEnabled.
+     *
+     * The hierarchy is first built top down with a binned surface area
+     * heuristic (SAH).  After that, moved nodes have their boxes refit in place,
+     * added nodes are inserted where they add the least area, and removed ones
+     * are unlinked.  A moved node that leaves the box ReinsertLevels above it
+     * is unlinked and inserted again, so that it joins the nodes it is now near.  Refitting lets boxes grow looser over time, so a subtree
+     * whose root's box grows past RebuildRatio times its area when built is
+     * rebuilt, leaving the rest of the hierarchy alone.  The highest such
+     * subtrees are rebuilt first, and an update rebuilds at most
+     * 1/RebuildShare of the leaves, so no frame pays for a full rebuild; a
+     * subtree too large for that is only rebuilt by Rebuild().  Wherever
+     * inserts take the hierarchy deeper than MaxDepth, the subtree is rebuilt
+     * to fit.
+     *
+     * Nodes that did not move are not visited in an update.  A destroyed node
+     * leaves the index at once.  A node that leaves the tree any other way is
+     * found by comparing the number of nodes with models in the tree with the
+     * number in the index.  Only when those differ does EndUpdate walk the tree.
+     *
+     * The nodes returned by queries are only valid until the tree is next changed.
+     */
+    class SpatialIndex {
+        friend class ScenegraphNode;
+        
+    public:
+        /**
+         * A subtree is rebuilt when the area of its root's box grows past this
+         * multiple of its area when it was built
+         */
+        static constexpr float RebuildRatio = 1.5f;
+        /**
+         * An update rebuilds at most this fraction of the leaves
+         */
+        static const unsigned int RebuildShare = 8;
+        /**
+         * A moved node is inserted again when it leaves the box this many
+         * levels above it
+         */
+        static const unsigned int ReinsertLevels = 3;
+        /**
+         * The greatest number of levels below the root, so that rays can be
+         * traced with a fixed size stack
+         */
+        static const unsigned int MaxDepth = 64;
+        
+        /**
+         * The nearest node a ray hits
+         */
+        struct RayHit {
+            /** The node hit, or nullptr if none was */
+            ScenegraphNode* node=nullptr;
+            /** The distance along the ray to the node's bounding sphere */
+            float distance=0;
+        };
+        
+        /**
+         * Counts of the work done by the last EndUpdate
+         */
+        struct UpdateStats {
+            size_t inserted=0;
+            size_t removed=0;
+            /** The number of nodes whose bounds moved */
+            size_t moved=0;
+            /** The number of moved nodes that were inserted again */
+            size_t reinserted=0;
+            /** The number of leaves in subtrees rebuilt with the SAH */
+            size_t rebuiltLeaves=0;
+        };
+        
+    private:
+        /**
+         * The index used for a missing node
+         */
+        static const uint32_t NoNode = UINT32_MAX;
+        
+        /**
+         * A node of the hierarchy.  Leaves have an item and no children, and
+         * free nodes have neither.
+         */
+        struct Node {
+            float lo[3];
+            float hi[3];
+            /** The summed surface areas of this node and the internal nodes under it */
+            float areaSum;
+            /** The area of the box when the node was built */
+            float builtArea;
+            uint32_t parent;
+            uint32_t left;
+            uint32_t right;
+            // these share a word to keep a node to 64 bytes
+            union {
+                /** For a leaf, the last search for nodes that have left the tree that found it */
+                uint32_t stamp;
+                /** For an internal node, the number of leaves under it */
+                uint32_t leaves;
+            };
+            /** Where this leaf is in added, or NoNode once it is linked in */
+            uint32_t addedSlot;
+            /** The number of levels below this node, at most 0xFFFF */
+            uint16_t height;
+            /** Set on the internal nodes above a change, until EndUpdate refits them */
+            bool dirty;
+            ScenegraphNode* item;
+        };
+        
+        /**
+         * A node with a model being sorted into place by Build
+         */
+        struct BuildItem;
+        
+        std::vector<Node> nodes;
+        std::vector<uint32_t> freeNodes;
+        uint32_t root=NoNode;
+        /** The number of leaves linked into the hierarchy */
+        size_t leafCount=0;
+        uint32_t stamp=0;
+        /** Leaves placed in the current update that are not linked in yet */
+        std::vector<uint32_t> added;
+        std::vector<uint32_t> moved;
+        UpdateStats stats;
+        
+        uint32_t AllocateNode();
+        void FreeNode(const uint32_t index);
+        void SetLeafBox(const uint32_t leaf);
+        void InsertLeaf(const uint32_t leaf);
+        void UnlinkLeaf(const uint32_t leaf);
+        void RemoveLeaf(const uint32_t leaf);
+        void MarkDirty(uint32_t index);
+        void RefitDirty(const uint32_t index);
+        void RefitUp(uint32_t index);
+        void RebuildDegraded(const uint32_t index, size_t& budget);
+        uint32_t Build(BuildItem* items, const size_t count,
+                       const float centerLo[3], const float centerHi[3], const unsigned int depth);
+        void Rebuild(const uint32_t index);
+        void RebuildDeepest();
+        void Dismantle(const uint32_t index, std::vector<BuildItem>& items);
+        void CollectItems(const uint32_t index, std::vector<ScenegraphNode*>& results)const;
+        void StampTree(const ScenegraphNode* node);
+        void RemoveDetached(const ScenegraphNode* root);
+        
+        /**
+         * Drops a node being destroyed
+         */
+        void Forget(ScenegraphNode* item);
+        
+    public:
+        SpatialIndex();
+        /**
+         * Clears the back pointers of the nodes still in the index
+         */
+        ~SpatialIndex();
+        
+        /**
+         * Starts an update.  Call Place for every node of the tree that has
+         * moved, gained or lost a model, or is not in the index yet, and then
+         * EndUpdate.
+         */
+        void BeginUpdate();
+        /**
+         * Enters a node in the index, moves it, or takes it out if it has no model
+         *
+         * @param node the node, whose bounds are up to date
+         * @param moved true if its bounds have changed since the last update
+         */
+        void Place(ScenegraphNode* node, const bool moved);
+        /**
+         * Finishes an update: removes the nodes that have left the tree, refits
+         * the boxes of those that moved, and rebuilds subtrees that have degraded
+         *
+         * @param root the root of the tree, whose bounds are up to date
+         */
+        void EndUpdate(const ScenegraphNode* root);
+        /**
+         * Rebuilds the whole hierarchy with the SAH
+         */
+        void Rebuild();
+        
+        /**
+         * Finds the nearest node whose bounding sphere a ray hits
+         *
+         * @param origin the start of the ray
+         * @param direction the direction of the ray, which need not be normalized;
+         * distances are in units of its length
+         * @param maxDistance how far along the ray to look
+         * @returns the nearest hit, whose node is nullptr if there was none
+         */
+        RayHit Raycast(const Vector3& origin, const Vector3& direction, const float maxDistance)const;
+        /**
+         * Finds the nodes whose bounding spheres overlap a sphere
+         *
+         * @param center the center of the sphere
+         * @param radius the radius of the sphere
+         * @param results has the nodes found added to it
+         * @returns the number of nodes found
+         */
+        size_t QuerySphere(const Vector3& center, const float radius, std::vector<ScenegraphNode*>& results)const;
+        /**
+         * Finds the nodes whose boxes are not wholly outside a set of planes
+         *
+         * @param planes six planes, as GraphicsProvider3D::GetFrustumPlanes returns
+         * @param results has the nodes found added to it
+         * @returns the number of nodes found
+         */
+        size_t QueryFrustum(const float planes[6][4], std::vector<ScenegraphNode*>& results)const;
+        
+        /**
+         * @returns the number of nodes in the index
+         */
+        size_t GetCount()const;
+        /**
+         * Returns the SAH cost of the hierarchy, the summed areas of its
+         * internal nodes over the area of its root.  Lower is better.
+         */
+        float GetCost()const;
+        /**
+         * @returns counts of the work done by the last EndUpdate
+         */
+        const UpdateStats& GetUpdateStats()const;
     };
     
     /**
@@ -327,6 +1315,13 @@ namespace Scenegraph3D {
      */
     typedef void (*Scenegraph3DKeyCB)(Scenegraph* scenegraphPointer, int key);
     
+    /**
+     * The thread pool that brings a tree's world transforms up to date
+     * before it is drawn.  It is only used by Scenegraph, and is defined
+     * along with it.
+     */
+    class TransformWorkers; // forward declaration
+    
     /**
      * This is the base class of the Scenegraph2D system.  Create an instacne of this
      * class in order to use the Scenegraph to render to the screen.
@@ -342,6 +1337,57 @@ namespace Scenegraph3D {
          */
         std::shared_ptr<GraphicsProvider3D> providerPtr;
         
+        /**
+         * The length of a WorldCell's edge in world units, used by
+         * floating origin rendering.
+         */
+        float cellSize=1024.0f;
+        
+        /**
+         * The root drawn by the last RenderFrame.  Cached world transforms
+         * are relative to it, so drawing from a different root recomputes them all.
+         */
+        mutable const ScenegraphNode* lastRoot=nullptr;
+        
+        /**
+         * G3DModel::GetBoundsUpdateCount as of the last RenderFrame.  When it
+         * has changed, the tree is checked for nodes whose models' bounds did.
+         */
+        mutable unsigned int lastBoundsUpdateCount=0;
+        
+        /**
+         * The work done by the last RenderFrame
+         */
+        mutable FrameStats frameStats;
+        
+        /**
+         * The threads that update world transforms for RenderFrame.  Like
+         * providerPtr, it is shared by all copies of the Scenegraph.
+         */
+        std::shared_ptr<TransformWorkers> workersPtr;
+        
+        /**
+         * The draws of the frame being rendered, kept to reuse its storage
+         */
+        mutable RenderList renderList;
+        
+        /**
+         * The spatial index of the tree drawn by RenderFrame, or nullptr
+         */
+        std::shared_ptr<SpatialIndex> indexPtr;
+        /**
+         * The nodes in view, when culling with the spatial index
+         */
+        mutable std::vector<ScenegraphNode*> visibleNodes;
+        
+        /**
+         * Marks the nodes under root whose models' bounds have been updated
+         * since the last RenderFrame, if any model's have
+         *
+         * @param root the root about to be drawn
+         * @param rootChanged true if root is not the one drawn last
+         */
+        void MarkStaleModelBounds(ScenegraphNode* root, const bool rootChanged)const;
         
     public:
         /**
@@ -352,13 +1398,13 @@ namespace Scenegraph3D {
          * @param windowWidth width of the window to create in pixels
          * @param windowHeight height of the window to create in pixels
          */
-        Scenegraph(std::string name, int windowWidth,int windowHeight);
+        Scenegraph(const std::string& name, int windowWidth,int windowHeight);
         
         /**
          * TODO
          **/
         Sprite3D MakeTexturedSphere(const float radius, const unsigned int rings,
-                                    const unsigned int sectors,const std::string texturePath)const;
+                                    const unsigned int sectors,const std::string& texturePath)const;
         /**
          * Sets the function to call in order to proccess key
          * events in the Scenegra[h's window.
@@ -375,9 +1421,128 @@ namespace Scenegraph3D {
          *  of the tree to the current offscreen video buffer.
          *  It then swaps the buffer onto the screen.
          *
+         *  Each node keeps its world transform from the previous frame, and only
+         *  recomputes it if its sprite has been changed, it has been added to or
+         *  removed from a parent, or an ancestor's world transform was recomputed.
+         *  This relies on the tree being drawn from the same root each frame;
+         *  drawing from a different root recomputes every node.
+         *
+         *  Nodes whose bounds are outside the view frustum are skipped, a whole
+         *  subtree at a time where possible.
+         *
+         *  The draws are gathered into a RenderList and sorted by texture, model
+         *  and depth before they are submitted, so the models are not drawn in
+         *  tree order.  GetFrameStats reports the binds this saved.
+         *
+         *  When the Scenegraph has more than one worker, the world transforms
+         *  and bounds are brought up to date on all the workers before the tree
+         *  is drawn.  Each node's world transform comes out the same either way.
+         *
+         *  If G3DModel::UpdateBounds has been called on any model since the last
+         *  frame, every node is checked, and those drawing a model whose bounds
+         *  were updated have their bounds refreshed.  Without that call, edited
+         *  vertices that move outside the old bounds may be culled.
+         *
+         *  The memory of destroyed nodes is kept for new nodes to reuse, and
+         *  each form of RenderFrame counts a frame towards giving it back: what
+         *  has not been reused after 120 frames goes back to the heap.
+         *
+         * @param root  the root of the scenegraph node tree to draw
+         */
+        void RenderFrame(const SharedNodePtr& root)const;
+        
+        /**
+         *  Draws the current state of a ScengraphNode graph relative to a camera
+         *
+         *  This is the floating origin form of RenderFrame.  Every node is drawn
+         *  relative to the origin of the camera's cell rather than the world origin,
+         *  so the float math only ever sees distances from the camera and objects
+         *  stay steady however far the scene extends.  Keep each node's float
+         *  translation within a few cells and use ScenegraphNode::SetCell for the rest.
+         *  World transforms and bounds are brought up to date just as for the
+         *  other form of RenderFrame, so the two forms can be mixed freely.
+         *
          * @param root  the root of the scenegraph node tree to draw
+         * @param cameraCell the cell the camera is in
+         * @param cameraTransform the view transform of the camera, taking
+         * coordinates relative to cameraCell's origin to eye coordinates
+         */
+        void RenderFrame(const SharedNodePtr& root, const WorldCell& cameraCell,
+                         const Transform3D& cameraTransform)const;
+        
+        /**
+         *  Draws the current state of a tree in a FlatScene
+         *
+         *  This updates the scene's world transforms and then lists the root
+         *  and its descendants in one pass over the scene's arrays.  The draws
+         *  are sorted like those of the other forms of RenderFrame, but the
+         *  scene keeps no bounds, so nothing is culled.
+         *
+         * @param scene the scene the root is in
+         * @param root  the root of the tree to draw
+         */
+        void RenderFrame(FlatScene& scene, const FlatNodePtr& root)const;
+        
+        /**
+         * Sets the size of the cells used by floating origin rendering
+         *
+         * @param size the length of a WorldCell's edge in world units
+         */
+        void SetCellSize(const float size);
+        /**
+         * returns the size of the cells used by floating origin rendering
+         *
+         * @returns the length of a WorldCell's edge in world units
+         */
+        float GetCellSize()const;
+        
+        /**
+         * returns counts of the work done by the last RenderFrame
+         *
+         * A FlatScene frame culls nothing and does not count the world
+         * transforms it recomputes.
+         *
+         * @returns the number of nodes drawn and culled, world transforms
+         * recomputed and GL state changes made and saved
+         */
+        const FrameStats& GetFrameStats()const;
+        
+        /**
+         * Sets the number of threads that update world transforms in RenderFrame
+         *
+         * The thread calling RenderFrame is one of them, and the others sleep
+         * between frames.  A Scenegraph starts with a single worker, which suits
+         * small or mostly static trees; large animated trees update faster
+         * with one worker per core.
+         *
+         * @param count the number of workers, or 0 for one per hardware thread
+         */
+        void SetWorkerCount(const unsigned int count);
+        
+        /**
+         * Turns the spatial index on or off
+         *
+         * While it is on, RenderFrame(root) keeps a SpatialIndex of the nodes of
+         * the tree it draws, and culls by querying it rather than by walking the
+         * tree.  FrameStats::nodesDrawn and nodesCulled then count only nodes
+         * with models.  Floating origin rendering updates the index too, but
+         * culls each node on its own rather than querying it.
+         *
+         * @param enabled true to keep an index, false to discard it
+         */
+        void SetSpatialIndexEnabled(const bool enabled);
+        /**
+         * returns the spatial index, for ray and proximity queries
+         *
+         * @returns the index as of the last RenderFrame, or nullptr if it is off
+         */
+        const SpatialIndex* GetSpatialIndex()const;
+        /**
+         * returns the number of threads that update world transforms
+         *
+         * @returns the number of workers, including the thread calling RenderFrame
          */
-        void RenderFrame(const SharedNodePtr root)const;
+        unsigned int GetWorkerCount()const;
     };
 }
 
@@ -0,0 +1,287 @@
+/* -*- C++ -*- ------------------------------------------------------------
+
+Copyright (c) 2007 Jesse Anders and Demian Nave http://cmldev.net/
+
+The Configurable Math Library (CML) is distributed under the terms of the
+Boost Software License, v1.0 (see cml/LICENSE for details).
+
+ *-----------------------------------------------------------------------*/
+/** @file
+ *  @brief A frame-scoped bump allocator for dynamic vectors and matrices.
+ *
+ * Dynamic arrays allocate on every resize and every temporary.  For
+ * per-frame scratch math, use arena_allocator<> as the dynamic<> allocator
+ * (e.g. vectorf_arena, matrixf_arena).  Each allocation then bumps a pointer
+ * in the calling thread's frame_arena(), and the arena is emptied once per
+ * frame with reset().
+ *
+ * @warning Arrays allocated from an arena must be destroyed before the
+ * arena is reset.  Never keep them beyond the frame.
+ */
+
+#ifndef core_arena_h
+#define core_arena_h
+
+#include <cstdlib>
+#include <new>
+#include <cml/core/common.h>
+
+namespace cml {
+
+/** Usage of an arena over one frame, as passed to the stats hook. */
+struct arena_stats
+{
+    /** Highest number of bytes in use at once since the last reset. */
+    size_t peak_bytes;
+
+    /** Bytes reserved by the arena's blocks. */
+    size_t capacity_bytes;
+
+    /** Number of allocations since the last reset. */
+    size_t allocations;
+};
+
+/** A bump allocator that is emptied all at once.
+ *
+ * Memory comes from large blocks.  allocate() rounds the top of the current
+ * block up to the alignment and bumps it.  deallocate() only gives memory
+ * back when it frees the most recent allocation, which covers the usual
+ * temporary-inside-an-expression pattern.  Everything else is released by
+ * reset().
+ *
+ * When a frame overflows the first block, reset() replaces all blocks with
+ * one block of the combined size, so a steady workload settles into a
+ * single block.
+ */
+class arena
+{
+  public:
+
+    /** Called by reset() with the frame's usage. */
+    typedef void (*stats_hook)(const arena_stats& stats, void* user_data);
+
+
+  public:
+
+    explicit arena(size_t block_size = 64*1024)
+        : m_block_size(block_size), m_first(0), m_current(0), m_top(0),
+          m_used(0), m_peak(0), m_allocations(0),
+          m_hook(0), m_hook_data(0) {}
+
+    ~arena() { release(); }
+
+    /** Return bytes of memory aligned to alignment (a power of 2). */
+    void* allocate(size_t bytes, size_t alignment) {
+        char* p = align(m_top, alignment);
+        if(!m_current || p + bytes > end(m_current)) {
+            p = next_block(bytes, alignment);
+        }
+        m_used += (p + bytes) - m_top;
+        m_top = p + bytes;
+        if(m_used > m_peak) m_peak = m_used;
+        ++ m_allocations;
+        return p;
+    }
+
+    /** Give back p if it is the most recent allocation. */
+    void deallocate(void* p, size_t bytes) {
+        char* c = static_cast<char*>(p);
+        if(m_current && c + bytes == m_top && c >= begin(m_current)) {
+            m_used -= bytes;
+            m_top = c;
+        }
+    }
+
+    /** Release every allocation, and report the frame to the stats hook. */
+    void reset() {
+        if(m_hook) {
+            arena_stats stats = { m_peak, capacity(), m_allocations };
+            m_hook(stats, m_hook_data);
+        }
+
+        /* Combine the blocks into one if the frame needed several: */
+        if(m_first && m_first->next) {
+            size_t total = capacity();
+            release();
+            m_first = new_block(total);
+        }
+
+        m_current = m_first;
+        m_top = m_first ? begin(m_first) : 0;
+        m_used = m_peak = m_allocations = 0;
+    }
+
+    /** Install a hook that reset() calls with the frame's usage. */
+    void set_stats_hook(stats_hook hook, void* user_data = 0) {
+        m_hook = hook;
+        m_hook_data = user_data;
+    }
+
+    /** Bytes in use, including alignment padding. */
+    size_t used() const { return m_used; }
+
+    /** Highest value of used() since the last reset. */
+    size_t peak() const { return m_peak; }
+
+    /** Bytes reserved by all blocks. */
+    size_t capacity() const {
+        size_t total = 0;
+        for(block* b = m_first; b; b = b->next) total += b->size;
+        return total;
+    }
+
+
+  private:
+
+    /** Block header; the block's memory follows it. */
+    struct block {
+        block* next;
+        size_t size;
+        double align_data;
+    };
+
+    static char* begin(block* b) {
+        return reinterpret_cast<char*>(&b->align_data);
+    }
+
+    static char* end(block* b) { return begin(b) + b->size; }
+
+    static char* align(char* p, size_t alignment) {
+        size_t a = reinterpret_cast<size_t>(p);
+        return reinterpret_cast<char*>((a + alignment-1) & ~(alignment-1));
+    }
+
+    static block* new_block(size_t size) {
+        void* memory = std::malloc(sizeof(block) + size);
+        if(!memory) throw std::bad_alloc();
+        block* b = static_cast<block*>(memory);
+        b->next = 0;
+        b->size = size;
+        return b;
+    }
+
+    /** Move to the next block that fits, adding one if needed. */
+    char* next_block(size_t bytes, size_t alignment) {
+        block* b = m_current ? m_current->next : m_first;
+        for(; b; b = b->next) {
+            char* p = align(begin(b), alignment);
+            if(p + bytes <= end(b)) break;
+        }
+        if(!b) {
+            size_t size = bytes + alignment;
+            if(size < m_block_size) size = m_block_size;
+            b = new_block(size);
+            if(m_current) {
+                b->next = m_current->next;
+                m_current->next = b;
+            } else {
+                m_first = b;
+            }
+        }
+
+        /* Count the rest of the old block as used until the next reset: */
+        if(m_current) m_used += end(m_current) - m_top;
+        m_current = b;
+        m_top = begin(b);
+        return align(m_top, alignment);
+    }
+
+    void release() {
+        while(m_first) {
+            block* next = m_first->next;
+            std::free(m_first);
+            m_first = next;
+        }
+        m_current = 0;
+        m_top = 0;
+    }
+
+    /* Not copyable: */
+    arena(const arena&);
+    arena& operator=(const arena&);
+
+
+  private:
+
+    size_t                      m_block_size;
+    block*                      m_first;
+    block*                      m_current;
+    char*                       m_top;
+    size_t                      m_used;
+    size_t                      m_peak;
+    size_t                      m_allocations;
+    stats_hook                  m_hook;
+    void*                       m_hook_data;
+};
+
+/** The calling thread's frame arena, used by arena_allocator<>. */
+inline arena& frame_arena()
+{
+    static thread_local arena frame;
+    return frame;
+}
+
+/** STL-compatible allocator that draws from frame_arena(). */
+template<typename T> class arena_allocator
+{
+  public:
+
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<typename U> struct rebind { typedef arena_allocator<U> other; };
+
+
+  public:
+
+    arena_allocator() {}
+    template<typename U> arena_allocator(const arena_allocator<U>&) {}
+
+    pointer allocate(size_type n, const void* = 0) {
+        return static_cast<pointer>(
+                frame_arena().allocate(n*sizeof(T), alignof(T)));
+    }
+
+    void deallocate(pointer p, size_type n) {
+        frame_arena().deallocate(p, n*sizeof(T));
+    }
+
+    void construct(pointer p, const T& value) { new((void*) p) T(value); }
+    void destroy(pointer p) { p->~T(); }
+
+    size_type max_size() const { return size_type(-1) / sizeof(T); }
+};
+
+/** Allocator for void, used as the dynamic<> parameter. */
+template<> class arena_allocator<void>
+{
+  public:
+
+    typedef void value_type;
+    typedef void* pointer;
+    typedef const void* const_pointer;
+
+    template<typename U> struct rebind { typedef arena_allocator<U> other; };
+};
+
+template<typename T, typename U> inline bool
+operator==(const arena_allocator<T>&, const arena_allocator<U>&) {
+    return true;
+}
+
+template<typename T, typename U> inline bool
+operator!=(const arena_allocator<T>&, const arena_allocator<U>&) {
+    return false;
+}
+
+} // namespace cml
+
+#endif
+
+// -------------------------------------------------------------------------
+// vim:ft=cpp
@@ -19,11 +19,36 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #include <cml/fixed.h>
 
 namespace cml {
+namespace detail {
+
+/** Storage policy for fixed_1D<>: a plain C array by default. */
+template<typename Element, int Size> struct fixed_1D_storage {
+    enum { padded_size = Size, alignment = alignof(Element) };
+    static void clear_padding(Element*) {}
+};
+
+#if defined(CML_ALIGNED_VECTOR_STORAGE)
+/** Float 3D and 4D arrays are 16-byte aligned, and a 3D array keeps a
+ * fourth lane that always holds 0.
+ */
+template<> struct fixed_1D_storage<float,3> {
+    enum { padded_size = 4, alignment = 16 };
+    static void clear_padding(float* data) { data[3] = 0.f; }
+};
+
+template<> struct fixed_1D_storage<float,4> {
+    enum { padded_size = 4, alignment = 16 };
+    static void clear_padding(float*) {}
+};
+#endif
+
+} // namespace detail
 
 /** Statically-allocated array.
  *
  * @note This class is designed to have the same size as a C array with the
- * same length.  It's therefore possible (but not recommended!) to coerce
+ * same length, unless CML_ALIGNED_VECTOR_STORAGE pads it (see
+ * detail::fixed_1D_storage).  It's therefore possible (but not recommended!) to coerce
  * a normal C array into a fixed_1D<> like this:
  *
  * typedef fixed_1D<double,10> array;
@@ -64,6 +89,9 @@ class fixed_1D
     /* Array implementation: */
     typedef value_type array_impl[Size];
 
+    /* Storage policy, which may pad and align the array: */
+    typedef detail::fixed_1D_storage<Element,Size> storage_policy;
+
     /* For matching by memory type: */
     typedef fixed_memory_tag memory_tag;
 
@@ -114,12 +142,13 @@ class fixed_1D
 
   protected:
 
-    fixed_1D() {}
+    fixed_1D() { storage_policy::clear_padding(m_data); }
 
 
   protected:
 
-    array_impl                  m_data;
+    alignas(storage_policy::alignment)
+        value_type              m_data[storage_policy::padded_size];
 };
 
 } // namespace cml
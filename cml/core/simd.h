@@ -0,0 +1,54 @@
+/* -*- C++ -*- ------------------------------------------------------------
+
+Copyright (c) 2007 Jesse Anders and Demian Nave http://cmldev.net/
+
+The Configurable Math Library (CML) is distributed under the terms of the
+Boost Software License, v1.0 (see cml/LICENSE for details).
+
+ *-----------------------------------------------------------------------*/
+/** @file
+ *  @brief Intrinsics and load/store helpers shared by the SIMD kernels.
+ */
+
+#ifndef core_simd_h
+#define core_simd_h
+
+#include <cml/core/common.h>
+
+#if defined(CML_SIMD)
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#else
+#include <xmmintrin.h>
+#endif
+
+namespace cml {
+namespace detail {
+
+/** Load 3 floats, with 0 in the last lane.
+ *
+ * This never reads past p[2], so it is safe on unpadded arrays.
+ */
+inline __m128 SimdLoad3(const float* p)
+{
+    return _mm_movelh_ps(
+        _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) p), _mm_load_ss(p+2));
+}
+
+/** Store the first three lanes of v. */
+inline void SimdStore3(float* p, __m128 v)
+{
+    _mm_storel_pi((__m64*) p, v);
+    _mm_store_ss(p+2, _mm_movehl_ps(v,v));
+}
+
+} // namespace detail
+} // namespace cml
+
+#endif // CML_SIMD
+
+#endif
+
+// -------------------------------------------------------------------------
+// vim:ft=cpp
@@ -34,9 +34,48 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #define CML_VECTOR_UNROLL_LIMIT 8
 #endif
 
-/* Don't unroll matrix operations by default: */
+/* Unroll fixed-size matrix operations by default.  Define
+ * CML_NO_2D_UNROLLER to use loops instead:
+ */
 #if !defined(CML_2D_UNROLLER) && !defined(CML_NO_2D_UNROLLER)
-#define CML_NO_2D_UNROLLER
+#define CML_2D_UNROLLER
+#endif
+
+/* The default matrix unroll limit, in elements (covers up to 4x4): */
+#if defined(CML_2D_UNROLLER) && !defined(CML_MATRIX_UNROLL_LIMIT)
+#define CML_MATRIX_UNROLL_LIMIT 16
+#endif
+
+/* Use SSE/AVX kernels when the target supports them: */
+#if !defined(CML_SIMD) && !defined(CML_NO_SIMD)
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CML_SIMD
+#endif
+#endif
+
+/* Use the SIMD kernels for fixed-size 3x3 and 4x4 float matrix products: */
+#if defined(CML_SIMD) && !defined(CML_SIMD_MATMUL) \
+    && !defined(CML_NO_SIMD_MATMUL)
+#define CML_SIMD_MATMUL
+#endif
+
+/* Fixed-size float 3D and 4D vectors are stored as plain arrays by default.
+ * Define CML_ALIGNED_VECTOR_STORAGE to store them 16-byte aligned and padded
+ * to four lanes, so dot(), cross(), normalize() and lerp() can use the SIMD
+ * kernels.  This makes a vector3f 16 bytes rather than 12.
+ */
+#if defined(CML_ALIGNED_VECTOR_STORAGE) && !defined(CML_SIMD)
+#error "CML_ALIGNED_VECTOR_STORAGE requires SSE support."
+#endif
+
+/* The rotation builders use polynomial float sines and cosines by default.
+ * Define CML_DEFAULT_SINCOS_POLICY as cml::libm_sincos to use std::sin()
+ * and std::cos(), or as cml::fast_sincos to trade accuracy for speed (see
+ * cml/mathlib/sincos.h):
+ */
+#if !defined(CML_DEFAULT_SINCOS_POLICY)
+#define CML_DEFAULT_SINCOS_POLICY cml::precise_sincos
 #endif
 
 /* The default vector dot() unroll limit: */
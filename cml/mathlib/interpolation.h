@@ -14,6 +14,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #define interpolation_h
 
 #include <cml/mathlib/matrix_rotation.h>
+#include <cml/vector/vector_simd.h>
 
 /* Interpolation functions.
  *
@@ -226,6 +227,35 @@ InterpResize(matrix<E,A,B,L>& m, const MatT& target, dynamic_size_tag) {
     m.resize(target.rows(),target.cols());
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Helper functions to compute a linear interpolation
+//////////////////////////////////////////////////////////////////////////////
+
+template < class ResultT, class T1, class T2, typename Scalar > void
+InterpLerp(ResultT& result, const T1& val0, const T2& val1, Scalar u,
+    false_type)
+{
+    result = (Scalar(1) - u) * val0 + u * val1;
+}
+
+#if defined(CML_ALIGNED_VECTOR_STORAGE)
+// Aligned, padded float vectors use the SIMD kernel...
+
+template < class ResultT, class T1, class T2 > void
+InterpLerp(ResultT& result, const T1& val0, const T2& val1, float u,
+    true_type)
+{
+    VectorSimdLerp(val0.data(), val1.data(), u, result.data());
+}
+
+template < class ResultT, class T1, class T2, typename Scalar > void
+InterpLerp(ResultT& result, const T1& val0, const T2& val1, Scalar u,
+    true_type)
+{
+    InterpLerp(result, val0, val1, u, false_type());
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////////
 // Construction of 'intermediate' quaternions and matrices for use with squad
 //////////////////////////////////////////////////////////////////////////////
@@ -988,8 +1018,9 @@ lerp(const T1& val0, const T2& val1, Scalar u)
 
     temporary_type result;
     detail::InterpResize(result, val1, size_tag());
-    
-    result = (Scalar(1) - u) * val0 + u * val1;
+
+    typedef typename et::VectorSimdTraits<T1,T2>::result simd_tag;
+    detail::InterpLerp(result, val0, val1, u, simd_tag());
     return result;
 }
 
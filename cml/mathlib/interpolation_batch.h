@@ -0,0 +1,514 @@
+/* -*- C++ -*- ------------------------------------------------------------
+
+Copyright (c) 2007 Jesse Anders and Demian Nave http://cmldev.net/
+
+The Configurable Math Library (CML) is distributed under the terms of the
+Boost Software License, v1.0 (see cml/LICENSE for details).
+
+ *-----------------------------------------------------------------------*/
+/** @file
+ *  @brief Batched nlerp(), slerp() and squad() for arrays of quaternions.
+ *
+ * Each function interpolates n quaternion pairs with a separate parameter
+ * per pair.  Arrays come in two forms:
+ *
+ * - AoS: an array of fixed-size float quaternions.
+ * - SoA: four float arrays, one per quaternion element, in the same order
+ *   as the quaternion's storage.
+ *
+ * The interpolations only use dot products and elementwise arithmetic, so
+ * they give the same result for either quaternion order.
+ *
+ * With SSE, four quaternions are interpolated at once.  AoS arrays are
+ * transposed into registers on the fly.  slerp_batch() and squad_batch()
+ * use polynomial acos() and sin() with absolute error below 1e-7, and
+ * expect t in [0,1].  Results agree with nlerp() and slerp() to within a
+ * few float ulps.
+ */
+
+#ifndef interpolation_batch_h
+#define interpolation_batch_h
+
+#include <cmath>
+#include <cml/core/simd.h>
+#include <cml/constants.h>
+#include <cml/mathlib/epsilon.h>
+#include <cml/quaternion.h>
+
+namespace cml {
+namespace detail {
+
+/** Interpolate lane by lane without SIMD. */
+struct BatchScalarOps
+{
+    static float dot(const float a[4], const float b[4]) {
+        return a[0]*b[0] + (a[1]*b[1] + (a[2]*b[2] + a[3]*b[3]));
+    }
+
+    static void nlerp(const float a[4], const float b[4], float t,
+            float out[4])
+    {
+        float sign = (dot(a,b) < 0.f) ? -1.f : 1.f;
+        for(int k = 0; k < 4; ++k) {
+            out[k] = (1.f - t)*a[k] + t*(sign*b[k]);
+        }
+        float length = std::sqrt(dot(out,out));
+        for(int k = 0; k < 4; ++k) {
+            out[k] /= length;
+        }
+    }
+
+    static void slerp(const float a[4], const float b[4], float t,
+            float tolerance, bool shortest, float out[4])
+    {
+        float b2[4] = { b[0], b[1], b[2], b[3] };
+        float c = dot(a,b2);
+        if(shortest && c < 0.f) {
+            for(int k = 0; k < 4; ++k) b2[k] = -b2[k];
+            c = -c;
+        }
+        float omega = acos_safe(c);
+        float s = std::sin(omega);
+        if(s < tolerance) {
+            for(int k = 0; k < 4; ++k) {
+                out[k] = (1.f - t)*a[k] + t*b2[k];
+            }
+            float length = std::sqrt(dot(out,out));
+            for(int k = 0; k < 4; ++k) {
+                out[k] /= length;
+            }
+        } else {
+            float wa = std::sin((1.f - t)*omega), wb = std::sin(t*omega);
+            for(int k = 0; k < 4; ++k) {
+                out[k] = (wa*a[k] + wb*b2[k]) / s;
+            }
+        }
+    }
+};
+
+#if defined(CML_SIMD)
+
+/** Four quaternions in SoA form, one register per element. */
+struct BatchQuat4 { __m128 e[4]; };
+
+/** Interpolate four quaternions at a time with SSE. */
+struct BatchSimdOps
+{
+    static __m128 select(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask,a), _mm_andnot_ps(mask,b));
+    }
+
+    static __m128 dot(const BatchQuat4& a, const BatchQuat4& b) {
+        __m128 tail = _mm_add_ps(
+            _mm_mul_ps(a.e[2],b.e[2]), _mm_mul_ps(a.e[3],b.e[3]));
+        tail = _mm_add_ps(_mm_mul_ps(a.e[1],b.e[1]), tail);
+        return _mm_add_ps(_mm_mul_ps(a.e[0],b.e[0]), tail);
+    }
+
+    /** acos() of x in [-1,1] (Abramowitz and Stegun 4.4.46). */
+    static __m128 acos(__m128 x) {
+        const __m128 one = _mm_set1_ps(1.f);
+        __m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+        __m128 ax = _mm_min_ps(
+                _mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(),x)), one);
+        __m128 p = _mm_set1_ps(-0.0012624911f);
+        p = _mm_add_ps(_mm_mul_ps(p,ax), _mm_set1_ps( 0.0066700901f));
+        p = _mm_add_ps(_mm_mul_ps(p,ax), _mm_set1_ps(-0.0170881256f));
+        p = _mm_add_ps(_mm_mul_ps(p,ax), _mm_set1_ps( 0.0308918810f));
+        p = _mm_add_ps(_mm_mul_ps(p,ax), _mm_set1_ps(-0.0501743046f));
+        p = _mm_add_ps(_mm_mul_ps(p,ax), _mm_set1_ps( 0.0889789874f));
+        p = _mm_add_ps(_mm_mul_ps(p,ax), _mm_set1_ps(-0.2145988016f));
+        p = _mm_add_ps(_mm_mul_ps(p,ax), _mm_set1_ps( 1.5707963050f));
+        p = _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(one,ax)));
+        return select(negative,
+                _mm_sub_ps(_mm_set1_ps(float(constants<double>::pi())),p), p);
+    }
+
+    /** sin() of x in [0,pi], folded onto [0,pi/2]. */
+    static __m128 sin(__m128 x) {
+        x = _mm_min_ps(x,
+                _mm_sub_ps(_mm_set1_ps(float(constants<double>::pi())),x));
+        __m128 x2 = _mm_mul_ps(x,x);
+        __m128 p = _mm_set1_ps(-1.f/39916800.f);
+        p = _mm_add_ps(_mm_mul_ps(p,x2), _mm_set1_ps( 1.f/362880.f));
+        p = _mm_add_ps(_mm_mul_ps(p,x2), _mm_set1_ps(-1.f/5040.f));
+        p = _mm_add_ps(_mm_mul_ps(p,x2), _mm_set1_ps( 1.f/120.f));
+        p = _mm_add_ps(_mm_mul_ps(p,x2), _mm_set1_ps(-1.f/6.f));
+        p = _mm_add_ps(_mm_mul_ps(p,x2), _mm_set1_ps(1.f));
+        return _mm_mul_ps(p,x);
+    }
+
+    /** out = normalize((1-t)*a + t*b). */
+    static void lerp_normalize(const BatchQuat4& a, const BatchQuat4& b,
+            __m128 t, BatchQuat4& out)
+    {
+        __m128 wa = _mm_sub_ps(_mm_set1_ps(1.f), t);
+        for(int k = 0; k < 4; ++k) {
+            out.e[k] = _mm_add_ps(
+                    _mm_mul_ps(wa,a.e[k]), _mm_mul_ps(t,b.e[k]));
+        }
+        __m128 length = _mm_sqrt_ps(dot(out,out));
+        for(int k = 0; k < 4; ++k) {
+            out.e[k] = _mm_div_ps(out.e[k], length);
+        }
+    }
+
+    /** Negate the lanes of q where mask has its sign bit set. */
+    static void flip(BatchQuat4& q, __m128 sign) {
+        for(int k = 0; k < 4; ++k) {
+            q.e[k] = _mm_xor_ps(q.e[k], sign);
+        }
+    }
+
+    static void nlerp(const BatchQuat4& a, const BatchQuat4& b, __m128 t,
+            BatchQuat4& out)
+    {
+        BatchQuat4 b2 = b;
+        flip(b2, _mm_and_ps(dot(a,b), _mm_set1_ps(-0.f)));
+        lerp_normalize(a, b2, t, out);
+    }
+
+    static void slerp(const BatchQuat4& a, const BatchQuat4& b, __m128 t,
+            __m128 tolerance, bool shortest, BatchQuat4& out)
+    {
+        BatchQuat4 b2 = b;
+        __m128 c = dot(a,b);
+        if(shortest) {
+            __m128 sign = _mm_and_ps(c, _mm_set1_ps(-0.f));
+            flip(b2, sign);
+            c = _mm_xor_ps(c, sign);
+        }
+        __m128 omega = acos(c);
+        __m128 s = sin(omega);
+        __m128 wa = _mm_div_ps(
+                sin(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.f),t),omega)), s);
+        __m128 wb = _mm_div_ps(sin(_mm_mul_ps(t,omega)), s);
+
+        /* Nearly parallel lanes fall back to a normalized lerp: */
+        BatchQuat4 linear;
+        lerp_normalize(a, b2, t, linear);
+        __m128 near = _mm_cmplt_ps(s, tolerance);
+        for(int k = 0; k < 4; ++k) {
+            __m128 v = _mm_add_ps(
+                    _mm_mul_ps(wa,a.e[k]), _mm_mul_ps(wb,b2.e[k]));
+            out.e[k] = select(near, linear.e[k], v);
+        }
+    }
+
+    /** Load count (1-4) AoS quaternions, padding with a unit quaternion. */
+    static void load_aos(const float* q, size_t count, BatchQuat4& out) {
+        __m128 r[4];
+        for(size_t i = 0; i < 4; ++i) {
+            r[i] = (i < count) ? _mm_loadu_ps(q+4*i)
+                : _mm_setr_ps(1.f, 0.f, 0.f, 0.f);
+        }
+        _MM_TRANSPOSE4_PS(r[0],r[1],r[2],r[3]);
+        for(int k = 0; k < 4; ++k) out.e[k] = r[k];
+    }
+
+    static void store_aos(float* q, size_t count, const BatchQuat4& in) {
+        __m128 r[4] = { in.e[0], in.e[1], in.e[2], in.e[3] };
+        _MM_TRANSPOSE4_PS(r[0],r[1],r[2],r[3]);
+        for(size_t i = 0; i < count; ++i) _mm_storeu_ps(q+4*i, r[i]);
+    }
+
+    /** Load count (1-4) SoA quaternions starting at index i. */
+    static void load_soa(const float* const q[4], size_t i, size_t count,
+            BatchQuat4& out)
+    {
+        for(int k = 0; k < 4; ++k) {
+            if(count == 4) {
+                out.e[k] = _mm_loadu_ps(q[k]+i);
+            } else {
+                float lanes[4];
+                for(size_t j = 0; j < 4; ++j) {
+                    lanes[j] = (j < count) ? q[k][i+j] : (k == 0 ? 1.f : 0.f);
+                }
+                out.e[k] = _mm_loadu_ps(lanes);
+            }
+        }
+    }
+
+    static void store_soa(float* const q[4], size_t i, size_t count,
+            const BatchQuat4& in)
+    {
+        for(int k = 0; k < 4; ++k) {
+            if(count == 4) {
+                _mm_storeu_ps(q[k]+i, in.e[k]);
+            } else {
+                float lanes[4];
+                _mm_storeu_ps(lanes, in.e[k]);
+                for(size_t j = 0; j < count; ++j) q[k][i+j] = lanes[j];
+            }
+        }
+    }
+
+    static __m128 load_t(const float* t, size_t i, size_t count) {
+        if(count == 4) return _mm_loadu_ps(t+i);
+        float lanes[4] = { 0.f, 0.f, 0.f, 0.f };
+        for(size_t j = 0; j < count; ++j) lanes[j] = t[i+j];
+        return _mm_loadu_ps(lanes);
+    }
+};
+
+#endif // CML_SIMD
+
+/* The kernels below take N input quaternions per pair and write one. */
+
+/** nlerp(q[0], q[1], t). */
+struct BatchNlerp
+{
+    enum { N = 2 };
+
+    void operator()(const float* const q[2], float t, float out[4]) const {
+        BatchScalarOps::nlerp(q[0], q[1], t, out);
+    }
+#if defined(CML_SIMD)
+    void operator()(const BatchQuat4 q[2], __m128 t, BatchQuat4& out) const {
+        BatchSimdOps::nlerp(q[0], q[1], t, out);
+    }
+#endif
+};
+
+/** slerp(q[0], q[1], t) along the shortest arc. */
+struct BatchSlerp
+{
+    enum { N = 2 };
+    float tolerance;
+
+    void operator()(const float* const q[2], float t, float out[4]) const {
+        BatchScalarOps::slerp(q[0], q[1], t, tolerance, true, out);
+    }
+#if defined(CML_SIMD)
+    void operator()(const BatchQuat4 q[2], __m128 t, BatchQuat4& out) const {
+        BatchSimdOps::slerp(q[0], q[1], t, _mm_set1_ps(tolerance), true, out);
+    }
+#endif
+};
+
+/** squad(q[0], q[1], q[2], q[3], t).
+ *
+ * The end points q[0] and q[3] are interpolated along the shortest arc.
+ * The intermediates and the outer blend are not, since flipping them makes
+ * the curve jump between segments (see the notes on squad() in
+ * interpolation.h).
+ */
+struct BatchSquad
+{
+    enum { N = 4 };
+    float tolerance;
+
+    void operator()(const float* const q[4], float t, float out[4]) const {
+        float ends[4], mids[4];
+        BatchScalarOps::slerp(q[0], q[3], t, tolerance, true, ends);
+        BatchScalarOps::slerp(q[1], q[2], t, tolerance, false, mids);
+        BatchScalarOps::slerp(
+                ends, mids, 2.f*t*(1.f - t), tolerance, false, out);
+    }
+#if defined(CML_SIMD)
+    void operator()(const BatchQuat4 q[4], __m128 t, BatchQuat4& out) const {
+        __m128 tol = _mm_set1_ps(tolerance);
+        BatchQuat4 ends, mids;
+        BatchSimdOps::slerp(q[0], q[3], t, tol, true, ends);
+        BatchSimdOps::slerp(q[1], q[2], t, tol, false, mids);
+        __m128 h = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.f),t),
+                _mm_sub_ps(_mm_set1_ps(1.f),t));
+        BatchSimdOps::slerp(ends, mids, h, tol, false, out);
+    }
+#endif
+};
+
+/** Run a kernel over n AoS quaternion tuples. */
+template<class KernelT> void
+InterpolateBatchAoS(const KernelT& kernel, const float* const q[],
+        const float* t, float* out, size_t n)
+{
+    enum { N = KernelT::N };
+#if defined(CML_SIMD)
+    for(size_t i = 0; i < n; i += 4) {
+        size_t count = (n - i < 4) ? n - i : 4;
+        BatchQuat4 in[N], result;
+        for(int k = 0; k < N; ++k) {
+            BatchSimdOps::load_aos(q[k] + 4*i, count, in[k]);
+        }
+        kernel(in, BatchSimdOps::load_t(t, i, count), result);
+        BatchSimdOps::store_aos(out + 4*i, count, result);
+    }
+#else
+    for(size_t i = 0; i < n; ++i) {
+        const float* in[N];
+        for(int k = 0; k < N; ++k) in[k] = q[k] + 4*i;
+        kernel(in, t[i], out + 4*i);
+    }
+#endif
+}
+
+/** Run a kernel over n SoA quaternion tuples. */
+template<class KernelT> void
+InterpolateBatchSoA(const KernelT& kernel, const float* const* const q[],
+        const float* t, float* const out[4], size_t n)
+{
+    enum { N = KernelT::N };
+#if defined(CML_SIMD)
+    for(size_t i = 0; i < n; i += 4) {
+        size_t count = (n - i < 4) ? n - i : 4;
+        BatchQuat4 in[N], result;
+        for(int k = 0; k < N; ++k) {
+            BatchSimdOps::load_soa(q[k], i, count, in[k]);
+        }
+        kernel(in, BatchSimdOps::load_t(t, i, count), result);
+        BatchSimdOps::store_soa(out, i, count, result);
+    }
+#else
+    for(size_t i = 0; i < n; ++i) {
+        float lanes[N][4], result[4];
+        const float* in[N];
+        for(int k = 0; k < N; ++k) {
+            for(int e = 0; e < 4; ++e) lanes[k][e] = q[k][e][i];
+            in[k] = lanes[k];
+        }
+        kernel(in, t[i], result);
+        for(int e = 0; e < 4; ++e) out[e][i] = result[e];
+    }
+#endif
+}
+
+/** Return the elements of an AoS quaternion array as floats.
+ *
+ * @note q must point to at least one quaternion.
+ */
+template<class OrderT, class CrossT> inline const float*
+BatchData(const quaternion<float,fixed<>,OrderT,CrossT>* q)
+{
+    /* The array must be densely packed 4-float quaternions: */
+    static_assert(sizeof(quaternion<float,fixed<>,OrderT,CrossT>) == 4*sizeof(float),
+            "batch interpolation needs densely packed 4-float quaternions");
+    return q[0].as_vector().data();
+}
+
+template<class OrderT, class CrossT> inline float*
+BatchData(quaternion<float,fixed<>,OrderT,CrossT>* q)
+{
+    return const_cast<float*>(
+            BatchData((const quaternion<float,fixed<>,OrderT,CrossT>*) q));
+}
+
+} // namespace detail
+
+//////////////////////////////////////////////////////////////////////////////
+// Batched interpolation of quaternion arrays (AoS)
+//////////////////////////////////////////////////////////////////////////////
+
+/** Set out[i] = nlerp(q1[i], q2[i], t[i]) for i in [0,n). */
+template<class OrderT, class CrossT> void
+nlerp_batch(
+    const quaternion<float,fixed<>,OrderT,CrossT>* q1,
+    const quaternion<float,fixed<>,OrderT,CrossT>* q2,
+    const float* t,
+    quaternion<float,fixed<>,OrderT,CrossT>* out,
+    size_t n)
+{
+    /* The arrays may be null when empty: */
+    if(n == 0) return;
+    const float* q[2] = { detail::BatchData(q1), detail::BatchData(q2) };
+    detail::BatchNlerp kernel;
+    detail::InterpolateBatchAoS(kernel, q, t, detail::BatchData(out), n);
+}
+
+/** Set out[i] = slerp(q1[i], q2[i], t[i]) for i in [0,n). */
+template<class OrderT, class CrossT> void
+slerp_batch(
+    const quaternion<float,fixed<>,OrderT,CrossT>* q1,
+    const quaternion<float,fixed<>,OrderT,CrossT>* q2,
+    const float* t,
+    quaternion<float,fixed<>,OrderT,CrossT>* out,
+    size_t n,
+    float tolerance = epsilon<float>::placeholder())
+{
+    if(n == 0) return;
+    const float* q[2] = { detail::BatchData(q1), detail::BatchData(q2) };
+    detail::BatchSlerp kernel = { tolerance };
+    detail::InterpolateBatchAoS(kernel, q, t, detail::BatchData(out), n);
+}
+
+/** Set out[i] = squad(q1[i], q1_intermediate[i], q2_intermediate[i], q2[i],
+ * t[i]) for i in [0,n).
+ */
+template<class OrderT, class CrossT> void
+squad_batch(
+    const quaternion<float,fixed<>,OrderT,CrossT>* q1,
+    const quaternion<float,fixed<>,OrderT,CrossT>* q1_intermediate,
+    const quaternion<float,fixed<>,OrderT,CrossT>* q2_intermediate,
+    const quaternion<float,fixed<>,OrderT,CrossT>* q2,
+    const float* t,
+    quaternion<float,fixed<>,OrderT,CrossT>* out,
+    size_t n,
+    float tolerance = epsilon<float>::placeholder())
+{
+    if(n == 0) return;
+    const float* q[4] = {
+        detail::BatchData(q1), detail::BatchData(q1_intermediate),
+        detail::BatchData(q2_intermediate), detail::BatchData(q2)
+    };
+    detail::BatchSquad kernel = { tolerance };
+    detail::InterpolateBatchAoS(kernel, q, t, detail::BatchData(out), n);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Batched interpolation of quaternion arrays (SoA)
+//////////////////////////////////////////////////////////////////////////////
+
+/** nlerp_batch() over quaternions stored as four element arrays. */
+inline void
+nlerp_batch(
+    const float* const q1[4],
+    const float* const q2[4],
+    const float* t,
+    float* const out[4],
+    size_t n)
+{
+    const float* const* q[2] = { q1, q2 };
+    detail::BatchNlerp kernel;
+    detail::InterpolateBatchSoA(kernel, q, t, out, n);
+}
+
+/** slerp_batch() over quaternions stored as four element arrays. */
+inline void
+slerp_batch(
+    const float* const q1[4],
+    const float* const q2[4],
+    const float* t,
+    float* const out[4],
+    size_t n,
+    float tolerance = epsilon<float>::placeholder())
+{
+    const float* const* q[2] = { q1, q2 };
+    detail::BatchSlerp kernel = { tolerance };
+    detail::InterpolateBatchSoA(kernel, q, t, out, n);
+}
+
+/** squad_batch() over quaternions stored as four element arrays. */
+inline void
+squad_batch(
+    const float* const q1[4],
+    const float* const q1_intermediate[4],
+    const float* const q2_intermediate[4],
+    const float* const q2[4],
+    const float* t,
+    float* const out[4],
+    size_t n,
+    float tolerance = epsilon<float>::placeholder())
+{
+    const float* const* q[4] = {
+        q1, q1_intermediate, q2_intermediate, q2
+    };
+    detail::BatchSquad kernel = { tolerance };
+    detail::InterpolateBatchSoA(kernel, q, t, out, n);
+}
+
+} // namespace cml
+
+#endif
+
+// -------------------------------------------------------------------------
+// vim:ft=cpp
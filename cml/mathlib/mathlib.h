@@ -15,6 +15,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 
 #include <cml/mathlib/typedef.h>
 #include <cml/mathlib/epsilon.h>
+#include <cml/mathlib/sincos.h>
 #include <cml/mathlib/vector_angle.h>
 #include <cml/mathlib/vector_ortho.h>
 #include <cml/mathlib/vector_transform.h>
@@ -26,6 +27,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #include <cml/mathlib/quaternion_rotation.h>
 #include <cml/mathlib/coord_conversion.h>
 #include <cml/mathlib/interpolation.h>
+#include <cml/mathlib/interpolation_batch.h>
 #include <cml/mathlib/frustum.h>
 #include <cml/mathlib/projection.h>
 #include <cml/mathlib/picking.h>
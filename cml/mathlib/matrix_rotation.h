@@ -15,6 +15,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 
 #include <cml/mathlib/matrix_misc.h>
 #include <cml/mathlib/vector_ortho.h>
+#include <cml/mathlib/sincos.h>
 
 /* Functions related to matrix rotations in 3D and 2D. */
 
@@ -38,8 +39,8 @@ matrix_rotation_world_axis( matrix<E,A,B,L>& m, size_t axis, E angle)
     size_t i, j, k;
     cyclic_permutation(axis, i, j, k);
     
-    value_type s = value_type(std::sin(angle));
-    value_type c = value_type(std::cos(angle));
+    value_type s, c;
+    sincos(value_type(angle), s, c);
     
     identity_transform(m);
 
@@ -84,8 +85,8 @@ matrix_rotation_axis_angle(matrix<E,A,B,L>& m, const VecT& axis, E angle)
     
     identity_transform(m);
 
-    value_type s = std::sin(angle);
-    value_type c = std::cos(angle);
+    value_type s, c;
+    sincos(value_type(angle), s, c);
     value_type omc = value_type(1) - c;
 
     value_type xomc = axis[0] * omc;
@@ -213,12 +214,11 @@ matrix_rotation_euler(matrix<E,A,B,L>& m, E angle_0, E angle_1, E angle_2,
         angle_2 = -angle_2;
     }
     
-    value_type s0 = std::sin(angle_0);
-    value_type c0 = std::cos(angle_0);
-    value_type s1 = std::sin(angle_1);
-    value_type c1 = std::cos(angle_1);
-    value_type s2 = std::sin(angle_2);
-    value_type c2 = std::cos(angle_2);
+    value_type angles[3] = { angle_0, angle_1, angle_2 }, s[3], c[3];
+    sincos_batch(angles, s, c, 3);
+
+    value_type s0 = s[0], s1 = s[1], s2 = s[2];
+    value_type c0 = c[0], c1 = c[1], c2 = c[2];
     
     value_type s0s2 = s0 * s2;
     value_type s0c2 = s0 * c2;
@@ -293,12 +293,11 @@ matrix_rotation_euler_derivatives(
         angle_2 = -angle_2;
     }
 
-    value_type s0 = std::sin(angle_0);
-    value_type c0 = std::cos(angle_0);
-    value_type s1 = std::sin(angle_1);
-    value_type c1 = std::cos(angle_1);
-    value_type s2 = std::sin(angle_2);
-    value_type c2 = std::cos(angle_2);
+    value_type angles[3] = { angle_0, angle_1, angle_2 }, s[3], c[3];
+    sincos_batch(angles, s, c, 3);
+
+    value_type s0 = s[0], s1 = s[1], s2 = s[2];
+    value_type c0 = c[0], c1 = c[1], c2 = c[2];
     
     value_type s0s2 = s0 * s2;
     value_type s0c2 = s0 * c2;
@@ -488,8 +487,8 @@ matrix_rotation_2D( matrix<E,A,B,L>& m, E angle)
     /* Checking */
     detail::CheckMatLinear2D(m);
 
-    value_type s = value_type(std::sin(angle));
-    value_type c = value_type(std::cos(angle));
+    value_type s, c;
+    sincos(value_type(angle), s, c);
     
     identity_transform(m);
 
@@ -536,8 +535,8 @@ matrix_rotate_about_world_axis(matrix<E,A,B,L>& m, size_t axis, E angle)
     size_t i, j, k;
     cyclic_permutation(axis, i, j, k);
 
-    value_type s = value_type(std::sin(angle));
-    value_type c = value_type(std::cos(angle));
+    value_type s, c;
+    sincos(value_type(angle), s, c);
 
     value_type ij = c * m.basis_element(i,j) - s * m.basis_element(i,k);
     value_type jj = c * m.basis_element(j,j) - s * m.basis_element(j,k);
@@ -588,8 +587,8 @@ matrix_rotate_about_local_axis(matrix<E,A,B,L>& m, size_t axis, E angle)
     size_t i, j, k;
     cyclic_permutation(axis, i, j, k);
 
-    value_type s = value_type(std::sin(angle));
-    value_type c = value_type(std::cos(angle));
+    value_type s, c;
+    sincos(value_type(angle), s, c);
 
     value_type j0 = c * m.basis_element(j,0) + s * m.basis_element(k,0);
     value_type j1 = c * m.basis_element(j,1) + s * m.basis_element(k,1);
@@ -635,8 +634,8 @@ matrix_rotate_2D(matrix<E,A,B,L>& m, E angle)
     /* Checking */
     detail::CheckMatLinear2D(m);
 
-    value_type s = value_type(std::sin(angle));
-    value_type c = value_type(std::cos(angle));
+    value_type s, c;
+    sincos(value_type(angle), s, c);
 
     value_type m00 = c * m.basis_element(0,0) - s * m.basis_element(0,1);
     value_type m10 = c * m.basis_element(1,0) - s * m.basis_element(1,1);
@@ -14,6 +14,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #define quaternion_rotation_h
 
 #include <cml/mathlib/checking.h>
+#include <cml/mathlib/sincos.h>
 
 /* Functions related to quaternion rotations.
  *
@@ -49,8 +50,10 @@ quaternion_rotation_world_axis(quaternion<E,A,O,C>& q, size_t axis, E angle)
     const size_t I = order_type::X + axis;
     
     angle *= value_type(.5);
-    q[I] = std::sin(angle);
-    q[W] = std::cos(angle);
+    value_type s, c;
+    sincos(value_type(angle), s, c);
+    q[I] = s;
+    q[W] = c;
 }
 
 /** Build a quaternion representing a rotation about the world x axis */
@@ -104,8 +107,9 @@ quaternion_rotation_axis_angle(
      * In which case the enum will also not be necessary.
      */
     
-    q[W] = std::cos(angle);
-    value_type s = std::sin(angle);
+    value_type s, c;
+    sincos(value_type(angle), s, c);
+    q[W] = c;
     q[X] = axis[0] * s;
     q[Y] = axis[1] * s;
     q[Z] = axis[2] * s;
@@ -197,12 +201,11 @@ quaternion_rotation_euler(
     angle_1 *= value_type(.5);
     angle_2 *= value_type(.5);
     
-    value_type s0 = std::sin(angle_0);
-    value_type c0 = std::cos(angle_0);
-    value_type s1 = std::sin(angle_1);
-    value_type c1 = std::cos(angle_1);
-    value_type s2 = std::sin(angle_2);
-    value_type c2 = std::cos(angle_2);
+    value_type angles[3] = { angle_0, angle_1, angle_2 }, s[3], c[3];
+    sincos_batch(angles, s, c, 3);
+
+    value_type s0 = s[0], s1 = s[1], s2 = s[2];
+    value_type c0 = c[0], c1 = c[1], c2 = c[2];
     
     value_type s0s2 = s0 * s2;
     value_type s0c2 = s0 * c2;
@@ -391,8 +394,8 @@ quaternion_rotate_about_world_axis(quaternion<E,A,O,C>& q,size_t axis,E angle)
     const size_t K = order_type::X + k;
     
     angle *= value_type(.5);
-    value_type s = value_type(std::sin(angle));
-    value_type c = value_type(std::cos(angle));
+    value_type s, c;
+    sincos(value_type(angle), s, c);
 
     quaternion_type result;
     result[I] = c * q[I] + s * q[W];
@@ -444,8 +447,8 @@ quaternion_rotate_about_local_axis(quaternion<E,A,O,C>& q,size_t axis,E angle)
     const size_t K = order_type::X + k;
     
     angle *= value_type(.5);
-    value_type s = value_type(std::sin(angle));
-    value_type c = value_type(std::cos(angle));
+    value_type s, c;
+    sincos(value_type(angle), s, c);
 
     quaternion_type result;
     result[I] = c * q[I] + s * q[W];
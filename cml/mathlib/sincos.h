@@ -0,0 +1,442 @@
+/* -*- C++ -*- ------------------------------------------------------------
+
+Copyright (c) 2007 Jesse Anders and Demian Nave http://cmldev.net/
+
+The Configurable Math Library (CML) is distributed under the terms of the
+Boost Software License, v1.0 (see cml/LICENSE for details).
+
+ *-----------------------------------------------------------------------*/
+/** @file
+ *  @brief Polynomial sine and cosine of float angles, one or many at once.
+ *
+ * sincos() returns the sine and cosine of one angle, and sincos_batch() of
+ * an array of angles.  How they are computed depends on a policy tag:
+ *
+ * - libm_sincos calls std::sin() and std::cos().
+ * - precise_sincos reduces the angle to [-pi/4,pi/4] and evaluates
+ *   degree 7/8 minimax polynomials.  The absolute error is below 1.5e-7,
+ *   i.e. within a couple of float ulps of libm.
+ * - fast_sincos uses degree 5/4 polynomials on the same range.  The
+ *   absolute error is below 1.3e-5, which is plenty for tessellation and
+ *   animation, but not for angles that are accumulated.
+ *
+ * The polynomial policies only apply to float; other types always use
+ * libm.  The reduction is accurate for |angle| <= 8192; larger, infinite
+ * or NaN angles are passed to libm as well.
+ *
+ * sincos_batch() handles eight angles per instruction with AVX2 and four
+ * with SSE2.  Results are identical to sincos() with the same policy.
+ *
+ * The rotation builders in matrix_rotation.h and quaternion_rotation.h
+ * use CML_DEFAULT_SINCOS_POLICY, which is precise_sincos unless it is
+ * defined otherwise before including CML.
+ */
+
+#ifndef sincos_h
+#define sincos_h
+
+#include <cmath>
+#include <cml/core/simd.h>
+
+#if defined(CML_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#if defined(__AVX2__)
+#define CML_SIMD_SINCOS 8
+#else
+#include <emmintrin.h>
+#define CML_SIMD_SINCOS 4
+#endif
+#endif
+
+namespace cml {
+
+/** Compute sines and cosines with std::sin() and std::cos(). */
+struct libm_sincos {};
+
+/** Compute float sines and cosines to within 1.5e-7. */
+struct precise_sincos {};
+
+/** Compute float sines and cosines to within 1.3e-5. */
+struct fast_sincos {};
+
+namespace detail {
+
+/** Angles up to this size are reduced without significant error. */
+const float SincosReduceLimit = 8192.f;
+
+/** One angle at a time, without SIMD. */
+struct SincosScalarOps
+{
+    typedef float value;
+    typedef int index;
+    enum { width = 1 };
+
+    static value set1(float a) { return a; }
+    static value add(value a, value b) { return a + b; }
+    static value sub(value a, value b) { return a - b; }
+    static value mul(value a, value b) { return a * b; }
+
+    /** Round to the nearest integer. */
+    static index round(value a) { return index(a + (a < 0.f ? -.5f : .5f)); }
+    static value to_value(index k) { return value(k); }
+    static index next(index k) { return k + 1; }
+
+    /** Return b where k is odd, and a where it is even. */
+    static value select_odd(index k, value a, value b) {
+        return (k & 1) ? b : a;
+    }
+
+    /** Negate a where bit 1 of k is set. */
+    static value negate_if(index k, value a) { return (k & 2) ? -a : a; }
+
+    static value load(const float* p, size_t) { return *p; }
+    static void store(float* p, size_t, value a) { *p = a; }
+
+    /** Return a non-zero mask if a is beyond the reduction limit. */
+    static int large(value a) {
+        return !(std::fabs(a) <= SincosReduceLimit);
+    }
+};
+
+#if defined(CML_SIMD_SINCOS)
+
+/** Four angles at a time with SSE2. */
+struct SincosSseOps
+{
+    typedef __m128 value;
+    typedef __m128i index;
+    enum { width = 4 };
+
+    static value set1(float a) { return _mm_set1_ps(a); }
+    static value add(value a, value b) { return _mm_add_ps(a,b); }
+    static value sub(value a, value b) { return _mm_sub_ps(a,b); }
+    static value mul(value a, value b) { return _mm_mul_ps(a,b); }
+
+    /** Round to the nearest integer (the default MXCSR mode). */
+    static index round(value a) { return _mm_cvtps_epi32(a); }
+    static value to_value(index k) { return _mm_cvtepi32_ps(k); }
+    static index next(index k) {
+        return _mm_add_epi32(k, _mm_set1_epi32(1));
+    }
+
+    static value select_odd(index k, value a, value b) {
+        const __m128i one = _mm_set1_epi32(1);
+        __m128 odd = _mm_castsi128_ps(
+                _mm_cmpeq_epi32(_mm_and_si128(k,one), one));
+        return _mm_or_ps(_mm_and_ps(odd,b), _mm_andnot_ps(odd,a));
+    }
+
+    static value negate_if(index k, value a) {
+        __m128i sign = _mm_slli_epi32(
+                _mm_and_si128(k, _mm_set1_epi32(2)), 30);
+        return _mm_xor_ps(a, _mm_castsi128_ps(sign));
+    }
+
+    /** Load count (1-4) angles, padding with zeros. */
+    static value load(const float* p, size_t count) {
+        switch(count) {
+            case 1: return _mm_load_ss(p);
+            case 2: return _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) p);
+            case 3: return SimdLoad3(p);
+            default: return _mm_loadu_ps(p);
+        }
+    }
+
+    /** Store the first count (1-4) lanes. */
+    static void store(float* p, size_t count, value a) {
+        switch(count) {
+            case 1: _mm_store_ss(p, a); break;
+            case 2: _mm_storel_pi((__m64*) p, a); break;
+            case 3: SimdStore3(p, a); break;
+            default: _mm_storeu_ps(p, a); break;
+        }
+    }
+
+    /** Return a lane mask of the angles beyond the reduction limit. */
+    static int large(value a) {
+        __m128 size = _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+        return _mm_movemask_ps(
+                _mm_cmpnle_ps(size, _mm_set1_ps(SincosReduceLimit)));
+    }
+};
+
+#if CML_SIMD_SINCOS == 8
+
+/** Eight angles at a time with AVX2. */
+struct SincosAvxOps
+{
+    typedef __m256 value;
+    typedef __m256i index;
+    enum { width = 8 };
+
+    static value set1(float a) { return _mm256_set1_ps(a); }
+    static value add(value a, value b) { return _mm256_add_ps(a,b); }
+    static value sub(value a, value b) { return _mm256_sub_ps(a,b); }
+    static value mul(value a, value b) { return _mm256_mul_ps(a,b); }
+
+    static index round(value a) { return _mm256_cvtps_epi32(a); }
+    static value to_value(index k) { return _mm256_cvtepi32_ps(k); }
+    static index next(index k) {
+        return _mm256_add_epi32(k, _mm256_set1_epi32(1));
+    }
+
+    static value select_odd(index k, value a, value b) {
+        const __m256i one = _mm256_set1_epi32(1);
+        __m256 odd = _mm256_castsi256_ps(
+                _mm256_cmpeq_epi32(_mm256_and_si256(k,one), one));
+        return _mm256_blendv_ps(a, b, odd);
+    }
+
+    static value negate_if(index k, value a) {
+        __m256i sign = _mm256_slli_epi32(
+                _mm256_and_si256(k, _mm256_set1_epi32(2)), 30);
+        return _mm256_xor_ps(a, _mm256_castsi256_ps(sign));
+    }
+
+    /** Load count (1-8) angles, padding with zeros. */
+    static value load(const float* p, size_t count) {
+        if(count == 8) return _mm256_loadu_ps(p);
+        __m128 lo = SincosSseOps::load(p, count < 4 ? count : 4);
+        __m128 hi = (count > 4) ?
+            SincosSseOps::load(p+4, count-4) : _mm_setzero_ps();
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+    }
+
+    /** Store the first count (1-8) lanes. */
+    static void store(float* p, size_t count, value a) {
+        if(count == 8) {
+            _mm256_storeu_ps(p, a);
+            return;
+        }
+        SincosSseOps::store(p, count < 4 ? count : 4,
+                _mm256_castps256_ps128(a));
+        if(count > 4) {
+            SincosSseOps::store(p+4, count-4, _mm256_extractf128_ps(a, 1));
+        }
+    }
+
+    static int large(value a) {
+        __m256 size = _mm256_andnot_ps(_mm256_set1_ps(-0.f), a);
+        return _mm256_movemask_ps(_mm256_cmp_ps(
+                    size, _mm256_set1_ps(SincosReduceLimit), _CMP_NLE_UQ));
+    }
+};
+
+typedef SincosAvxOps SincosBatchOps;
+#else
+typedef SincosSseOps SincosBatchOps;
+#endif
+
+#else
+typedef SincosScalarOps SincosBatchOps;
+#endif // CML_SIMD_SINCOS
+
+/** Sine and cosine polynomials for r in [-pi/4,pi/4]. */
+template<class Ops, class Policy> struct SincosPolynomial;
+
+/** Degree 7 sine and degree 8 cosine (Cephes sinf/cosf). */
+template<class Ops> struct SincosPolynomial<Ops,precise_sincos>
+{
+    typedef typename Ops::value value;
+
+    static void eval(value r, value& s, value& c) {
+        value r2 = Ops::mul(r,r);
+        value ps = Ops::set1(-1.9515295891e-4f);
+        ps = Ops::add(Ops::mul(ps,r2), Ops::set1( 8.3321608736e-3f));
+        ps = Ops::add(Ops::mul(ps,r2), Ops::set1(-1.6666654611e-1f));
+        s = Ops::add(Ops::mul(Ops::mul(ps,r2), r), r);
+
+        value pc = Ops::set1(2.443315711809948e-5f);
+        pc = Ops::add(Ops::mul(pc,r2), Ops::set1(-1.388731625493765e-3f));
+        pc = Ops::add(Ops::mul(pc,r2), Ops::set1( 4.166664568298827e-2f));
+        pc = Ops::sub(Ops::mul(pc,r2), Ops::set1(.5f));
+        c = Ops::add(Ops::mul(pc,r2), Ops::set1(1.f));
+    }
+};
+
+/** Degree 5 sine and degree 4 cosine, minimax on [-pi/4,pi/4]. */
+template<class Ops> struct SincosPolynomial<Ops,fast_sincos>
+{
+    typedef typename Ops::value value;
+
+    static void eval(value r, value& s, value& c) {
+        value r2 = Ops::mul(r,r);
+        value ps = Ops::set1(8.152992348e-3f);
+        ps = Ops::add(Ops::mul(ps,r2), Ops::set1(-1.666283381e-1f));
+        s = Ops::add(Ops::mul(Ops::mul(ps,r2), r), r);
+
+        value pc = Ops::set1(4.048893586e-2f);
+        pc = Ops::add(Ops::mul(pc,r2), Ops::set1(-4.997763071e-1f));
+        c = Ops::add(Ops::mul(pc,r2), Ops::set1(1.f));
+    }
+};
+
+/** Sine and cosine of angles with |x| <= SincosReduceLimit.
+ *
+ * x = k*pi/2 + r, where pi/2 is split into three parts so that k times
+ * the first two is exact (Cody and Waite).  The quadrant k mod 4 then
+ * picks and negates the polynomials.
+ */
+template<class Ops, class Policy> inline void
+SincosReduced(typename Ops::value x,
+        typename Ops::value& s, typename Ops::value& c)
+{
+    typedef typename Ops::value value;
+    typedef typename Ops::index index;
+
+    index k = Ops::round(Ops::mul(x, Ops::set1(0.63661977236758134f)));
+    value kf = Ops::to_value(k);
+    value r = Ops::sub(x, Ops::mul(kf, Ops::set1(1.5703125f)));
+    r = Ops::sub(r, Ops::mul(kf, Ops::set1(4.837512969970703125e-4f)));
+    r = Ops::sub(r, Ops::mul(kf, Ops::set1(7.54978995489188216e-8f)));
+
+    value ps, pc;
+    SincosPolynomial<Ops,Policy>::eval(r, ps, pc);
+    s = Ops::negate_if(k, Ops::select_odd(k, ps, pc));
+    c = Ops::negate_if(Ops::next(k), Ops::select_odd(k, pc, ps));
+}
+
+/** Sine and cosine of one angle.
+ *
+ * With SSE2 this uses the first lane of the SIMD kernel, which avoids the
+ * unpredictable quadrant branches of the scalar code.
+ */
+template<class Policy> inline void
+SincosScalar(float angle, float& s, float& c)
+{
+    if(SincosScalarOps::large(angle)) {
+        s = std::sin(angle);
+        c = std::cos(angle);
+        return;
+    }
+#if defined(CML_SIMD_SINCOS)
+    __m128 vs, vc;
+    SincosReduced<SincosSseOps,Policy>(_mm_set_ss(angle), vs, vc);
+    s = _mm_cvtss_f32(vs);
+    c = _mm_cvtss_f32(vc);
+#else
+    SincosReduced<SincosScalarOps,Policy>(angle, s, c);
+#endif
+}
+
+/** Evaluate count (up to width) angles at once.
+ *
+ * Any large angles are then redone with libm.
+ */
+template<class Ops, class Policy> inline void
+SincosGroup(const float* angles, float* s, float* c, size_t count)
+{
+    typename Ops::value x = Ops::load(angles, count), vs, vc;
+    int large = Ops::large(x);
+
+    /* Keep the large angles, since s or c may be the angle array: */
+    float kept[Ops::width];
+    if(large) Ops::store(kept, Ops::width, x);
+
+    SincosReduced<Ops,Policy>(x, vs, vc);
+    Ops::store(s, count, vs);
+    Ops::store(c, count, vc);
+
+    for(int i = 0; large; ++i, large >>= 1) {
+        if(large & 1) {
+            s[i] = std::sin(kept[i]);
+            c[i] = std::cos(kept[i]);
+        }
+    }
+}
+
+template<class Policy> inline void
+SincosBatchRun(const float* angles, float* s, float* c, size_t n)
+{
+    const size_t width = SincosBatchOps::width;
+    const size_t whole = n - n % width;
+    for(size_t i = 0; i < whole; i += width) {
+        SincosGroup<SincosBatchOps,Policy>(angles+i, s+i, c+i, width);
+    }
+
+    /* A short last group is padded, rather than done one by one: */
+    if(whole < n) {
+        SincosGroup<SincosBatchOps,Policy>(
+                angles+whole, s+whole, c+whole, n-whole);
+    }
+}
+
+} // namespace detail
+
+/** Compute the sine and cosine of angle with std::sin() and std::cos(). */
+template<typename T> inline void
+sincos(T angle, T& s, T& c, libm_sincos)
+{
+    s = T(std::sin(angle));
+    c = T(std::cos(angle));
+}
+
+/** The polynomial policies only apply to float, so use libm otherwise. */
+template<typename T, class Policy> inline void
+sincos(T angle, T& s, T& c, Policy)
+{
+    sincos(angle, s, c, libm_sincos());
+}
+
+/** Compute the sine and cosine of angle to within 1.5e-7. */
+inline void
+sincos(float angle, float& s, float& c, precise_sincos)
+{
+    detail::SincosScalar<precise_sincos>(angle, s, c);
+}
+
+/** Compute the sine and cosine of angle to within 1.3e-5. */
+inline void
+sincos(float angle, float& s, float& c, fast_sincos)
+{
+    detail::SincosScalar<fast_sincos>(angle, s, c);
+}
+
+/** Compute the sine and cosine of angle with the default policy. */
+template<typename T> inline void
+sincos(T angle, T& s, T& c)
+{
+    sincos(angle, s, c, CML_DEFAULT_SINCOS_POLICY());
+}
+
+/** Compute s[i] = sin(angles[i]) and c[i] = cos(angles[i]) for i < n.
+ *
+ * s or c may be the same array as angles.  Like sincos(), the polynomial
+ * policies only apply to float.
+ */
+template<typename T, class Policy> inline void
+sincos_batch(const T* angles, T* s, T* c, size_t n, Policy)
+{
+    for(size_t i = 0; i < n; ++i) {
+        T a = angles[i];
+        sincos(a, s[i], c[i], libm_sincos());
+    }
+}
+
+/** Compute n float sines and cosines to within 1.5e-7. */
+inline void
+sincos_batch(const float* angles, float* s, float* c, size_t n,
+        precise_sincos)
+{
+    detail::SincosBatchRun<precise_sincos>(angles, s, c, n);
+}
+
+/** Compute n float sines and cosines to within 1.3e-5. */
+inline void
+sincos_batch(const float* angles, float* s, float* c, size_t n, fast_sincos)
+{
+    detail::SincosBatchRun<fast_sincos>(angles, s, c, n);
+}
+
+/** Compute n sines and cosines with the default policy. */
+template<typename T> inline void
+sincos_batch(const T* angles, T* s, T* c, size_t n)
+{
+    sincos_batch(angles, s, c, n, CML_DEFAULT_SINCOS_POLICY());
+}
+
+} // namespace cml
+
+#endif
+
+// -------------------------------------------------------------------------
+// vim:ft=cpp
@@ -18,6 +18,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #include <cml/quaternion.h>
 #include <cml/constants.h>
 #include <cml/mathlib/epsilon.h>
+#include <cml/core/arena.h>
 
 namespace cml {
 
@@ -121,6 +122,14 @@ typedef matrix< double, dynamic<>, row_basis, row_major > matrixd_r;
 typedef matrix< double, dynamic<>, col_basis, col_major > matrixd_c;
 
 
+/* frame-scoped dynamic vectors and matrices (see cml/core/arena.h) */
+typedef vector< float,  dynamic< arena_allocator<void> > > vectorf_arena;
+typedef vector< double, dynamic< arena_allocator<void> > > vectord_arena;
+
+typedef matrix< float,  dynamic< arena_allocator<void> > > matrixf_arena;
+typedef matrix< double, dynamic< arena_allocator<void> > > matrixd_arena;
+
+
 /* constants */
 typedef constants<float>  constantsf;
 typedef constants<double> constantsd;
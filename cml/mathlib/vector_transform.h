@@ -14,6 +14,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #define vector_transform_h
 
 #include <cml/mathlib/checking.h>
+#include <cml/vector/vector_simd.h>
 
 /* Functions for transforming a vector, representing a geometric point or
  * or vector, by an affine transfom.
@@ -65,6 +66,77 @@ transform_vector_4D(const MatT& m, const VecT& v, col_basis) {
     return m*v;
 }
 
+/* transform_point() uses the SIMD kernel for a fixed-size float 4x4 matrix
+ * that stores each basis vector contiguously, and a float 3D vector with
+ * contiguous storage:
+ */
+template < class MatT > struct TransformPointSimdMatrix {
+    enum { is_true = false };
+};
+
+template < class AT, class BO, class L >
+struct TransformPointSimdMatrix< matrix<float,AT,BO,L> > {
+    typedef matrix<float,AT,BO,L> matrix_type;
+    enum {
+        is_true =
+            same_type<typename matrix_type::size_tag,fixed_size_tag>::is_true
+            && (int) matrix_type::array_rows == 4
+            && (int) matrix_type::array_cols == 4
+            && ((same_type<BO,col_basis>::is_true
+                    && same_type<L,col_major>::is_true)
+                || (same_type<BO,row_basis>::is_true
+                    && same_type<L,row_major>::is_true))
+    };
+};
+
+template < class VecT > struct TransformPointSimdVector {
+    enum { is_true = false };
+};
+
+template < class AT > struct TransformPointSimdVector< vector<float,AT> > {
+    typedef vector<float,AT> vector_type;
+    enum {
+        is_true =
+            same_type<typename vector_type::size_tag,fixed_size_tag>::is_true
+            && (int) vector_type::array_size == 3
+    };
+};
+
+template < class MatT, class VecT > struct TransformPointSimdTraits {
+#if defined(CML_SIMD)
+    enum { is_true = TransformPointSimdMatrix<MatT>::is_true
+        && TransformPointSimdVector<VecT>::is_true };
+#else
+    enum { is_true = false };
+#endif
+    typedef typename select_if<is_true,true_type,false_type>::result result;
+};
+
+template < class MatT, class VecT > TEMP_VEC3
+transform_point(const MatT& m, const VecT& v, false_type)
+{
+    typedef TEMP_VEC3 vector_type;
+    return vector_type(
+        m.basis_element(0,0)*v[0]+m.basis_element(1,0)*v[1]+
+            m.basis_element(2,0)*v[2]+m.basis_element(3,0),
+        m.basis_element(0,1)*v[0]+m.basis_element(1,1)*v[1]+
+            m.basis_element(2,1)*v[2]+m.basis_element(3,1),
+        m.basis_element(0,2)*v[0]+m.basis_element(1,2)*v[1]+
+            m.basis_element(2,2)*v[2]+m.basis_element(3,2)
+    );
+}
+
+#if defined(CML_SIMD)
+template < class MatT, class VecT > TEMP_VEC3
+transform_point(const MatT& m, const VecT& v, true_type)
+{
+    typedef TEMP_VEC3 vector_type;
+    vector_type result;
+    VectorSimdTransformPoint(m.data(), v.data(), result.data());
+    return result;
+}
+#endif
+
 } // namespace detail
 
 /** Apply a 4x4 homogeneous transform matrix to a 4D vector */
@@ -77,20 +149,13 @@ transform_vector_4D(const MatT& m, const VecT& v) {
 template < class MatT, class VecT > TEMP_VEC3
 transform_point(const MatT& m, const VecT& v)
 {
-    typedef TEMP_VEC3 vector_type;
-
     /* Checking */
     detail::CheckMatAffine3D(m);
     detail::CheckVec3(v);
 
-    return vector_type(
-        m.basis_element(0,0)*v[0]+m.basis_element(1,0)*v[1]+
-            m.basis_element(2,0)*v[2]+m.basis_element(3,0),
-        m.basis_element(0,1)*v[0]+m.basis_element(1,1)*v[1]+
-            m.basis_element(2,1)*v[2]+m.basis_element(3,1),
-        m.basis_element(0,2)*v[0]+m.basis_element(1,2)*v[1]+
-            m.basis_element(2,2)*v[2]+m.basis_element(3,2)
-    );
+    typedef typename detail::TransformPointSimdTraits<MatT,VecT>::result
+        simd_tag;
+    return detail::transform_point(m,v,simd_tag());
 }
 
 /** Apply a 3D affine transform to a 3D vector */
@@ -49,6 +49,7 @@ template<typename Element, class ArrayType,
 #include <cml/matrix/matrix_functions.h>
 #include <cml/matrix/lu.h>
 #include <cml/matrix/inverse.h>
+#include <cml/matrix/inverse_batch.h>
 #include <cml/matrix/determinant.h>
 #include <cml/matrix/matrix_print.h>
 
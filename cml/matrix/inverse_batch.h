@@ -0,0 +1,438 @@
+/* -*- C++ -*- ------------------------------------------------------------
+
+Copyright (c) 2007 Jesse Anders and Demian Nave http://cmldev.net/
+
+The Configurable Math Library (CML) is distributed under the terms of the
+Boost Software License, v1.0 (see cml/LICENSE for details).
+
+ *-----------------------------------------------------------------------*/
+/** @file
+ *  @brief Batched inverses and determinants of arrays of 4x4 float matrices.
+ *
+ * inverse() handles one matrix at a time.  The batched functions here use
+ * the same closed form (cofactors) but invert several matrices per
+ * instruction: eight with AVX, four with SSE, one otherwise.
+ * Each group is transposed into registers so that every register holds
+ * one element of all the matrices in the group.  A short last group is
+ * padded with identity matrices.
+ *
+ * The inverse of a transpose is the transpose of the inverse, so the
+ * general kernel does not care about basis or layout.  The affine kernel
+ * only needs to know where the translation is stored, which it works out
+ * from the matrix type.
+ *
+ * Singular matrices give a determinant of 0 and an inverse of infinities
+ * or NaNs.  Pass a determinant array to check for them.
+ */
+
+#ifndef matrix_inverse_batch_h
+#define matrix_inverse_batch_h
+
+#include <cml/core/simd.h>
+#include <cml/core/cml_meta.h>
+
+namespace cml {
+namespace detail {
+
+/** One matrix at a time, without SIMD. */
+struct InverseBatchScalarOps
+{
+    typedef float value;
+    enum { width = 1 };
+
+    static value add(value a, value b) { return a + b; }
+    static value sub(value a, value b) { return a - b; }
+    static value mul(value a, value b) { return a * b; }
+    static value recip(value a) { return 1.f / a; }
+    static value zero() { return 0.f; }
+    static value one() { return 1.f; }
+
+    /** Return the elements of a matrix, which need no copying. */
+    static const value* load(const float* m, size_t, value*) {
+        return m;
+    }
+
+    static void store(float* m, size_t, const value e[16]) {
+        for(int k = 0; k < 16; ++k) m[k] = e[k];
+    }
+
+    static void store_lanes(float* p, size_t, value v) { p[0] = v; }
+};
+
+#if defined(CML_SIMD)
+
+/** Four matrices at a time with SSE. */
+struct InverseBatchSseOps
+{
+    typedef __m128 value;
+    enum { width = 4 };
+
+    static value add(value a, value b) { return _mm_add_ps(a,b); }
+    static value sub(value a, value b) { return _mm_sub_ps(a,b); }
+    static value mul(value a, value b) { return _mm_mul_ps(a,b); }
+    static value recip(value a) { return _mm_div_ps(_mm_set1_ps(1.f),a); }
+    static value zero() { return _mm_setzero_ps(); }
+    static value one() { return _mm_set1_ps(1.f); }
+
+    /** Load count (1-4) matrices into e, and return e.
+     *
+     * A short group is copied to a buffer and padded with identities
+     * first, so the loads themselves never branch.
+     */
+    static const value* load(const float* m, size_t count, value e[16]) {
+        float padded[64];
+        if(count < 4) {
+            for(size_t k = 0; k < 64; ++k) {
+                padded[k] = (k < 16*count) ? m[k] : ((k % 16) % 5 == 0);
+            }
+            m = padded;
+        }
+        for(int r = 0; r < 16; r += 4) {
+            e[r+0] = _mm_loadu_ps(m + r);
+            e[r+1] = _mm_loadu_ps(m + r + 16);
+            e[r+2] = _mm_loadu_ps(m + r + 32);
+            e[r+3] = _mm_loadu_ps(m + r + 48);
+            _MM_TRANSPOSE4_PS(e[r+0],e[r+1],e[r+2],e[r+3]);
+        }
+        return e;
+    }
+
+    /** Store the first count (1-4) matrices held in e. */
+    static void store(float* m, size_t count, const value e[16]) {
+        float padded[64];
+        float* p = (count < 4) ? padded : m;
+        for(int r = 0; r < 16; r += 4) {
+            __m128 q0 = e[r+0], q1 = e[r+1], q2 = e[r+2], q3 = e[r+3];
+            _MM_TRANSPOSE4_PS(q0,q1,q2,q3);
+            _mm_storeu_ps(p + r, q0);
+            _mm_storeu_ps(p + r + 16, q1);
+            _mm_storeu_ps(p + r + 32, q2);
+            _mm_storeu_ps(p + r + 48, q3);
+        }
+        if(count < 4) {
+            for(size_t k = 0; k < 16*count; ++k) m[k] = padded[k];
+        }
+    }
+
+    static void store_lanes(float* p, size_t count, value v) {
+        if(count == 4) {
+            _mm_storeu_ps(p, v);
+        } else {
+            float lanes[4];
+            _mm_storeu_ps(lanes, v);
+            for(size_t i = 0; i < count; ++i) p[i] = lanes[i];
+        }
+    }
+};
+
+#if defined(__AVX__)
+
+/** Eight matrices at a time with AVX, as two SSE groups side by side. */
+struct InverseBatchAvxOps
+{
+    typedef __m256 value;
+    enum { width = 8 };
+
+    static value add(value a, value b) { return _mm256_add_ps(a,b); }
+    static value sub(value a, value b) { return _mm256_sub_ps(a,b); }
+    static value mul(value a, value b) { return _mm256_mul_ps(a,b); }
+    static value recip(value a) {
+        return _mm256_div_ps(_mm256_set1_ps(1.f),a);
+    }
+    static value zero() { return _mm256_setzero_ps(); }
+    static value one() { return _mm256_set1_ps(1.f); }
+
+    static size_t half(size_t count, size_t offset) {
+        return (count > offset) ? count - offset : 0;
+    }
+
+    /** Load count (1-8) matrices into e, and return e. */
+    static const value* load(const float* m, size_t count, value e[16]) {
+        __m128 lo[16], hi[16];
+        InverseBatchSseOps::load(m, count < 4 ? count : 4, lo);
+        InverseBatchSseOps::load(count > 4 ? m + 64 : m, half(count,4), hi);
+        for(int k = 0; k < 16; ++k) {
+            e[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[k]), hi[k], 1);
+        }
+        return e;
+    }
+
+    static void store(float* m, size_t count, const value e[16]) {
+        __m128 lo[16], hi[16];
+        for(int k = 0; k < 16; ++k) {
+            lo[k] = _mm256_castps256_ps128(e[k]);
+            hi[k] = _mm256_extractf128_ps(e[k], 1);
+        }
+        InverseBatchSseOps::store(m, count < 4 ? count : 4, lo);
+        InverseBatchSseOps::store(m + 64, half(count,4), hi);
+    }
+
+    static void store_lanes(float* p, size_t count, value v) {
+        float lanes[8];
+        _mm256_storeu_ps(lanes, v);
+        for(size_t i = 0; i < count; ++i) p[i] = lanes[i];
+    }
+};
+
+typedef InverseBatchAvxOps InverseBatchOps;
+#else
+typedef InverseBatchSseOps InverseBatchOps;
+#endif
+
+#else
+typedef InverseBatchScalarOps InverseBatchOps;
+#endif // CML_SIMD
+
+/** Invert general 4x4 matrices from their 2x2 minors.
+ *
+ * e holds the elements in row-major order.
+ */
+template<class Ops> struct InverseBatchGeneral
+{
+    typedef typename Ops::value value;
+
+    static value det2(value a, value b, value c, value d) {
+        return Ops::sub(Ops::mul(a,b), Ops::mul(c,d));
+    }
+
+    /** Return x*p - y*q + z*s, scaled by f. */
+    static value cofactor(value x, value p, value y, value q,
+            value z, value s, value f)
+    {
+        return Ops::mul(Ops::add(Ops::sub(
+                        Ops::mul(x,p), Ops::mul(y,q)), Ops::mul(z,s)), f);
+    }
+
+    /** Minors of the top two rows (s) and of the bottom two rows (c). */
+    static void minors(const value e[16], value s[6], value c[6]) {
+        s[0] = det2(e[0],e[5], e[4],e[1]);
+        s[1] = det2(e[0],e[6], e[4],e[2]);
+        s[2] = det2(e[0],e[7], e[4],e[3]);
+        s[3] = det2(e[1],e[6], e[5],e[2]);
+        s[4] = det2(e[1],e[7], e[5],e[3]);
+        s[5] = det2(e[2],e[7], e[6],e[3]);
+        c[5] = det2(e[10],e[15], e[14],e[11]);
+        c[4] = det2(e[9],e[15], e[13],e[11]);
+        c[3] = det2(e[9],e[14], e[13],e[10]);
+        c[2] = det2(e[8],e[15], e[12],e[11]);
+        c[1] = det2(e[8],e[14], e[12],e[10]);
+        c[0] = det2(e[8],e[13], e[12],e[9]);
+    }
+
+    static value determinant(const value s[6], const value c[6]) {
+        return Ops::add(
+            Ops::add(Ops::sub(Ops::mul(s[0],c[5]), Ops::mul(s[1],c[4])),
+                Ops::add(Ops::mul(s[2],c[3]), Ops::mul(s[3],c[2]))),
+            Ops::sub(Ops::mul(s[5],c[0]), Ops::mul(s[4],c[1])));
+    }
+
+    value determinant(const value e[16]) const {
+        value s[6], c[6];
+        minors(e, s, c);
+        return determinant(s, c);
+    }
+
+    /** Write the inverse to r, and return the determinant. */
+    value operator()(const value e[16], value r[16]) const {
+        value s[6], c[6];
+        minors(e, s, c);
+        value det = determinant(s, c);
+        value f = Ops::recip(det);
+        value g = Ops::sub(Ops::zero(), f);
+        r[0]  = cofactor(e[5], c[5], e[6], c[4], e[7], c[3], f);
+        r[1]  = cofactor(e[1], c[5], e[2], c[4], e[3], c[3], g);
+        r[2]  = cofactor(e[13], s[5], e[14], s[4], e[15], s[3], f);
+        r[3]  = cofactor(e[9], s[5], e[10], s[4], e[11], s[3], g);
+        r[4]  = cofactor(e[4], c[5], e[6], c[2], e[7], c[1], g);
+        r[5]  = cofactor(e[0], c[5], e[2], c[2], e[3], c[1], f);
+        r[6]  = cofactor(e[12], s[5], e[14], s[2], e[15], s[1], g);
+        r[7]  = cofactor(e[8], s[5], e[10], s[2], e[11], s[1], f);
+        r[8]  = cofactor(e[4], c[4], e[5], c[2], e[7], c[0], f);
+        r[9]  = cofactor(e[0], c[4], e[1], c[2], e[3], c[0], g);
+        r[10] = cofactor(e[12], s[4], e[13], s[2], e[15], s[0], f);
+        r[11] = cofactor(e[8], s[4], e[9], s[2], e[11], s[0], g);
+        r[12] = cofactor(e[4], c[3], e[5], c[1], e[6], c[0], g);
+        r[13] = cofactor(e[0], c[3], e[1], c[1], e[2], c[0], f);
+        r[14] = cofactor(e[12], s[3], e[13], s[1], e[14], s[0], g);
+        r[15] = cofactor(e[8], s[3], e[9], s[1], e[10], s[0], f);
+        return det;
+    }
+};
+
+/** Invert affine 4x4 matrices, whose last row is (0,0,0,1).
+ *
+ * e holds the elements in row-major order, with the translation in the
+ * last column.  If Transposed is true the elements are read and written
+ * transposed instead, with the translation in elements 12-14.  Only the
+ * 3x3 part is inverted.
+ */
+template<class Ops, bool Transposed> struct InverseBatchAffine
+{
+    typedef typename Ops::value value;
+
+    /** Index of element (row,col). */
+    static int at(int row, int col) {
+        return Transposed ? 4*col + row : 4*row + col;
+    }
+
+    static value det2(value a, value b, value c, value d) {
+        return Ops::sub(Ops::mul(a,b), Ops::mul(c,d));
+    }
+
+    /** The determinant of the 3x3 part, which is the same transposed. */
+    value determinant(const value e[16]) const {
+        return Ops::add(Ops::mul(e[0],det2(e[5],e[10], e[6],e[9])),
+                Ops::add(Ops::mul(e[1],det2(e[6],e[8], e[4],e[10])),
+                    Ops::mul(e[2],det2(e[4],e[9], e[5],e[8]))));
+    }
+
+    /** Write the inverse to r, and return the determinant. */
+    value operator()(const value e[16], value r[16]) const {
+        value m00 = e[at(0,0)], m01 = e[at(0,1)], m02 = e[at(0,2)];
+        value m10 = e[at(1,0)], m11 = e[at(1,1)], m12 = e[at(1,2)];
+        value m20 = e[at(2,0)], m21 = e[at(2,1)], m22 = e[at(2,2)];
+        value t0 = e[at(0,3)], t1 = e[at(1,3)], t2 = e[at(2,3)];
+
+        /* Cofactors of the 3x3 part, transposed: */
+        value a00 = det2(m11,m22, m12,m21);
+        value a01 = det2(m02,m21, m01,m22);
+        value a02 = det2(m01,m12, m02,m11);
+        value a10 = det2(m12,m20, m10,m22);
+        value a11 = det2(m00,m22, m02,m20);
+        value a12 = det2(m02,m10, m00,m12);
+        value a20 = det2(m10,m21, m11,m20);
+        value a21 = det2(m01,m20, m00,m21);
+        value a22 = det2(m00,m11, m01,m10);
+
+        value det = Ops::add(Ops::mul(m00,a00),
+                Ops::add(Ops::mul(m01,a10), Ops::mul(m02,a20)));
+        value f = Ops::recip(det);
+        a00 = Ops::mul(a00,f); a01 = Ops::mul(a01,f); a02 = Ops::mul(a02,f);
+        a10 = Ops::mul(a10,f); a11 = Ops::mul(a11,f); a12 = Ops::mul(a12,f);
+        a20 = Ops::mul(a20,f); a21 = Ops::mul(a21,f); a22 = Ops::mul(a22,f);
+
+        r[at(0,0)] = a00; r[at(0,1)] = a01; r[at(0,2)] = a02;
+        r[at(1,0)] = a10; r[at(1,1)] = a11; r[at(1,2)] = a12;
+        r[at(2,0)] = a20; r[at(2,1)] = a21; r[at(2,2)] = a22;
+
+        /* -(A^-1 t): */
+        value zero = Ops::zero();
+        r[at(0,3)] = Ops::sub(zero, Ops::add(Ops::mul(a00,t0),
+                    Ops::add(Ops::mul(a01,t1), Ops::mul(a02,t2))));
+        r[at(1,3)] = Ops::sub(zero, Ops::add(Ops::mul(a10,t0),
+                    Ops::add(Ops::mul(a11,t1), Ops::mul(a12,t2))));
+        r[at(2,3)] = Ops::sub(zero, Ops::add(Ops::mul(a20,t0),
+                    Ops::add(Ops::mul(a21,t1), Ops::mul(a22,t2))));
+        r[at(3,0)] = r[at(3,1)] = r[at(3,2)] = zero;
+        r[15] = Ops::one();
+        return det;
+    }
+};
+
+/** Invert n matrices of 16 contiguous floats with a kernel. */
+template<class Ops, class KernelT> void
+InverseBatchRun(const KernelT& kernel, const float* m, float* out,
+        float* det, size_t n)
+{
+    typedef typename Ops::value value;
+    static const size_t W = Ops::width;
+    for(size_t i = 0; i < n; i += W) {
+        size_t count = (n - i < W) ? n - i : W;
+        value buffer[16], r[16];
+        const value* e = Ops::load(m + 16*i, count, buffer);
+        value d = kernel(e, r);
+        Ops::store(out + 16*i, count, r);
+        if(det) Ops::store_lanes(det + i, count, d);
+    }
+}
+
+/** Find the determinants of n matrices of 16 contiguous floats. */
+template<class Ops, class KernelT> void
+DeterminantBatchRun(const KernelT& kernel, const float* m, float* det,
+        size_t n)
+{
+    typedef typename Ops::value value;
+    static const size_t W = Ops::width;
+    for(size_t i = 0; i < n; i += W) {
+        size_t count = (n - i < W) ? n - i : W;
+        value buffer[16];
+        const value* e = Ops::load(m + 16*i, count, buffer);
+        Ops::store_lanes(det + i, count, kernel.determinant(e));
+    }
+}
+
+/** True if a matrix type stores its translation in elements 12-14. */
+template<class BasisT, class LayoutT> struct InverseBatchTranslationLast
+{
+    enum { is_true = (bool) same_type<BasisT,col_basis>::is_true
+        == (bool) same_type<LayoutT,col_major>::is_true };
+};
+
+template<class BasisT, class LayoutT> inline const float*
+InverseBatchData(const matrix<float,fixed<4,4>,BasisT,LayoutT>* m)
+{
+    /* The array must be densely packed 16-float matrices: */
+    static_assert(sizeof(matrix<float,fixed<4,4>,BasisT,LayoutT>) == 16*sizeof(float),
+            "inverse_batch needs densely packed 16-float matrices");
+    return m[0].data();
+}
+
+} // namespace detail
+
+/** Set out[i] = inverse(m[i]) for i in [0,n).
+ *
+ * @param det if not null, receives the determinant of each m[i].
+ */
+template<class BasisT, class LayoutT> void
+inverse_batch(
+    const matrix<float,fixed<4,4>,BasisT,LayoutT>* m,
+    matrix<float,fixed<4,4>,BasisT,LayoutT>* out,
+    size_t n,
+    float* det = 0)
+{
+    typedef detail::InverseBatchOps Ops;
+    detail::InverseBatchRun<Ops>(detail::InverseBatchGeneral<Ops>(),
+            detail::InverseBatchData(m), out[0].data(), det, n);
+}
+
+/** Set out[i] = inverse(m[i]) for i in [0,n), for affine matrices.
+ *
+ * The matrices must be affine (a 3x3 part plus a translation), as the
+ * basis row or column that would hold a projection is ignored.  This is
+ * cheaper than inverse_batch().
+ *
+ * @param det if not null, receives the determinant of each m[i].
+ */
+template<class BasisT, class LayoutT> void
+inverse_affine_batch(
+    const matrix<float,fixed<4,4>,BasisT,LayoutT>* m,
+    matrix<float,fixed<4,4>,BasisT,LayoutT>* out,
+    size_t n,
+    float* det = 0)
+{
+    typedef detail::InverseBatchOps Ops;
+    enum { transposed =
+        detail::InverseBatchTranslationLast<BasisT,LayoutT>::is_true };
+    detail::InverseBatchRun<Ops>(
+            detail::InverseBatchAffine<Ops,(bool) transposed>(),
+            detail::InverseBatchData(m), out[0].data(), det, n);
+}
+
+/** Set det[i] = determinant(m[i]) for i in [0,n). */
+template<class BasisT, class LayoutT> void
+determinant_batch(
+    const matrix<float,fixed<4,4>,BasisT,LayoutT>* m,
+    float* det,
+    size_t n)
+{
+    typedef detail::InverseBatchOps Ops;
+    detail::DeterminantBatchRun<Ops>(detail::InverseBatchGeneral<Ops>(),
+            detail::InverseBatchData(m), det, n);
+}
+
+} // namespace cml
+
+#endif
+
+// -------------------------------------------------------------------------
+// vim:ft=cpp
@@ -23,6 +23,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 
 #include <cml/et/size_checking.h>
 #include <cml/matrix/matrix_expr.h>
+#include <cml/matrix/matrix_mul_simd.h>
 
 /* This is used below to create a more meaningful compile-time error when
  * mul is not provided with matrix or MatrixExpr arguments:
@@ -63,6 +64,141 @@ MatMulCheckedSize(const LeftT& left, const RightT& right, dynamic_size_tag)
     return matrix_size(left_N.first, right_N.second); /* rows,cols */
 }
 
+/** Compute C = A x B with the generic O(N^3) loop. */
+template<class LeftT, class RightT, class ResultT> inline void
+MatMulLoop(const LeftT& left, const RightT& right, ResultT& C)
+{
+    typedef typename ResultT::value_type value_type;
+    for(size_t i = 0; i < left.rows(); ++i) {               /* rows */
+        for(size_t j = 0; j < right.cols(); ++j) {          /* cols */
+            value_type sum(left(i,0)*right(0,j));
+            for(size_t k = 1; k < right.rows(); ++k) {
+                sum += (left(i,k)*right(k,j));
+            }
+            C(i,j) = sum;
+        }
+    }
+}
+
+#if defined(CML_2D_UNROLLER)
+/** Unroll C = A x B for small fixed-size matrices.
+ *
+ * Each element is summed in the same order as MatMulLoop(), so the results
+ * are identical.
+ */
+template<class LeftT, class RightT, class ResultT>
+struct MatMulUnroller
+{
+    typedef typename ResultT::value_type value_type;
+
+    enum {
+        Cols = ResultT::array_cols,
+        LastElem = ResultT::array_rows*ResultT::array_cols-1,
+        LastK = LeftT::array_cols-1
+    };
+
+    /** Add left(R,K)*right(K,C) to sum, for K through LastK. */
+    template<int R, int C, int K, bool done = (K > LastK)> struct Sum {
+        value_type operator()(
+                const LeftT& left, const RightT& right, value_type sum) const
+        {
+            sum += left(R,K)*right(K,C);
+            return Sum<R,C,K+1>()(left,right,sum);
+        }
+    };
+
+    /** All products have been added. */
+    template<int R, int C, int K> struct Sum<R,C,K,true> {
+        value_type operator()(
+                const LeftT&, const RightT&, value_type sum) const
+        {
+            return sum;
+        }
+    };
+
+    /** Compute element I of C, counting along rows, then the rest. */
+    template<int I, bool last = (I == LastElem)> struct Eval {
+        void operator()(
+                const LeftT& left, const RightT& right, ResultT& C) const
+        {
+            Eval<I,true>()(left,right,C);
+            Eval<I+1>()(left,right,C);
+        }
+    };
+
+    /** Compute element I of C only. */
+    template<int I> struct Eval<I,true> {
+        void operator()(
+                const LeftT& left, const RightT& right, ResultT& C) const
+        {
+            enum { R = I / Cols, Col = I % Cols };
+            C(R,Col) = Sum<R,Col,1>()(left,right,left(R,0)*right(0,Col));
+        }
+    };
+};
+
+/* Multiply small fixed-size matrices with the unroller: */
+template<class LeftT, class RightT, class ResultT> struct MatMulUnrollTraits
+{
+    enum {
+        is_true =
+            same_type<typename LeftT::size_tag,fixed_size_tag>::is_true
+            && same_type<typename RightT::size_tag,fixed_size_tag>::is_true
+            && same_type<typename ResultT::size_tag,fixed_size_tag>::is_true
+            && (int) ResultT::array_rows * (int) ResultT::array_cols
+                <= CML_MATRIX_UNROLL_LIMIT
+    };
+    typedef typename select_if<is_true,true_type,false_type>::result result;
+};
+
+template<class LeftT, class RightT, class ResultT> inline void
+MatMulGeneric(const LeftT& left, const RightT& right, ResultT& C, true_type)
+{
+    typedef typename MatMulUnroller<LeftT,RightT,ResultT>
+        ::template Eval<0> Unroller;
+    Unroller()(left,right,C);
+}
+
+template<class LeftT, class RightT, class ResultT> inline void
+MatMulGeneric(const LeftT& left, const RightT& right, ResultT& C, false_type)
+{
+    MatMulLoop(left,right,C);
+}
+#endif
+
+/** Compute C = A x B without the SIMD kernels. */
+template<class LeftT, class RightT, class ResultT> inline void
+MatMulInto(const LeftT& left, const RightT& right, ResultT& C, false_type)
+{
+#if defined(CML_2D_UNROLLER)
+    typedef typename MatMulUnrollTraits<LeftT,RightT,ResultT>::result
+        unroll_tag;
+    MatMulGeneric(left,right,C,unroll_tag());
+#else
+    MatMulLoop(left,right,C);
+#endif
+}
+
+#if defined(CML_SIMD_MATMUL)
+/** Compute C = A x B for fixed-size 3x3 or 4x4 float matrices.
+ *
+ * @sa et::MatMulSimdTraits
+ */
+template<class LeftT, class RightT, class ResultT> inline void
+MatMulInto(const LeftT& left, const RightT& right, ResultT& C, true_type)
+{
+    typedef MatMulSimdKernel<LeftT::array_rows> kernel;
+    enum {
+        col_major_args =
+            same_type<typename LeftT::layout,col_major>::is_true
+    };
+
+    /* The row-major kernel computes B'*A' for column-major data: */
+    const float* a = col_major_args ? right.data() : left.data();
+    const float* b = col_major_args ? left.data() : right.data();
+    kernel::mul(a, b, C.data());
+}
+#endif
 
 /** Matrix multiplication.
  *
@@ -110,17 +246,10 @@ mul(const LeftT& left, const RightT& right)
     result_type C;
     cml::et::detail::Resize(C, N);
 
-    /* XXX Specialize this for fixed-size matrices: */
-    typedef typename result_type::value_type value_type;
-    for(size_t i = 0; i < left.rows(); ++i) {               /* rows */
-        for(size_t j = 0; j < right.cols(); ++j) {          /* cols */
-            value_type sum(left(i,0)*right(0,j));
-            for(size_t k = 1; k < right.rows(); ++k) {
-                sum += (left(i,k)*right(k,j));
-            }
-            C(i,j) = sum;
-        }
-    }
+    /* Fixed-size 3x3 and 4x4 float products use the SIMD kernels: */
+    typedef typename et::MatMulSimdTraits<
+        LeftT,RightT,result_type>::result simd_tag;
+    detail::MatMulInto(left, right, C, simd_tag());
 
     return C;
 }
@@ -0,0 +1,118 @@
+/* -*- C++ -*- ------------------------------------------------------------
+
+Copyright (c) 2007 Jesse Anders and Demian Nave http://cmldev.net/
+
+The Configurable Math Library (CML) is distributed under the terms of the
+Boost Software License, v1.0 (see cml/LICENSE for details).
+
+ *-----------------------------------------------------------------------*/
+/** @file
+ *  @brief SSE/AVX kernels for fixed-size 3x3 and 4x4 float matrix products.
+ *
+ * The kernels work on row-major arrays: each row of C is a sum of the rows
+ * of B, weighted by the matching row of A.  Column-major arguments are
+ * handled by swapping them, since the transpose of A*B is B'*A'.
+ *
+ * Each element sums its products in the same order as the generic loop in
+ * matrix_mul.h, so the results match it unless the compiler contracts the
+ * multiply-adds.
+ */
+
+#ifndef matrix_mul_simd_h
+#define matrix_mul_simd_h
+
+#include <cml/core/simd.h>
+
+#if defined(CML_SIMD_MATMUL)
+
+namespace cml {
+namespace detail {
+
+/** Row-major 4x4 product C = A*B. */
+inline void MatMulSimd44(const float* a, const float* b, float* c)
+{
+#if defined(__AVX__)
+    /* Two rows of C per iteration, with each row of B in both halves: */
+    __m256 b0 = _mm256_broadcast_ps((const __m128*) (b+0));
+    __m256 b1 = _mm256_broadcast_ps((const __m128*) (b+4));
+    __m256 b2 = _mm256_broadcast_ps((const __m128*) (b+8));
+    __m256 b3 = _mm256_broadcast_ps((const __m128*) (b+12));
+    for(int i = 0; i < 16; i += 8) {
+        __m256 ai = _mm256_loadu_ps(a+i);
+        __m256 sum = _mm256_mul_ps(_mm256_shuffle_ps(ai,ai,0x00), b0);
+        sum = _mm256_add_ps(sum,
+                _mm256_mul_ps(_mm256_shuffle_ps(ai,ai,0x55), b1));
+        sum = _mm256_add_ps(sum,
+                _mm256_mul_ps(_mm256_shuffle_ps(ai,ai,0xAA), b2));
+        sum = _mm256_add_ps(sum,
+                _mm256_mul_ps(_mm256_shuffle_ps(ai,ai,0xFF), b3));
+        _mm256_storeu_ps(c+i, sum);
+    }
+#else
+    __m128 b0 = _mm_loadu_ps(b+0);
+    __m128 b1 = _mm_loadu_ps(b+4);
+    __m128 b2 = _mm_loadu_ps(b+8);
+    __m128 b3 = _mm_loadu_ps(b+12);
+    for(int i = 0; i < 16; i += 4) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(a[i+0]), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i+1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i+2]), b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i+3]), b3));
+        _mm_storeu_ps(c+i, sum);
+    }
+#endif
+}
+
+/** Store three 3-float rows as one packed 3x3 array.
+ *
+ * The rows go out as two full stores and one single store, so a later
+ * 16-byte load of the array reads from a single store.
+ */
+inline void MatMulSimdStore33(float* c, __m128 r0, __m128 r1, __m128 r2)
+{
+    __m128 t = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(0,0,2,2));
+    _mm_storeu_ps(c+0, _mm_shuffle_ps(r0, t, _MM_SHUFFLE(2,0,1,0)));
+    _mm_storeu_ps(c+4, _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(1,0,2,1)));
+    _mm_store_ss(c+8, _mm_movehl_ps(r2,r2));
+}
+
+/** Row-major 3x3 product C = A*B. */
+inline void MatMulSimd33(const float* a, const float* b, float* c)
+{
+    __m128 b0 = SimdLoad3(b+0);
+    __m128 b1 = SimdLoad3(b+3);
+    __m128 b2 = SimdLoad3(b+6);
+    __m128 rows[3];
+    for(int i = 0; i < 3; ++i) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(a[i*3+0]), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i*3+1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a[i*3+2]), b2));
+        rows[i] = sum;
+    }
+    MatMulSimdStore33(c, rows[0], rows[1], rows[2]);
+}
+
+/** Dispatch to the kernel for an N x N product. */
+template<int N> struct MatMulSimdKernel;
+
+template<> struct MatMulSimdKernel<3> {
+    static void mul(const float* a, const float* b, float* c) {
+        MatMulSimd33(a,b,c);
+    }
+};
+
+template<> struct MatMulSimdKernel<4> {
+    static void mul(const float* a, const float* b, float* c) {
+        MatMulSimd44(a,b,c);
+    }
+};
+
+} // namespace detail
+} // namespace cml
+
+#endif // CML_SIMD_MATMUL
+
+#endif
+
+// -------------------------------------------------------------------------
+// vim:ft=cpp
@@ -13,6 +13,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #ifndef matrix_traits_h
 #define matrix_traits_h
 
+#include <cml/core/cml_meta.h>
 #include <cml/et/traits.h>
 
 namespace cml {
@@ -40,6 +41,61 @@ struct ExprTraits< cml::matrix<E,AT,BO,L> >
     size_t cols(const expr_type& m) const { return m.cols(); }
 };
 
+/** Select the SIMD kernel for a matrix product at compile time.
+ *
+ * The kernel is used when both arguments and the result are fixed-size
+ * 3x3 or 4x4 float matrices that share a memory layout.  Anything else uses
+ * the generic loop.
+ *
+ * @note With CML_ALWAYS_PROMOTE_TO_DEFAULT_LAYOUT (the default), the product
+ * of two column-major matrices is row-major, so it uses the generic loop:
+ * the compiler folds that loop into the layout change, which is faster than
+ * the kernel followed by a transpose.
+ *
+ * @sa CML_SIMD_MATMUL, CML_NO_SIMD_MATMUL
+ */
+template<typename LeftT, typename RightT, typename ResultT>
+struct MatMulSimdTraits
+{
+    typedef typename cml::remove_const<
+        typename LeftT::value_type>::type left_value;
+    typedef typename cml::remove_const<
+        typename RightT::value_type>::type right_value;
+    typedef typename cml::remove_const<
+        typename ResultT::value_type>::type result_value;
+
+    enum {
+        float_values = same_type<left_value,float>::is_true
+            && same_type<right_value,float>::is_true
+            && same_type<result_value,float>::is_true,
+
+        fixed_sizes =
+            same_type<typename LeftT::size_tag,fixed_size_tag>::is_true
+            && same_type<typename RightT::size_tag,fixed_size_tag>::is_true
+            && same_type<typename ResultT::size_tag,fixed_size_tag>::is_true,
+
+        array_size = LeftT::array_rows,
+
+        square_sizes = (int) LeftT::array_cols == (int) array_size
+            && (int) RightT::array_rows == (int) array_size
+            && (int) RightT::array_cols == (int) array_size
+            && (array_size == 3 || array_size == 4),
+
+        same_layout =
+            same_type<typename LeftT::layout,typename RightT::layout>::is_true
+            && same_type<typename LeftT::layout,typename ResultT::layout>::is_true
+    };
+
+#if defined(CML_SIMD_MATMUL)
+    enum { is_true = float_values && fixed_sizes
+        && square_sizes && same_layout };
+#else
+    enum { is_true = false };
+#endif
+
+    typedef typename select_if<is_true,true_type,false_type>::result result;
+};
+
 } // namespace et
 } // namespace cml
 
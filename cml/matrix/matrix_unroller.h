@@ -9,8 +9,6 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 /** @file
  *  @brief
  *
- * @todo Need to implement unrolling for efficient col-major array access.
- *
  * @todo Does it make sense to unroll an assignment if either side of the
  * assignment has a fixed size, or just when the target matrix is fixed
  * size?
@@ -43,8 +41,6 @@ namespace detail {
  * @sa cml::et::OpAssign
  *
  * @bug Need to verify that OpT is actually an assignment operator.
- * @bug The 2D unroller needs to be specified for efficient col-major
- * access.
  */
 template<class OpT, typename E, class AT, typename BO, typename L, class SrcT>
 class MatrixAssignmentUnroller
@@ -61,76 +57,58 @@ class MatrixAssignmentUnroller
 #if defined(CML_2D_UNROLLER)
 
     /* Forward declare: */
-    template<int R, int C, int LastRow, int LastCol, bool can_unroll>
-        struct Eval;
-
-    /* XXX This needs to be specified for efficient col-major access also! */
-
-    /** Evaluate the binary operator at element R,C. */
-    template<int R, int C, int LastRow, int LastCol>
-        struct Eval<R,C,LastRow,LastCol,true> {
-            void operator()(matrix_type& dest, const SrcT& src) const {
-
-                /* Apply to current R,C: */
-                OpT().apply(dest(R,C), src_traits().get(src,R,C));
-
-                /* Evaluate at R,C+1: */
-                Eval<R,C+1,LastRow,LastCol,true>()(dest,src);
-            }
-        };
-
-    /** Evaluate the binary operator at element R,LastCol. */
-    template<int R, int LastRow, int LastCol>
-        struct Eval<R,LastCol,LastRow,LastCol,true> {
-            void operator()(matrix_type& dest, const SrcT& src) const {
+    template<int I, int Last, bool can_unroll> struct Eval;
 
-                /* Apply to R,LastCol: */
-                OpT().apply(dest(R,LastCol), src_traits().get(src,R,LastCol));
-
-                /* Evaluate at R+1,0; i.e. move to next row and start the
-                 * col iteration from 0:
-                 */
-                Eval<R+1,0,LastRow,LastCol,true>()(dest,src);
-            }
+    /** Map the storage index I to a row and column.
+     *
+     * Elements are visited in memory order, so row-major matrices are
+     * walked by rows and col-major matrices by columns.
+     */
+    template<int I> struct Index {
+        enum {
+            Rows = matrix_type::array_rows,
+            Cols = matrix_type::array_cols,
+            by_rows = same_type<L,row_major>::is_true,
+            R = by_rows ? I / Cols : I % Rows,
+            C = by_rows ? I % Cols : I / Rows
         };
+    };
 
-    /** Evaluate the binary operator at element LastRow,C. */
-    template<int C, int LastRow, int LastCol>
-        struct Eval<LastRow,C,LastRow,LastCol,true> {
-            void operator()(matrix_type& dest, const SrcT& src) const {
-
-                /* Apply to LastRow,C: */
-                OpT().apply(dest(LastRow,C), src_traits().get(src,LastRow,C));
-
-                /* Evaluate at LastRow,C+1: */
-                Eval<LastRow,C+1,LastRow,LastCol,true>()(dest,src);
-            }
-        };
+    /** Evaluate the binary operator at storage index I. */
+    template<int I, int Last> struct Eval<I,Last,true> {
+        void operator()(matrix_type& dest, const SrcT& src) const {
 
-    /** Evaluate the binary operator at element LastRow,LastCol. */
-    template<int LastRow, int LastCol>
-        struct Eval<LastRow,LastCol,LastRow,LastCol,true> {
-            void operator()(matrix_type& dest, const SrcT& src) const {
+            /* Apply to the current element: */
+            typedef Index<I> index;
+            OpT().apply(
+                    dest(index::R,index::C),
+                    src_traits().get(src,index::R,index::C));
 
-                /* Apply to LastRow,LastCol: */
-                OpT().apply(
-                        dest(LastRow,LastCol),
-                        src_traits().get(src,LastRow,LastCol));
-            }
-        };
+            /* Evaluate at the next element: */
+            Eval<I+1,Last,true>()(dest,src);
+        }
+    };
 
+    /** Evaluate the binary operator at the last element. */
+    template<int Last> struct Eval<Last,Last,true> {
+        void operator()(matrix_type& dest, const SrcT& src) const {
+            typedef Index<Last> index;
+            OpT().apply(
+                    dest(index::R,index::C),
+                    src_traits().get(src,index::R,index::C));
+        }
+    };
 
     /** Evaluate operators on large matrices using a loop. */
-    template<int R, int C, int LastRow, int LastCol>
-        struct Eval<R,C,LastRow,LastCol,false> {
-            void operator()(matrix_type& dest, const SrcT& src) const {
-                for(size_t i = 0; i <= LastRow; ++i) {
-                    for(size_t j = 0; j <= LastCol; ++j) {
-                        OpT().apply(dest(i,j), src_traits().get(src,i,j));
-                    }
+    template<int I, int Last> struct Eval<I,Last,false> {
+        void operator()(matrix_type& dest, const SrcT& src) const {
+            for(size_t i = 0; i < dest.rows(); ++i) {
+                for(size_t j = 0; j < dest.cols(); ++j) {
+                    OpT().apply(dest(i,j), src_traits().get(src,i,j));
                 }
             }
-        };
+        }
+    };
 
 #endif // CML_2D_UNROLLER
 
@@ -165,7 +143,7 @@ class MatrixAssignmentUnroller
 
 #if defined(CML_2D_UNROLLER)
         typedef typename MatrixAssignmentUnroller<OpT,E,AT,BO,L,SrcT>
-            ::template Eval<0, 0, LastRow, LastCol,
+            ::template Eval<0, Max-1,
             (Max <= CML_MATRIX_UNROLL_LIMIT)> Unroller;
 #endif
 
@@ -17,6 +17,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #include <cml/vector/vector_expr.h>
 #include <cml/vector/class_ops.h>
 #include <cml/vector/vector_unroller.h>
+#include <cml/vector/vector_simd.h>
 #include <cml/vector/external.h>
 #include <cml/util.h>
 
@@ -91,7 +92,9 @@ class vector< Element, fixed<Size> >
 
     /** Normalize the vector. */
     vector_type& normalize() {
-        return (*this /= length());
+        typedef typename et::VectorSimdTraits<
+            vector_type,vector_type>::result simd_tag;
+        return normalize(simd_tag());
     }
 
     /** Set this vector to [0]. */
@@ -181,6 +184,22 @@ class vector< Element, fixed<Size> >
 
     CML_VEC_ASSIGN_FROM_SCALAR(*=, cml::et::OpMulAssign)
     CML_VEC_ASSIGN_FROM_SCALAR(/=, cml::et::OpDivAssign)
+
+
+  protected:
+
+    /** Normalize using the expression templates. */
+    vector_type& normalize(false_type) {
+        return (*this /= length());
+    }
+
+#if defined(CML_ALIGNED_VECTOR_STORAGE)
+    /** Normalize aligned, padded storage with the SIMD kernel. */
+    vector_type& normalize(true_type) {
+        detail::VectorSimdNormalize<Size>(this->data());
+        return *this;
+    }
+#endif
 };
 
 } // namespace cml
@@ -21,6 +21,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #include <cml/et/size_checking.h>
 #include <cml/vector/vector_unroller.h>
 #include <cml/vector/vector_expr.h>
+#include <cml/vector/vector_simd.h>
 #include <cml/matrix/matrix_expr.h>
 
 /* This is used below to create a more meaningful compile-time error when
@@ -167,6 +168,49 @@ UnrollDot(const LeftT& left, const RightT& right, dynamic_size_tag)
     return sum;
 }
 
+/** Compute the dot product with the unrollers. */
+template<typename LeftT, typename RightT, typename SizeTag>
+inline typename DotPromote<LeftT,RightT>::promoted_scalar
+DispatchDot(const LeftT& left, const RightT& right, SizeTag, false_type)
+{
+    return UnrollDot(left,right,SizeTag());
+}
+
+/** Compute the cross product element by element. */
+template<typename ResultT, typename LeftT, typename RightT>
+inline ResultT
+DispatchCross(const LeftT& left, const RightT& right, false_type)
+{
+    return ResultT(
+            left[1]*right[2] - left[2]*right[1],
+            left[2]*right[0] - left[0]*right[2],
+            left[0]*right[1] - left[1]*right[0]
+            );
+}
+
+#if defined(CML_ALIGNED_VECTOR_STORAGE)
+/** Compute the dot product of two aligned, padded vectors.
+ *
+ * @sa et::VectorSimdTraits
+ */
+template<typename LeftT, typename RightT, typename SizeTag>
+inline float
+DispatchDot(const LeftT& left, const RightT& right, SizeTag, true_type)
+{
+    return VectorSimdDot<LeftT::array_size>(left.data(), right.data());
+}
+
+/** Compute the cross product of two aligned, padded 3D vectors. */
+template<typename ResultT, typename LeftT, typename RightT>
+inline ResultT
+DispatchCross(const LeftT& left, const RightT& right, true_type)
+{
+    ResultT result;
+    VectorSimdCross(left.data(), right.data(), result.data());
+    return result;
+}
+#endif
+
 /** For cross(): compile-time check for a 3D vector. */
 template<typename VecT> inline void
 Require3D(const VecT&, fixed_size_tag) {
@@ -228,8 +272,9 @@ dot(const LeftT& left, const RightT& right)
         left_type, right_type>::temporary_type promoted_vector;
     typedef typename promoted_vector::size_tag size_tag;
 
-    /* Call unroller: */
-    return detail::UnrollDot(left,right,size_tag());
+    /* Call the SIMD kernel or the unroller: */
+    typedef typename et::VectorSimdTraits<LeftT,RightT>::result simd_tag;
+    return detail::DispatchDot(left,right,size_tag(),simd_tag());
 }
 
 /** perp_dot()
@@ -293,12 +338,8 @@ cross(const LeftT& left, const RightT& right)
         LeftT,RightT>::promoted_vector result_type;
 
     /* Now, compute and return the cross product: */
-    result_type result(
-            left[1]*right[2] - left[2]*right[1],
-            left[2]*right[0] - left[0]*right[2],
-            left[0]*right[1] - left[1]*right[0]
-            );
-    return result;
+    typedef typename et::VectorSimdTraits<LeftT,RightT>::result simd_tag;
+    return detail::DispatchCross<result_type>(left,right,simd_tag());
 }
 
 /** Return the triple product of three 3D vectors.
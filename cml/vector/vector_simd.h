@@ -0,0 +1,120 @@
+/* -*- C++ -*- ------------------------------------------------------------
+
+Copyright (c) 2007 Jesse Anders and Demian Nave http://cmldev.net/
+
+The Configurable Math Library (CML) is distributed under the terms of the
+Boost Software License, v1.0 (see cml/LICENSE for details).
+
+ *-----------------------------------------------------------------------*/
+/** @file
+ *  @brief SSE kernels for fixed-size float 3D and 4D vectors.
+ *
+ * Except for VectorSimdTransformPoint(), the kernels need the aligned,
+ * padded storage selected by CML_ALIGNED_VECTOR_STORAGE: they load all
+ * four lanes and rely on the fourth lane of a 3D vector being 0.
+ *
+ * Sums are taken in the same order as the generic unrollers, so results
+ * match the scalar code.
+ */
+
+#ifndef vector_simd_h
+#define vector_simd_h
+
+#include <cml/core/simd.h>
+
+#if defined(CML_SIMD)
+
+namespace cml {
+namespace detail {
+
+/** Return p[0] + (p[1] + p[2]), the order used by the dot() unroller. */
+inline float VectorSimdSum3(__m128 p)
+{
+    __m128 tail = _mm_add_ss(
+        _mm_shuffle_ps(p,p,_MM_SHUFFLE(1,1,1,1)),
+        _mm_shuffle_ps(p,p,_MM_SHUFFLE(2,2,2,2)));
+    return _mm_cvtss_f32(_mm_add_ss(p, tail));
+}
+
+/** Return p[0] + (p[1] + (p[2] + p[3])). */
+inline float VectorSimdSum4(__m128 p)
+{
+    __m128 tail = _mm_add_ss(
+        _mm_shuffle_ps(p,p,_MM_SHUFFLE(2,2,2,2)),
+        _mm_shuffle_ps(p,p,_MM_SHUFFLE(3,3,3,3)));
+    tail = _mm_add_ss(_mm_shuffle_ps(p,p,_MM_SHUFFLE(1,1,1,1)), tail);
+    return _mm_cvtss_f32(_mm_add_ss(p, tail));
+}
+
+/** Dot product of two aligned N-lane vectors. */
+template<int N> inline float VectorSimdDot(const float* a, const float* b)
+{
+    __m128 p = _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b));
+    return (N == 3) ? VectorSimdSum3(p) : VectorSimdSum4(p);
+}
+
+/** Cross product of two aligned, padded 3D vectors. */
+inline void VectorSimdCross(const float* a, const float* b, float* c)
+{
+    __m128 va = _mm_load_ps(a);
+    __m128 vb = _mm_load_ps(b);
+    __m128 a_yzx = _mm_shuffle_ps(va,va,_MM_SHUFFLE(3,0,2,1));
+    __m128 b_yzx = _mm_shuffle_ps(vb,vb,_MM_SHUFFLE(3,0,2,1));
+    __m128 a_zxy = _mm_shuffle_ps(va,va,_MM_SHUFFLE(3,1,0,2));
+    __m128 b_zxy = _mm_shuffle_ps(vb,vb,_MM_SHUFFLE(3,1,0,2));
+    _mm_store_ps(c, _mm_sub_ps(
+                _mm_mul_ps(a_yzx,b_zxy), _mm_mul_ps(a_zxy,b_yzx)));
+}
+
+/** Normalize an aligned N-lane vector in place. */
+template<int N> inline void VectorSimdNormalize(float* v)
+{
+    __m128 vv = _mm_load_ps(v);
+    __m128 length = _mm_sqrt_ss(_mm_set_ss(VectorSimdDot<N>(v,v)));
+    vv = _mm_div_ps(vv, _mm_shuffle_ps(length,length,0));
+    if(N == 3) {
+        /* Keep the padding lane 0, even for a zero-length vector: */
+        vv = _mm_movelh_ps(vv, _mm_unpackhi_ps(vv, _mm_setzero_ps()));
+    }
+    _mm_store_ps(v, vv);
+}
+
+/** Compute c = (1-u)*a + u*b for aligned 4-lane vectors. */
+inline void VectorSimdLerp(const float* a, const float* b, float u, float* c)
+{
+    __m128 wa = _mm_set1_ps(1.f - u);
+    __m128 wb = _mm_set1_ps(u);
+    _mm_store_ps(c, _mm_add_ps(
+                _mm_mul_ps(wa,_mm_load_ps(a)), _mm_mul_ps(wb,_mm_load_ps(b))));
+}
+
+/** Apply an affine 4x4 transform to a 3D point.
+ *
+ * @param basis the matrix data, with each basis vector stored as 4
+ * contiguous floats.
+ * @param v the point, which need not be aligned or padded.
+ * @param result receives the 3 transformed coordinates.
+ */
+inline void VectorSimdTransformPoint(
+        const float* basis, const float* v, float* result)
+{
+    __m128 p = SimdLoad3(v);
+    __m128 sum = _mm_mul_ps(
+            _mm_loadu_ps(basis+0), _mm_shuffle_ps(p,p,_MM_SHUFFLE(0,0,0,0)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(
+            _mm_loadu_ps(basis+4), _mm_shuffle_ps(p,p,_MM_SHUFFLE(1,1,1,1))));
+    sum = _mm_add_ps(sum, _mm_mul_ps(
+            _mm_loadu_ps(basis+8), _mm_shuffle_ps(p,p,_MM_SHUFFLE(2,2,2,2))));
+    sum = _mm_add_ps(sum, _mm_loadu_ps(basis+12));
+    SimdStore3(result, sum);
+}
+
+} // namespace detail
+} // namespace cml
+
+#endif // CML_SIMD
+
+#endif
+
+// -------------------------------------------------------------------------
+// vim:ft=cpp
@@ -13,6 +13,7 @@ Boost Software License, v1.0 (see cml/LICENSE for details).
 #ifndef vector_traits_h
 #define vector_traits_h
 
+#include <cml/core/cml_meta.h>
 #include <cml/et/traits.h>
 
 namespace cml {
@@ -37,6 +38,43 @@ struct ExprTraits< cml::vector<E,AT> >
     size_t size(const expr_type& v) const { return v.size(); }
 };
 
+/** Detect vectors using the aligned, padded storage policy.
+ *
+ * @sa CML_ALIGNED_VECTOR_STORAGE
+ */
+template<typename T> struct VectorSimdStorage {
+    enum { is_true = false, array_size = 0 };
+};
+
+#if defined(CML_ALIGNED_VECTOR_STORAGE)
+template<> struct VectorSimdStorage< cml::vector< float, fixed<3,-1> > > {
+    enum { is_true = true, array_size = 3 };
+};
+
+template<> struct VectorSimdStorage< cml::vector< float, fixed<4,-1> > > {
+    enum { is_true = true, array_size = 4 };
+};
+#endif
+
+/** Select the SIMD kernels for a binary vector operation at compile time.
+ *
+ * The kernels are used when both arguments are aligned, padded vectors of
+ * the same size.  Anything else, including expressions, external and
+ * dynamic vectors, uses the generic code.
+ */
+template<typename LeftT, typename RightT> struct VectorSimdTraits
+{
+    typedef VectorSimdStorage<LeftT> left_storage;
+    typedef VectorSimdStorage<RightT> right_storage;
+
+    enum {
+        is_true = left_storage::is_true && right_storage::is_true
+            && (int) left_storage::array_size == (int) right_storage::array_size
+    };
+
+    typedef typename select_if<is_true,true_type,false_type>::result result;
+};
+
 } // namespace et
 } // namespace cml
 